@@ -0,0 +1,75 @@
+/*
+ * Small allocations from an arena and the node allocations of queue and
+ * stack, committing one page at a time against larger commit-ahead steps
+ * and geometric growth.
+ *
+ * usage: arena_alloc [allocations]
+ */
+#include "arena.h"
+#include "bench.h"
+#include "queue.h"
+#include "stack.h"
+
+#include <stdlib.h>
+
+#define ALLOCATION_SIZE 16
+
+static const struct {
+  const char *name;
+  uint64_t commit_ahead;
+} steps[] = {
+    {"page", KB(4)},
+    {"64 KB", KB(64)},
+    {"2 MB", MB(2)},
+    {"geometric", 0},
+};
+
+int main(int argc, char **argv) {
+  const unsigned int count = argc > 1 ? atoi(argv[1]) : 16000000;
+  char label[64];
+
+  printf("=========arena allocation benchmark========\n");
+  printf("allocations: %u\n", count);
+
+  for (unsigned int s = 0; s < sizeof(steps) / sizeof(*steps); s++) {
+    arena *arena;
+    queue *q;
+    stack *st;
+
+    arena_create(&arena, GB(4));
+    arena_set_commit_ahead(arena, steps[s].commit_ahead);
+    uint64_t start = bench_now_ns();
+    for (unsigned int i = 0; i < count; i++) {
+      char *memory = arena_alloc(arena, ALLOCATION_SIZE, 8, 0);
+      memory[0] = (char)i;
+    }
+    snprintf(label, sizeof(label), "arena_alloc %d B, %s", ALLOCATION_SIZE,
+             steps[s].name);
+    bench_report(label, count, bench_now_ns() - start);
+    arena_destroy(&arena);
+
+    arena_create(&arena, GB(4));
+    arena_set_commit_ahead(arena, steps[s].commit_ahead);
+    queue_create(&q, arena);
+    start = bench_now_ns();
+    for (unsigned int i = 0; i < count; i++) {
+      queue_enqueue(q, arena);
+    }
+    snprintf(label, sizeof(label), "queue_enqueue, %s", steps[s].name);
+    bench_report(label, count, bench_now_ns() - start);
+    arena_destroy(&arena);
+
+    arena_create(&arena, GB(4));
+    arena_set_commit_ahead(arena, steps[s].commit_ahead);
+    stack_create(&st, arena);
+    start = bench_now_ns();
+    for (unsigned int i = 0; i < count; i++) {
+      stack_push(st, arena);
+    }
+    snprintf(label, sizeof(label), "stack_push, %s", steps[s].name);
+    bench_report(label, count, bench_now_ns() - start);
+    arena_destroy(&arena);
+  }
+
+  return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * Allocation throughput of threads sharing one arena, arena_alloc behind a
+ * mutex against arena_alloc_concurrent, from 1 to 64 threads. The first
+ * line is plain arena_alloc on one thread, the path concurrent allocation
+ * must not slow down.
+ *
+ * usage: arena_concurrent [max_threads] [allocations]
+ */
+#include "arena.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#define ALLOCATION_SIZE 24
+
+typedef struct run {
+  arena *shared;
+  pthread_mutex_t *lock; // NULL for arena_alloc_concurrent
+  unsigned int allocations;
+} run;
+
+static void *worker(void *arg) {
+  run *r = arg;
+
+  for (unsigned int i = 0; i < r->allocations; i++) {
+    char *memory;
+
+    if (r->lock == NULL) {
+      memory = arena_alloc_concurrent(r->shared, ALLOCATION_SIZE, 8, 0);
+    } else {
+      pthread_mutex_lock(r->lock);
+      memory = arena_alloc(r->shared, ALLOCATION_SIZE, 8, 0);
+      pthread_mutex_unlock(r->lock);
+    }
+
+    memory[0] = (char)i;
+  }
+
+  return NULL;
+}
+
+static void measure(int use_lock, unsigned int threads,
+                    unsigned int allocations) {
+  arena *shared;
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  pthread_t ids[threads];
+  run r = {.lock = use_lock ? &lock : NULL,
+           .allocations = allocations / threads};
+  char label[64];
+
+  // Room for the alignment padding of the concurrent path.
+  arena_create(&shared, (uint64_t)allocations * (ALLOCATION_SIZE + 8));
+  r.shared = shared;
+
+  const uint64_t start = bench_now_ns();
+  for (unsigned int i = 0; i < threads; i++) {
+    pthread_create(&ids[i], NULL, worker, &r);
+  }
+  for (unsigned int i = 0; i < threads; i++) {
+    pthread_join(ids[i], NULL);
+  }
+
+  snprintf(label, sizeof(label), "%s %u threads",
+           use_lock ? "mutex arena_alloc" : "arena_alloc_concurrent", threads);
+  bench_report(label, (uint64_t)r.allocations * threads,
+               bench_now_ns() - start);
+
+  arena_destroy(&shared);
+}
+
+int main(int argc, char **argv) {
+  const unsigned int max_threads = argc > 1 ? atoi(argv[1]) : 64;
+  const unsigned int allocations = argc > 2 ? atoi(argv[2]) : 8000000;
+  arena *arena;
+
+  printf("=========arena concurrent allocation benchmark========\n");
+  printf("allocations: %u of %d bytes\n", allocations, ALLOCATION_SIZE);
+
+  arena_create(&arena, (uint64_t)allocations * ALLOCATION_SIZE);
+  const uint64_t start = bench_now_ns();
+  for (unsigned int i = 0; i < allocations; i++) {
+    char *memory = arena_alloc(arena, ALLOCATION_SIZE, 8, 0);
+    memory[0] = (char)i;
+  }
+  bench_report("arena_alloc 1 thread", allocations, bench_now_ns() - start);
+  arena_destroy(&arena);
+
+  for (unsigned int threads = 1; threads <= max_threads; threads <<= 1) {
+    measure(1, threads, allocations);
+    measure(0, threads, allocations);
+  }
+
+  return 0;
+}
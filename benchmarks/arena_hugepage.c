@@ -0,0 +1,90 @@
+/*
+ * Random hash_table lookups with the table and its keys in an arena of
+ * regular pages, of transparent huge pages and of MAP_HUGETLB pages. A
+ * table much larger than what the TLB covers with 4 KB pages misses it on
+ * nearly every lookup.
+ *
+ * usage: arena_hugepage [entries]
+ */
+#include "arena.h"
+#include "bench.h"
+#include "hash_table.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEY_SIZE 16
+#define LOOKUPS 4000000
+
+/**
+ * Print how much of the process is backed by transparent huge pages.
+ */
+static void print_huge_pages(void) {
+  char line[256];
+  FILE *smaps = fopen("/proc/self/smaps_rollup", "r");
+
+  if (smaps == NULL) {
+    return;
+  }
+
+  while (fgets(line, sizeof(line), smaps) != NULL) {
+    if (strncmp(line, "AnonHugePages:", 14) == 0) {
+      printf("%-40s %s", "", line);
+    }
+  }
+
+  fclose(smaps);
+}
+
+static void measure(const char *label, unsigned int flags,
+                    unsigned int count) {
+  arena *arena;
+  hash_table *ht;
+  uint64_t state = 42;
+  void *value;
+
+  if (arena_create_ex(&arena, GB(4), flags) == 1) {
+    printf("%-40s unavailable\n", label);
+    return;
+  }
+
+  hash_table_create(&ht, count, NULL, arena);
+
+  char *keys = arena_alloc(arena, (uint64_t)count * KEY_SIZE, alignof(char), 0);
+  for (unsigned int i = 0; i < count; i++) {
+    snprintf(keys + (uint64_t)i * KEY_SIZE, KEY_SIZE, "key:%010u", i);
+    hash_table_insert(ht, keys + (uint64_t)i * KEY_SIZE, &keys[i]);
+  }
+
+  uint64_t found = 0;
+  const uint64_t start = bench_now_ns();
+  for (unsigned int i = 0; i < LOOKUPS; i++) {
+    const uint64_t index = bench_random(&state) % count;
+    found += hash_table_lookup(ht, keys + index * KEY_SIZE, &value) == 0;
+  }
+  bench_report(label, LOOKUPS, bench_now_ns() - start);
+  print_huge_pages();
+
+  if (found != LOOKUPS) {
+    fprintf(stderr, "missing keys: %llu\n",
+            (unsigned long long)(LOOKUPS - found));
+  }
+
+  arena_destroy(&arena);
+}
+
+int main(int argc, char **argv) {
+  const unsigned int count = argc > 1 ? atoi(argv[1]) : 1 << 24;
+
+  printf("=========arena huge page benchmark========\n");
+  printf("entries: %u, random lookups: %d\n", count, LOOKUPS);
+
+  measure("4 KB pages", 0, count);
+  measure("4 KB pages, 2 MB commits", ARENA_COMMIT_HUGE, count);
+  measure("transparent huge pages", ARENA_HUGEPAGE | ARENA_COMMIT_HUGE,
+          count);
+  measure("MAP_HUGETLB", ARENA_HUGETLB, count);
+
+  return 0;
+}
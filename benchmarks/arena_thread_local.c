@@ -0,0 +1,91 @@
+/*
+ * Allocation throughput of threads sharing one arena behind a mutex against
+ * each thread using its arena_thread_local.
+ *
+ * Every thread makes the same number of small allocations and touches
+ * each one. The thread-local arenas go back to the pool between runs.
+ *
+ * usage: arena_thread_local [max_threads] [allocations_per_thread]
+ */
+#include "arena.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#define ALLOCATION_SIZE 24
+
+typedef struct run {
+  arena *shared; // NULL for the thread-local arenas
+  pthread_mutex_t *lock;
+  unsigned int allocations;
+} run;
+
+static void *worker(void *arg) {
+  run *r = arg;
+
+  if (r->shared == NULL) {
+    arena *local = arena_thread_local();
+
+    for (unsigned int i = 0; i < r->allocations; i++) {
+      char *memory = arena_alloc(local, ALLOCATION_SIZE, 8, 0);
+      memory[0] = (char)i;
+    }
+  } else {
+    for (unsigned int i = 0; i < r->allocations; i++) {
+      pthread_mutex_lock(r->lock);
+      char *memory = arena_alloc(r->shared, ALLOCATION_SIZE, 8, 0);
+      pthread_mutex_unlock(r->lock);
+      memory[0] = (char)i;
+    }
+  }
+
+  return NULL;
+}
+
+static void measure(int use_shared, unsigned int threads,
+                    unsigned int allocations) {
+  arena *shared = NULL;
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  pthread_t ids[threads];
+  run r = {.lock = &lock, .allocations = allocations};
+  char label[64];
+
+  if (use_shared) {
+    arena_create(&shared, (uint64_t)threads * allocations * ALLOCATION_SIZE);
+    r.shared = shared;
+  }
+
+  const uint64_t start = bench_now_ns();
+  for (unsigned int i = 0; i < threads; i++) {
+    pthread_create(&ids[i], NULL, worker, &r);
+  }
+  for (unsigned int i = 0; i < threads; i++) {
+    pthread_join(ids[i], NULL);
+  }
+
+  snprintf(label, sizeof(label), "%s %u threads",
+           use_shared ? "mutex arena" : "thread-local arena", threads);
+  bench_report(label, (uint64_t)threads * allocations,
+               bench_now_ns() - start);
+
+  if (shared != NULL) {
+    arena_destroy(&shared);
+  }
+}
+
+int main(int argc, char **argv) {
+  const unsigned int max_threads = argc > 1 ? atoi(argv[1]) : 8;
+  const unsigned int allocations = argc > 2 ? atoi(argv[2]) : 4000000;
+
+  printf("=========arena thread-local benchmark========\n");
+  printf("allocations per thread: %u of %d bytes\n", allocations,
+         ALLOCATION_SIZE);
+
+  for (unsigned int threads = 1; threads <= max_threads; threads <<= 1) {
+    measure(1, threads, allocations);
+    measure(0, threads, allocations);
+  }
+
+  return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * @file bench.h
+ *
+ * @brief Helpers shared by the benchmarks.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * @brief Monotonic time in nanoseconds.
+ */
+static inline uint64_t bench_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief splitmix64, a small deterministic generator for benchmark inputs.
+ *
+ * @param state generator state, updated on every call.
+ */
+static inline uint64_t bench_random(uint64_t *state) {
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+  return z ^ (z >> 31);
+}
+
+/**
+ * @brief Print a throughput line in million operations per second.
+ *
+ * @param label what was measured
+ * @param operations number of operations timed
+ * @param elapsed_ns time taken
+ */
+static inline void bench_report(const char *label, uint64_t operations,
+                                uint64_t elapsed_ns) {
+  printf("%-40s %10.2f Mops/s %8.2f ns/op\n", label,
+         (double)operations * 1e3 / (double)elapsed_ns,
+         (double)elapsed_ns / (double)operations);
+}
+
+#endif // BENCH_H
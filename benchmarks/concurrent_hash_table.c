@@ -0,0 +1,141 @@
+/*
+ * Thread scaling of concurrent_hash_table against a hash_table behind one
+ * global mutex, for 90/10 and 50/50 read/write mixes.
+ *
+ * Writes are insert_or_update over twice the prefilled key set, so half of
+ * them add keys and the table keeps growing during the run.
+ *
+ * usage: concurrent_hash_table [max_threads] [keys]
+ */
+#include "arena.h"
+#include "bench.h"
+#include "concurrent_hash_table.h"
+#include "hash_table.h"
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdlib.h>
+
+#define KEY_SIZE 24
+#define OPERATIONS 4000000 // split across the threads
+
+typedef struct run {
+  concurrent_hash_table *concurrent;
+  hash_table *locked;
+  pthread_mutex_t *lock;
+  const char *keys;
+  unsigned int key_count;
+  unsigned int write_percent;
+  unsigned int operations;
+  uint64_t seed;
+} run;
+
+static void *worker(void *arg) {
+  run *r = arg;
+  uint64_t state = r->seed;
+  void *value;
+
+  for (unsigned int i = 0; i < r->operations; i++) {
+    const uint64_t random = bench_random(&state);
+    const char *key = r->keys + (random % r->key_count) * KEY_SIZE;
+    const int is_write = (random >> 32) % 100 < r->write_percent;
+
+    if (r->concurrent != NULL) {
+      if (is_write) {
+        concurrent_hash_table_insert_or_update(r->concurrent, key,
+                                               (void *)key);
+      } else {
+        concurrent_hash_table_lookup(r->concurrent, key, &value);
+      }
+    } else {
+      pthread_mutex_lock(r->lock);
+      if (is_write) {
+        hash_table_insert_or_update(r->locked, key, (void *)key);
+      } else {
+        hash_table_lookup(r->locked, key, &value);
+      }
+      pthread_mutex_unlock(r->lock);
+    }
+  }
+
+  return NULL;
+}
+
+static void measure(int use_concurrent, unsigned int threads,
+                    unsigned int write_percent, const char *keys,
+                    unsigned int key_count) {
+  arena *arena;
+  concurrent_hash_table *concurrent = NULL;
+  hash_table *locked = NULL;
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  pthread_t ids[threads];
+  run runs[threads];
+  char label[64];
+
+  arena_create(&arena, GB(8));
+
+  // prefill half of the key set
+  if (use_concurrent) {
+    concurrent_hash_table_create(&concurrent, key_count / 2, NULL, arena);
+    for (unsigned int i = 0; i < key_count / 2; i++) {
+      concurrent_hash_table_insert(concurrent, keys + (uint64_t)i * KEY_SIZE,
+                                   NULL);
+    }
+  } else {
+    hash_table_create(&locked, key_count / 2, NULL, arena);
+    for (unsigned int i = 0; i < key_count / 2; i++) {
+      hash_table_insert(locked, keys + (uint64_t)i * KEY_SIZE, NULL);
+    }
+  }
+
+  const uint64_t start = bench_now_ns();
+
+  for (unsigned int t = 0; t < threads; t++) {
+    runs[t] = (run){concurrent, locked,       &lock,
+                    keys,       key_count,    write_percent,
+                    OPERATIONS / threads, t + 1};
+    pthread_create(&ids[t], NULL, worker, &runs[t]);
+  }
+
+  for (unsigned int t = 0; t < threads; t++) {
+    pthread_join(ids[t], NULL);
+  }
+
+  snprintf(label, sizeof(label), "%s %u/%u %2u threads",
+           use_concurrent ? "concurrent" : "mutex     ", 100 - write_percent,
+           write_percent, threads);
+  bench_report(label, (uint64_t)(OPERATIONS / threads) * threads,
+               bench_now_ns() - start);
+
+  arena_destroy(&arena);
+}
+
+int main(int argc, char **argv) {
+  const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  const unsigned int max_threads =
+      argc > 1 ? atoi(argv[1]) : (cpus < 4 ? 4 : cpus);
+  const unsigned int key_count = argc > 2 ? atoi(argv[2]) : 1 << 20;
+  static const unsigned int write_percents[] = {10, 50};
+  uint64_t state = 3;
+
+  printf("=========concurrent_hash_table benchmark========\n");
+  printf("keys: %u, operations per run: %u, online cpus: %ld\n", key_count,
+         OPERATIONS, cpus);
+
+  char *keys = malloc((uint64_t)key_count * KEY_SIZE);
+  for (unsigned int i = 0; i < key_count; i++) {
+    snprintf(keys + (uint64_t)i * KEY_SIZE, KEY_SIZE, "key:%llu",
+             (unsigned long long)bench_random(&state));
+  }
+
+  for (unsigned int w = 0; w < 2; w++) {
+    for (unsigned int threads = 1; threads <= max_threads; threads <<= 1) {
+      measure(0, threads, write_percents[w], keys, key_count);
+      measure(1, threads, write_percents[w], keys, key_count);
+    }
+  }
+
+  free(keys);
+
+  return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * Lookup latency percentiles of cuckoo_hash_table against hash_table, both
+ * just below the load at which hash_table grows.
+ *
+ * Every lookup is timed on its own, the clock overhead is included in both.
+ *
+ * usage: cuckoo_hash_table [capacity]
+ */
+#include "arena.h"
+#include "bench.h"
+#include "cuckoo_hash_table.h"
+#include "hash_table.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+
+#define KEY_SIZE 24
+#define LOOKUPS 2000000
+
+static int compare_latency(const void *a, const void *b) {
+  const uint32_t x = *(const uint32_t *)a;
+  const uint32_t y = *(const uint32_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+static void report_percentiles(const char *label, uint32_t *latencies) {
+  qsort(latencies, LOOKUPS, sizeof(uint32_t), compare_latency);
+
+  printf("%-32s p50 %5u  p99 %5u  p99.9 %5u  p99.99 %6u  max %7u ns\n",
+         label, latencies[LOOKUPS / 2], latencies[LOOKUPS / 100 * 99],
+         latencies[LOOKUPS / 1000 * 999], latencies[LOOKUPS / 10000 * 9999],
+         latencies[LOOKUPS - 1]);
+}
+
+int main(int argc, char **argv) {
+  const unsigned int capacity = argc > 1 ? atoi(argv[1]) : 1 << 21;
+  // just below the 0.875 load factor of hash_table
+  const unsigned int count = capacity * 0.87;
+  arena *arena;
+  hash_table *ht;
+  cuckoo_hash_table *cuckoo;
+  uint64_t state = 42;
+  uint64_t bytes;
+  uint64_t hits = 0;
+  void *value;
+
+  printf("=========cuckoo_hash_table benchmark========\n");
+  printf("capacity: %u, entries: %u\n", capacity, count);
+
+  arena_create(&arena, GB(4));
+  hash_table_create(&ht, capacity, NULL, arena);
+  cuckoo_hash_table_create(&cuckoo, capacity, arena);
+
+  // the second half of the keys is never inserted, for misses
+  char *keys =
+      arena_alloc(arena, (uint64_t)count * 2 * KEY_SIZE, alignof(char), 0);
+  for (uint64_t i = 0; i < (uint64_t)count * 2; i++) {
+    snprintf(keys + i * KEY_SIZE, KEY_SIZE, "client:%llu",
+             (unsigned long long)bench_random(&state));
+  }
+  for (unsigned int i = 0; i < count; i++) {
+    hash_table_insert(ht, keys + (uint64_t)i * KEY_SIZE, NULL);
+    cuckoo_hash_table_insert(cuckoo, keys + (uint64_t)i * KEY_SIZE, NULL);
+  }
+
+  hash_table_memory(ht, &bytes);
+  printf("%-32s %8.2f bytes/key\n", "hash_table", (double)bytes / count);
+  cuckoo_hash_table_memory(cuckoo, &bytes);
+  printf("%-32s %8.2f bytes/key\n", "cuckoo_hash_table", (double)bytes / count);
+
+  const char **hit_order =
+      arena_alloc(arena, sizeof(char *) * LOOKUPS, alignof(char *), 0);
+  const char **miss_order =
+      arena_alloc(arena, sizeof(char *) * LOOKUPS, alignof(char *), 0);
+  uint32_t *latencies =
+      arena_alloc(arena, sizeof(uint32_t) * LOOKUPS, alignof(uint32_t), 0);
+  for (unsigned int i = 0; i < LOOKUPS; i++) {
+    hit_order[i] = keys + (bench_random(&state) % count) * KEY_SIZE;
+    miss_order[i] = keys + (count + bench_random(&state) % count) * KEY_SIZE;
+  }
+
+  for (unsigned int i = 0; i < LOOKUPS; i++) {
+    const uint64_t start = bench_now_ns();
+    hits += hash_table_lookup(ht, hit_order[i], &value) == 0;
+    latencies[i] = bench_now_ns() - start;
+  }
+  report_percentiles("hash_table hit", latencies);
+
+  for (unsigned int i = 0; i < LOOKUPS; i++) {
+    const uint64_t start = bench_now_ns();
+    hits += cuckoo_hash_table_lookup(cuckoo, hit_order[i], &value) == 0;
+    latencies[i] = bench_now_ns() - start;
+  }
+  report_percentiles("cuckoo_hash_table hit", latencies);
+
+  for (unsigned int i = 0; i < LOOKUPS; i++) {
+    const uint64_t start = bench_now_ns();
+    hits += hash_table_lookup(ht, miss_order[i], &value) == 0;
+    latencies[i] = bench_now_ns() - start;
+  }
+  report_percentiles("hash_table miss", latencies);
+
+  for (unsigned int i = 0; i < LOOKUPS; i++) {
+    const uint64_t start = bench_now_ns();
+    hits += cuckoo_hash_table_lookup(cuckoo, miss_order[i], &value) == 0;
+    latencies[i] = bench_now_ns() - start;
+  }
+  report_percentiles("cuckoo_hash_table miss", latencies);
+
+  if (hits != 2ULL * LOOKUPS) {
+    fprintf(stderr, "unexpected number of hits: %llu\n",
+            (unsigned long long)hits);
+  }
+
+  arena_destroy(&arena);
+
+  return 0;
+}
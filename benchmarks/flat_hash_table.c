@@ -0,0 +1,112 @@
+/*
+ * Memory and lookup latency of values stored inline in flat_hash_table and
+ * hash_set, against hash_table pointing at separately allocated values.
+ *
+ * usage: flat_hash_table [entries]
+ */
+#include "arena.h"
+#include "bench.h"
+#include "flat_hash_table.h"
+#include "hash_set.h"
+#include "hash_table.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+
+#define KEY_SIZE 16
+#define LOOKUPS 4000000
+
+typedef struct {
+  double a;
+  double b;
+} pair;
+
+int main(int argc, char **argv) {
+  const unsigned int count = argc > 1 ? atoi(argv[1]) : 1 << 20;
+  arena *arena;
+  hash_table *ht;
+  flat_hash_table *flat;
+  hash_set *set;
+  uint64_t state = 42;
+  uint64_t bytes;
+  void *value;
+  pair found;
+  double sum = 0;
+
+  printf("=========flat_hash_table benchmark========\n");
+  printf("entries: %u, value: %zu bytes\n", count, sizeof(pair));
+
+  arena_create(&arena, GB(4));
+  hash_table_create(&ht, 16, NULL, arena);
+  flat_hash_table_create(&flat, 16, sizeof(pair), arena);
+  hash_set_create(&set, 16, arena);
+
+  // keys fit inline in every table, so only the values differ
+  char *keys = arena_alloc(arena, (uint64_t)count * KEY_SIZE, alignof(char), 0);
+  pair *values = arena_alloc(arena, sizeof(pair) * count, alignof(pair), 0);
+  for (unsigned int i = 0; i < count; i++) {
+    char *key = keys + (uint64_t)i * KEY_SIZE;
+    snprintf(key, KEY_SIZE, "%llx",
+             (unsigned long long)(bench_random(&state) >> 8));
+    values[i] = (pair){i, -(double)i};
+
+    hash_table_insert(ht, key, &values[i]);
+    flat_hash_table_insert(flat, key, &values[i]);
+    hash_set_add(set, key);
+  }
+
+  // random order, so consecutive lookups land in unrelated cache lines
+  const char **order =
+      arena_alloc(arena, sizeof(char *) * LOOKUPS, alignof(char *), 0);
+  for (unsigned int i = 0; i < LOOKUPS; i++) {
+    order[i] = keys + (bench_random(&state) % count) * KEY_SIZE;
+  }
+
+  hash_table_memory(ht, &bytes);
+  bytes += sizeof(pair) * count;
+  printf("%-40s %8.2f bytes/key\n", "hash_table + values",
+         (double)bytes / count);
+  flat_hash_table_memory(flat, &bytes);
+  printf("%-40s %8.2f bytes/key\n", "flat_hash_table", (double)bytes / count);
+  hash_set_memory(set, &bytes);
+  printf("%-40s %8.2f bytes/key\n", "hash_set", (double)bytes / count);
+
+  uint64_t start = bench_now_ns();
+  for (unsigned int i = 0; i < LOOKUPS; i++) {
+    if (hash_table_lookup(ht, order[i], &value) == 0) {
+      sum += ((pair *)value)->a + ((pair *)value)->b;
+    }
+  }
+  bench_report("hash_table lookup + dereference", LOOKUPS,
+               bench_now_ns() - start);
+
+  start = bench_now_ns();
+  for (unsigned int i = 0; i < LOOKUPS; i++) {
+    if (flat_hash_table_lookup(flat, order[i], &found) == 0) {
+      sum += found.a + found.b;
+    }
+  }
+  bench_report("flat_hash_table lookup", LOOKUPS, bench_now_ns() - start);
+
+  uint64_t hits = 0;
+  start = bench_now_ns();
+  for (unsigned int i = 0; i < LOOKUPS; i++) {
+    hits += hash_table_lookup(ht, order[i], &value) == 0;
+  }
+  bench_report("hash_table membership", LOOKUPS, bench_now_ns() - start);
+
+  start = bench_now_ns();
+  for (unsigned int i = 0; i < LOOKUPS; i++) {
+    hits += hash_set_contains(set, order[i]) == 0;
+  }
+  bench_report("hash_set contains", LOOKUPS, bench_now_ns() - start);
+
+  if (hits != 2ULL * LOOKUPS || sum != 0) {
+    fprintf(stderr, "unexpected results: %llu hits, sum %f\n",
+            (unsigned long long)hits, sum);
+  }
+
+  arena_destroy(&arena);
+
+  return 0;
+}
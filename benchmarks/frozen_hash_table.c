@@ -0,0 +1,80 @@
+/*
+ * Build time, memory and lookup latency of frozen_hash_table against the
+ * hash_table it is built from.
+ *
+ * usage: frozen_hash_table [entries]
+ */
+#include "arena.h"
+#include "bench.h"
+#include "frozen_hash_table.h"
+#include "hash_table.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+
+#define KEY_SIZE 24
+#define LOOKUPS 4000000
+
+int main(int argc, char **argv) {
+  const unsigned int count = argc > 1 ? atoi(argv[1]) : 1 << 20;
+  arena *arena;
+  hash_table *ht;
+  frozen_hash_table *frozen;
+  uint64_t state = 42;
+  uint64_t bytes;
+  void *value;
+
+  printf("=========frozen_hash_table benchmark========\n");
+  printf("entries: %u\n", count);
+
+  arena_create(&arena, GB(4));
+  hash_table_create(&ht, 16, NULL, arena);
+
+  char *keys = arena_alloc(arena, (uint64_t)count * KEY_SIZE, alignof(char), 0);
+  for (unsigned int i = 0; i < count; i++) {
+    snprintf(keys + (uint64_t)i * KEY_SIZE, KEY_SIZE, "route:%llu",
+             (unsigned long long)bench_random(&state));
+    hash_table_insert(ht, keys + (uint64_t)i * KEY_SIZE, &keys[i]);
+  }
+
+  // random order, so consecutive lookups land in unrelated cache lines
+  const char **order =
+      arena_alloc(arena, sizeof(char *) * LOOKUPS, alignof(char *), 0);
+  for (unsigned int i = 0; i < LOOKUPS; i++) {
+    order[i] = keys + (bench_random(&state) % count) * KEY_SIZE;
+  }
+
+  uint64_t start = bench_now_ns();
+  if (hash_table_freeze(ht, &frozen, arena) == 1) {
+    fprintf(stderr, "hash_table_freeze failed\n");
+    return 1;
+  }
+  bench_report("build", count, bench_now_ns() - start);
+
+  hash_table_memory(ht, &bytes);
+  printf("%-40s %8.2f bytes/key\n", "hash_table", (double)bytes / count);
+  frozen_hash_table_memory(frozen, &bytes);
+  printf("%-40s %8.2f bytes/key\n", "frozen_hash_table", (double)bytes / count);
+
+  uint64_t hits = 0;
+  start = bench_now_ns();
+  for (unsigned int i = 0; i < LOOKUPS; i++) {
+    hits += hash_table_lookup(ht, order[i], &value) == 0;
+  }
+  bench_report("hash_table lookup", LOOKUPS, bench_now_ns() - start);
+
+  start = bench_now_ns();
+  for (unsigned int i = 0; i < LOOKUPS; i++) {
+    hits += frozen_hash_table_lookup(frozen, order[i], &value) == 0;
+  }
+  bench_report("frozen_hash_table lookup", LOOKUPS, bench_now_ns() - start);
+
+  if (hits != 2ULL * LOOKUPS) {
+    fprintf(stderr, "unexpected number of hits: %llu\n",
+            (unsigned long long)hits);
+  }
+
+  arena_destroy(&arena);
+
+  return 0;
+}
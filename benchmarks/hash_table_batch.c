@@ -0,0 +1,92 @@
+/*
+ * Batch vs scalar lookup and insert throughput of hash_table, on a table
+ * larger than the last level cache.
+ *
+ * usage: hash_table_batch [entries] [batch]
+ */
+#include "arena.h"
+#include "bench.h"
+#include "hash_table.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+
+#define KEY_SIZE 24
+#define LOOKUPS 4000000
+
+int main(int argc, char **argv) {
+  const unsigned int count = argc > 1 ? atoi(argv[1]) : 1 << 22;
+  const unsigned int batch = argc > 2 ? atoi(argv[2]) : 128;
+  arena *arena;
+  hash_table *ht;
+  uint64_t state = 42;
+  void *value;
+
+  printf("=========hash_table batch benchmark========\n");
+  printf("entries: %u batch: %u\n", count, batch);
+
+  arena_create(&arena, GB(4));
+
+  char *key_data = arena_alloc(arena, (uint64_t)count * KEY_SIZE,
+                               alignof(char), 0);
+  const char **keys =
+      arena_alloc(arena, sizeof(char *) * count, alignof(char *), 0);
+  void **values = arena_alloc(arena, sizeof(void *) * count, alignof(void *), 0);
+  for (unsigned int i = 0; i < count; i++) {
+    keys[i] = key_data + (uint64_t)i * KEY_SIZE;
+    values[i] = &keys[i];
+    snprintf(key_data + (uint64_t)i * KEY_SIZE, KEY_SIZE, "key:%llu",
+             (unsigned long long)bench_random(&state));
+  }
+
+  // random order, so consecutive lookups land in unrelated cache lines
+  const char **order =
+      arena_alloc(arena, sizeof(char *) * LOOKUPS, alignof(char *), 0);
+  void **found = arena_alloc(arena, sizeof(void *) * batch, alignof(void *), 0);
+  for (unsigned int i = 0; i < LOOKUPS; i++) {
+    order[i] = keys[bench_random(&state) % count];
+  }
+
+  hash_table_create(&ht, 16, NULL, arena);
+  uint64_t start = bench_now_ns();
+  for (unsigned int i = 0; i < count; i++) {
+    hash_table_insert(ht, keys[i], values[i]);
+  }
+  bench_report("insert scalar", count, bench_now_ns() - start);
+
+  hash_table *batch_ht;
+  hash_table_create(&batch_ht, 16, NULL, arena);
+  start = bench_now_ns();
+  for (unsigned int i = 0; i < count; i += batch) {
+    hash_table_insert_batch(batch_ht, keys + i, values + i,
+                            count - i < batch ? count - i : batch);
+  }
+  bench_report("insert batch", count, bench_now_ns() - start);
+
+  uint64_t hits = 0;
+  start = bench_now_ns();
+  for (unsigned int i = 0; i < LOOKUPS; i++) {
+    hits += hash_table_lookup(ht, order[i], &value) == 0;
+  }
+  bench_report("lookup scalar", LOOKUPS, bench_now_ns() - start);
+
+  start = bench_now_ns();
+  for (unsigned int i = 0; i < LOOKUPS; i += batch) {
+    const unsigned int n = LOOKUPS - i < batch ? LOOKUPS - i : batch;
+
+    hash_table_lookup_batch(ht, order + i, n, found);
+    for (unsigned int j = 0; j < n; j++) {
+      hits += found[j] != NULL;
+    }
+  }
+  bench_report("lookup batch", LOOKUPS, bench_now_ns() - start);
+
+  if (hits != 2ULL * LOOKUPS || hash_table_size(batch_ht) != (int)count) {
+    fprintf(stderr, "unexpected results: %llu hits, %d entries\n",
+            (unsigned long long)hits, hash_table_size(batch_ht));
+  }
+
+  arena_destroy(&arena);
+
+  return 0;
+}
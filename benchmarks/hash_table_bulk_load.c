@@ -0,0 +1,68 @@
+/*
+ * Building a hash_table from a large key array, one hash_table_insert per
+ * key against hash_table_bulk_load with an increasing number of threads.
+ *
+ * usage: hash_table_bulk_load [entries] [max_threads]
+ */
+#include "arena.h"
+#include "bench.h"
+#include "hash_table.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+
+#define KEY_SIZE 32
+
+int main(int argc, char **argv) {
+  const unsigned int count = argc > 1 ? atoi(argv[1]) : 1 << 22;
+  const unsigned int max_threads = argc > 2 ? atoi(argv[2]) : 8;
+  arena *scratch; // declared first, 'arena' shadows the type below
+  arena *arena;
+  hash_table *ht;
+  uint64_t state = 42;
+  char label[64];
+
+  printf("=========hash_table bulk load benchmark========\n");
+  printf("entries: %u\n", count);
+
+  arena_create(&arena, GB(4));
+  arena_create(&scratch, GB(16));
+
+  char *keys = arena_alloc(arena, (uint64_t)count * KEY_SIZE, alignof(char), 0);
+  const char **key_array =
+      arena_alloc(arena, sizeof(char *) * count, alignof(char *), 0);
+  void **values = arena_alloc(arena, sizeof(void *) * count, alignof(void *), 0);
+  for (unsigned int i = 0; i < count; i++) {
+    key_array[i] = keys + (uint64_t)i * KEY_SIZE;
+    snprintf(keys + (uint64_t)i * KEY_SIZE, KEY_SIZE, "user:%llu",
+             (unsigned long long)bench_random(&state));
+    values[i] = &key_array[i];
+  }
+
+  // Every build starts from an empty table in a fresh arena.
+  hash_table_create(&ht, 16, NULL, scratch);
+  uint64_t start = bench_now_ns();
+  for (unsigned int i = 0; i < count; i++) {
+    hash_table_insert(ht, key_array[i], values[i]);
+  }
+  bench_report("insert loop", count, bench_now_ns() - start);
+
+  for (unsigned int threads = 1; threads <= max_threads; threads <<= 1) {
+    arena_reset(scratch);
+    hash_table_create(&ht, 16, NULL, scratch);
+
+    start = bench_now_ns();
+    hash_table_bulk_load(ht, key_array, values, count, threads);
+    snprintf(label, sizeof(label), "bulk_load %u threads", threads);
+    bench_report(label, count, bench_now_ns() - start);
+
+    if (hash_table_size(ht) != (int)count) {
+      fprintf(stderr, "unexpected size: %d\n", hash_table_size(ht));
+    }
+  }
+
+  arena_destroy(&scratch);
+  arena_destroy(&arena);
+
+  return 0;
+}
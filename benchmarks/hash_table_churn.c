@@ -0,0 +1,67 @@
+/*
+ * Long running insert/delete churn on hash_table.
+ *
+ * Keeps 'live' keys in the table, each step inserts a new key and deletes the
+ * oldest one. Reports throughput and probe lengths after every round, which
+ * stay flat when deletes do not pile up tombstones.
+ *
+ * usage: hash_table_churn [live] [rounds]
+ */
+#include "arena.h"
+#include "bench.h"
+#include "hash_table.h"
+
+#include <stdlib.h>
+
+#define KEY_SIZE 24
+
+static void make_key(char *key, uint64_t i) {
+  snprintf(key, KEY_SIZE, "session:%llu", (unsigned long long)i);
+}
+
+int main(int argc, char **argv) {
+  const unsigned int live = argc > 1 ? atoi(argv[1]) : 1400000;
+  const unsigned int rounds = argc > 2 ? atoi(argv[2]) : 10;
+  arena *arena;
+  hash_table *ht;
+  char key[KEY_SIZE];
+  char label[64];
+  double mean;
+  unsigned int max;
+  uint64_t next = 0;
+
+  printf("=========hash_table churn benchmark========\n");
+  printf("live keys: %u, rounds of %u insert+delete\n", live, live);
+
+  arena_create(&arena, GB(16));
+  // 1.4M live keys sit at ~0.67 load in 2M slots
+  hash_table_create(&ht, live, NULL, arena);
+
+  for (; next < live; next++) {
+    make_key(key, next);
+    hash_table_insert(ht, key, NULL);
+  }
+
+  hash_table_probe_stats(ht, &mean, &max);
+  printf("%-40s mean probe %.3f, max probe %u\n", "after fill", mean, max);
+
+  for (unsigned int round = 1; round <= rounds; round++) {
+    const uint64_t start = bench_now_ns();
+
+    for (unsigned int i = 0; i < live; i++, next++) {
+      make_key(key, next);
+      hash_table_insert(ht, key, NULL);
+      make_key(key, next - live);
+      hash_table_delete(ht, key);
+    }
+
+    snprintf(label, sizeof(label), "round %u insert+delete", round);
+    bench_report(label, live, bench_now_ns() - start);
+    hash_table_probe_stats(ht, &mean, &max);
+    printf("%-40s mean probe %.3f, max probe %u\n", "", mean, max);
+  }
+
+  arena_destroy(&arena);
+
+  return 0;
+}
@@ -0,0 +1,81 @@
+/*
+ * Reusing one large hash_table across small batches, rebuilding it for
+ * every batch against hash_table_clear.
+ *
+ * usage: hash_table_clear [capacity] [keys_per_batch]
+ */
+#include "arena.h"
+#include "bench.h"
+#include "hash_table.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+
+#define KEY_SIZE 24
+#define BATCHES 20000
+
+int main(int argc, char **argv) {
+  const unsigned int capacity = argc > 1 ? atoi(argv[1]) : 1 << 20;
+  const unsigned int batch = argc > 2 ? atoi(argv[2]) : 16;
+  arena *scratch; // declared first, 'arena' shadows the type below
+  arena *arena;
+  hash_table *ht;
+  uint64_t state = 42;
+  uint64_t hits = 0;
+  void *value;
+
+  printf("=========hash_table clear benchmark========\n");
+  printf("capacity: %u, keys per batch: %u\n", capacity, batch);
+
+  arena_create(&arena, GB(1));
+  arena_create(&scratch, GB(1));
+
+  char *keys =
+      arena_alloc(arena, (uint64_t)BATCHES * batch * KEY_SIZE, alignof(char), 0);
+  for (uint64_t i = 0; i < (uint64_t)BATCHES * batch; i++) {
+    snprintf(keys + i * KEY_SIZE, KEY_SIZE, "request:%llu",
+             (unsigned long long)bench_random(&state));
+  }
+
+  // The table and its slots are dropped with the scratch arena every batch.
+  uint64_t start = bench_now_ns();
+  for (unsigned int b = 0; b < BATCHES; b++) {
+    const char *batch_keys = keys + (uint64_t)b * batch * KEY_SIZE;
+
+    arena_reset(scratch);
+    hash_table_create(&ht, capacity, NULL, scratch);
+    for (unsigned int i = 0; i < batch; i++) {
+      hash_table_insert(ht, batch_keys + i * KEY_SIZE, &hits);
+    }
+    for (unsigned int i = 0; i < batch; i++) {
+      hits += hash_table_lookup(ht, batch_keys + i * KEY_SIZE, &value) == 0;
+    }
+  }
+  bench_report("rebuild per batch", BATCHES, bench_now_ns() - start);
+
+  arena_reset(scratch);
+  hash_table_create(&ht, capacity, NULL, scratch);
+  start = bench_now_ns();
+  for (unsigned int b = 0; b < BATCHES; b++) {
+    const char *batch_keys = keys + (uint64_t)b * batch * KEY_SIZE;
+
+    hash_table_clear(ht);
+    for (unsigned int i = 0; i < batch; i++) {
+      hash_table_insert(ht, batch_keys + i * KEY_SIZE, &hits);
+    }
+    for (unsigned int i = 0; i < batch; i++) {
+      hits += hash_table_lookup(ht, batch_keys + i * KEY_SIZE, &value) == 0;
+    }
+  }
+  bench_report("hash_table_clear per batch", BATCHES, bench_now_ns() - start);
+
+  if (hits != 2ULL * BATCHES * batch) {
+    fprintf(stderr, "unexpected number of hits: %llu\n",
+            (unsigned long long)hits);
+  }
+
+  arena_destroy(&scratch);
+  arena_destroy(&arena);
+
+  return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * Speed of the hash_table hash functions by key length, and the probe
+ * lengths they produce on URL-like keys.
+ *
+ * usage: hash_table_hash [capacity]
+ */
+#include "arena.h"
+#include "bench.h"
+#include "hash_table.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HASHES 20000000ULL
+#define KEY_SIZE 64
+
+/**
+ * FNV-1a, the previous default, for comparison.
+ */
+static unsigned int fnv1a(const char *key, unsigned int length) {
+  unsigned int hash_code = 2166136261U;
+
+  for (unsigned int i = 0; i < length; i++) {
+    hash_code ^= (unsigned char)key[i];
+    hash_code *= 16777619;
+  }
+
+  return hash_code;
+}
+
+static uint64_t fnv1a64(const char *key, unsigned int length, uint64_t seed) {
+  return fnv1a(key, length) ^ seed;
+}
+
+static const struct {
+  const char *name;
+  uint64_t (*hashfn)(const char *, unsigned int, uint64_t);
+} hashes[] = {
+    {"fnv1a", fnv1a64},
+    {"hash64", hash_table_hash64},
+    {"crc32c", hash_table_hash_crc32c},
+};
+
+static const unsigned int lengths[] = {8, 16, 24, 32, 64, 128, 256, 1024};
+
+int main(int argc, char **argv) {
+  const unsigned int capacity = argc > 1 ? atoi(argv[1]) : 1 << 20;
+  // stay one entry below the threshold so the table never grows
+  const unsigned int count = capacity * 0.875 - 1;
+  const unsigned int n_hashes = sizeof(hashes) / sizeof(*hashes);
+  char buffer[1024 + 64];
+  char label[64];
+  uint64_t state = 42;
+
+  printf("=========hash_table hash benchmark========\n");
+
+  for (unsigned int i = 0; i < sizeof(buffer); i++) {
+    buffer[i] = 'a' + bench_random(&state) % 26;
+  }
+
+  for (unsigned int l = 0; l < sizeof(lengths) / sizeof(*lengths); l++) {
+    // keep the total bytes hashed roughly the same for every length
+    const uint64_t iterations = HASHES * 8 / lengths[l];
+
+    for (unsigned int h = 0; h < n_hashes; h++) {
+      uint64_t sink = 0;
+      uint64_t start = bench_now_ns();
+
+      for (uint64_t i = 0; i < iterations; i++) {
+        // the offset changes the input, so calls cannot be hoisted
+        sink += hashes[h].hashfn(buffer + (i & 63), lengths[l], i);
+      }
+
+      snprintf(label, sizeof(label), "%-6s %4u bytes", hashes[h].name,
+               lengths[l]);
+      bench_report(label, iterations, bench_now_ns() - start);
+
+      if (sink == 42) {
+        printf("\n");
+      }
+    }
+  }
+
+  printf("probe lengths, %u URL-like keys at load 0.875:\n", count);
+
+  for (unsigned int h = 0; h < n_hashes; h++) {
+    arena *arena;
+    hash_table *ht;
+    double mean;
+    unsigned int max;
+
+    arena_create(&arena, GB(4));
+    if (hashes[h].hashfn == fnv1a64) {
+      hash_table_create(&ht, capacity, fnv1a, arena);
+    } else {
+      hash_table_create_seeded(&ht, capacity, hashes[h].hashfn,
+                               bench_random(&state), 0, arena);
+    }
+
+    char *keys = arena_alloc(arena, (uint64_t)count * KEY_SIZE, alignof(char), 0);
+    for (unsigned int i = 0; i < count; i++) {
+      char *key = keys + (uint64_t)i * KEY_SIZE;
+      snprintf(key, KEY_SIZE, "https://example.com/api/v1/users/%u/profile",
+               i);
+      hash_table_insert(ht, key, key);
+    }
+
+    hash_table_probe_stats(ht, &mean, &max);
+    printf("%-40s mean %.4f max %u groups\n", hashes[h].name, mean, max);
+
+    arena_destroy(&arena);
+  }
+
+  return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Lookup throughput of hash_table at different load factors.
+ *
+ * usage: hash_table_lookup [capacity]
+ */
+#include "arena.h"
+#include "bench.h"
+#include "hash_table.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+
+#define KEY_SIZE 24
+#define LOOKUPS 4000000
+
+static const double load_factors[] = {0.5, 0.625, 0.75, 0.875};
+
+int main(int argc, char **argv) {
+  const unsigned int capacity = argc > 1 ? atoi(argv[1]) : 1 << 20;
+  char label[64];
+
+  printf("=========hash_table lookup benchmark========\n");
+  printf("capacity: %u\n", capacity);
+
+  for (unsigned int l = 0; l < sizeof(load_factors) / sizeof(*load_factors);
+       l++) {
+    arena *arena;
+    hash_table *ht;
+    // stay one entry below the threshold so the table never grows
+    const unsigned int count = capacity * load_factors[l] - 1;
+    uint64_t state = 42;
+    void *value;
+
+    arena_create(&arena, GB(4));
+    hash_table_create(&ht, capacity, NULL, arena);
+
+    char *keys = arena_alloc(arena, (uint64_t)count * KEY_SIZE, alignof(char), 0);
+    char *misses = arena_alloc(arena, (uint64_t)count * KEY_SIZE, alignof(char), 0);
+    for (unsigned int i = 0; i < count; i++) {
+      snprintf(keys + (uint64_t)i * KEY_SIZE, KEY_SIZE, "key:%llu",
+               (unsigned long long)bench_random(&state));
+      snprintf(misses + (uint64_t)i * KEY_SIZE, KEY_SIZE, "miss:%llu",
+               (unsigned long long)bench_random(&state));
+      hash_table_insert(ht, keys + (uint64_t)i * KEY_SIZE, &keys[i]);
+    }
+
+    uint64_t found = 0;
+    uint64_t start = bench_now_ns();
+    for (unsigned int i = 0; i < LOOKUPS; i++) {
+      found += hash_table_lookup(ht, keys + (uint64_t)(i % count) * KEY_SIZE,
+                                 &value) == 0;
+    }
+    snprintf(label, sizeof(label), "load %.3f hit", load_factors[l]);
+    bench_report(label, LOOKUPS, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (unsigned int i = 0; i < LOOKUPS; i++) {
+      found += hash_table_lookup(ht, misses + (uint64_t)(i % count) * KEY_SIZE,
+                                 &value) == 0;
+    }
+    snprintf(label, sizeof(label), "load %.3f miss", load_factors[l]);
+    bench_report(label, LOOKUPS, bench_now_ns() - start);
+
+    if (found != LOOKUPS) {
+      fprintf(stderr, "unexpected number of hits: %llu\n",
+              (unsigned long long)found);
+    }
+
+    arena_destroy(&arena);
+  }
+
+  return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * Per-operation latency of hash_table while it grows, with and without
+ * HASH_TABLE_INCREMENTAL_RESIZE.
+ *
+ * Every insert is followed by a lookup of an earlier key, both are timed.
+ *
+ * usage: hash_table_resize_latency [count]
+ */
+#include "arena.h"
+#include "bench.h"
+#include "hash_table.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+
+#define KEY_SIZE 24
+#define BUCKETS 40 // log2(ns) buckets
+
+static int compare_u64(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *)a;
+  const uint64_t y = *(const uint64_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+static void run(const char *label, unsigned int flags, const char *keys,
+                unsigned int count, uint64_t *samples) {
+  arena *arena;
+  hash_table *ht;
+  uint64_t histogram[BUCKETS] = {0};
+  void *value;
+
+  arena_create(&arena, GB(8));
+  hash_table_create_ex(&ht, 16, NULL, flags, arena);
+
+  for (unsigned int i = 0; i < count; i++) {
+    const char *key = keys + (uint64_t)i * KEY_SIZE;
+    const char *earlier = keys + (uint64_t)(i / 2) * KEY_SIZE;
+
+    uint64_t start = bench_now_ns();
+    hash_table_insert(ht, key, key);
+    hash_table_lookup(ht, earlier, &value);
+    samples[i] = bench_now_ns() - start;
+    histogram[63 - __builtin_clzll(samples[i] | 1)]++;
+  }
+
+  qsort(samples, count, sizeof(*samples), compare_u64);
+
+  printf("\n%s\n", label);
+  printf("  p50 %llu ns, p99 %llu ns, p99.9 %llu ns, p99.99 %llu ns, "
+         "max %llu ns\n",
+         (unsigned long long)samples[count / 2],
+         (unsigned long long)samples[(uint64_t)count * 99 / 100],
+         (unsigned long long)samples[(uint64_t)count * 999 / 1000],
+         (unsigned long long)samples[(uint64_t)count * 9999 / 10000],
+         (unsigned long long)samples[count - 1]);
+
+  for (unsigned int b = 0; b < BUCKETS; b++) {
+    if (histogram[b] != 0) {
+      printf("  [%10llu, %10llu) ns: %u\n", 1ULL << b, 1ULL << (b + 1),
+             (unsigned int)histogram[b]);
+    }
+  }
+
+  arena_destroy(&arena);
+}
+
+int main(int argc, char **argv) {
+  const unsigned int count = argc > 1 ? atoi(argv[1]) : 1 << 22;
+  uint64_t state = 1;
+
+  printf("=========hash_table resize latency benchmark========\n");
+  printf("operations: %u insert + lookup pairs\n", count);
+
+  char *keys = malloc((uint64_t)count * KEY_SIZE);
+  uint64_t *samples = malloc(count * sizeof(uint64_t));
+  for (unsigned int i = 0; i < count; i++) {
+    snprintf(keys + (uint64_t)i * KEY_SIZE, KEY_SIZE, "key:%llu",
+             (unsigned long long)bench_random(&state));
+  }
+
+  run("stop-the-world resize", 0, keys, count, samples);
+  run("incremental resize", HASH_TABLE_INCREMENTAL_RESIZE, keys, count,
+      samples);
+
+  free(samples);
+  free(keys);
+
+  return 0;
+}
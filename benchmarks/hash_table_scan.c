@@ -0,0 +1,94 @@
+/*
+ * Full scan throughput of hash_table, one iterator against the slots split
+ * between threads.
+ *
+ * usage: hash_table_scan [capacity] [max_threads]
+ */
+#include "arena.h"
+#include "bench.h"
+#include "hash_table.h"
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdlib.h>
+
+#define KEY_SIZE 24
+#define MAX_THREADS 64
+
+typedef struct scan {
+  hash_table_iterator *it;
+  uint64_t entries;
+} scan;
+
+static void *worker(void *arg) {
+  scan *s = arg;
+  hash_table_entry *entry;
+
+  while (hash_table_iterator_next(s->it, &entry) == 0) {
+    s->entries++;
+  }
+
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  const unsigned int capacity = argc > 1 ? atoi(argv[1]) : 1 << 24;
+  unsigned int max_threads = argc > 2 ? atoi(argv[2]) : 8;
+  // half full, then a third deleted, so the scan crosses empty and deleted runs
+  const unsigned int count = capacity / 2;
+  arena *arena;
+  hash_table *ht;
+  hash_table_iterator *its[MAX_THREADS];
+  pthread_t threads[MAX_THREADS];
+  scan scans[MAX_THREADS];
+  char label[64];
+  char key[KEY_SIZE];
+
+  if (max_threads > MAX_THREADS) {
+    max_threads = MAX_THREADS;
+  }
+
+  printf("=========hash_table scan benchmark========\n");
+  printf("capacity: %u\n", capacity);
+
+  arena_create(&arena, GB(4));
+  hash_table_create(&ht, capacity, NULL, arena);
+
+  for (unsigned int i = 0; i < count; i++) {
+    snprintf(key, KEY_SIZE, "key:%u", i);
+    hash_table_insert(ht, key, NULL);
+  }
+  for (unsigned int i = 0; i < count; i += 3) {
+    snprintf(key, KEY_SIZE, "key:%u", i);
+    hash_table_delete(ht, key);
+  }
+
+  for (unsigned int t = 1; t <= max_threads; t <<= 1) {
+    uint64_t entries = 0;
+
+    hash_table_split_iterators(ht, t, its);
+
+    uint64_t start = bench_now_ns();
+    for (unsigned int i = 0; i < t; i++) {
+      scans[i].it = its[i];
+      scans[i].entries = 0;
+      pthread_create(&threads[i], NULL, worker, &scans[i]);
+    }
+    for (unsigned int i = 0; i < t; i++) {
+      pthread_join(threads[i], NULL);
+      entries += scans[i].entries;
+    }
+
+    snprintf(label, sizeof(label), "%u threads slots", t);
+    bench_report(label, capacity, bench_now_ns() - start);
+
+    if (entries != (uint64_t)hash_table_size(ht)) {
+      fprintf(stderr, "unexpected number of entries: %llu\n",
+              (unsigned long long)entries);
+    }
+  }
+
+  arena_destroy(&arena);
+
+  return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Counting words with hash_table, lookup followed by insert_or_update
+ * against a single probe through the slot and upsert APIs.
+ *
+ * usage: hash_table_upsert [distinct_keys]
+ */
+#include "arena.h"
+#include "bench.h"
+#include "hash_table.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+
+#define KEY_SIZE 24
+#define EVENTS 4000000
+
+static void *add(void *existing, void *value) {
+  return (void *)((uintptr_t)existing + (uintptr_t)value);
+}
+
+int main(int argc, char **argv) {
+  const unsigned int count = argc > 1 ? atoi(argv[1]) : 1 << 16;
+  arena *arena;
+  hash_table *ht;
+  uint64_t state = 42;
+  void *value;
+  void **slot;
+  int was_inserted;
+
+  printf("=========hash_table upsert benchmark========\n");
+  printf("distinct keys: %u\n", count);
+
+  arena_create(&arena, GB(4));
+
+  char *keys = arena_alloc(arena, (uint64_t)count * KEY_SIZE, alignof(char), 0);
+  const char **events =
+      arena_alloc(arena, sizeof(char *) * EVENTS, alignof(char *), 0);
+  for (unsigned int i = 0; i < count; i++) {
+    snprintf(keys + (uint64_t)i * KEY_SIZE, KEY_SIZE, "word:%u", i);
+  }
+  for (unsigned int i = 0; i < EVENTS; i++) {
+    events[i] = keys + (bench_random(&state) % count) * KEY_SIZE;
+  }
+
+  hash_table_create(&ht, 16, NULL, arena);
+  uint64_t start = bench_now_ns();
+  for (unsigned int i = 0; i < EVENTS; i++) {
+    if (hash_table_lookup(ht, events[i], &value) == 1) {
+      value = NULL;
+    }
+    hash_table_insert_or_update(ht, events[i], add(value, (void *)1));
+  }
+  bench_report("lookup + insert_or_update", EVENTS, bench_now_ns() - start);
+
+  hash_table_create(&ht, 16, NULL, arena);
+  start = bench_now_ns();
+  for (unsigned int i = 0; i < EVENTS; i++) {
+    hash_table_get_or_insert_slot(ht, events[i], &slot, &was_inserted);
+    *slot = add(*slot, (void *)1);
+  }
+  bench_report("get_or_insert_slot", EVENTS, bench_now_ns() - start);
+
+  hash_table_create(&ht, 16, NULL, arena);
+  start = bench_now_ns();
+  for (unsigned int i = 0; i < EVENTS; i++) {
+    hash_table_upsert(ht, events[i], (void *)1, add);
+  }
+  bench_report("upsert", EVENTS, bench_now_ns() - start);
+
+  arena_destroy(&arena);
+
+  return 0;
+}
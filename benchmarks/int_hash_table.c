@@ -0,0 +1,76 @@
+/*
+ * int_hash_table against hash_table keyed by the same 64 bit ids.
+ *
+ * The string table pays for formatting each id, as callers have to.
+ *
+ * usage: int_hash_table [count]
+ */
+#include "arena.h"
+#include "bench.h"
+#include "hash_table.h"
+#include "int_hash_table.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+
+#define KEY_SIZE 24
+
+int main(int argc, char **argv) {
+  const unsigned int count = argc > 1 ? atoi(argv[1]) : 1 << 20;
+  arena *arena;
+  hash_table *strings;
+  int_hash_table *ints;
+  char key[KEY_SIZE];
+  uint64_t state = 7;
+  uint64_t found = 0;
+  void *value;
+
+  printf("=========int_hash_table benchmark========\n");
+  printf("keys: %u\n", count);
+
+  arena_create(&arena, GB(4));
+  uint64_t *ids = arena_alloc(arena, count * sizeof(uint64_t),
+                              alignof(uint64_t), 0);
+  for (unsigned int i = 0; i < count; i++) {
+    ids[i] = bench_random(&state);
+  }
+
+  hash_table_create(&strings, 16, NULL, arena);
+  uint64_t start = bench_now_ns();
+  for (unsigned int i = 0; i < count; i++) {
+    snprintf(key, KEY_SIZE, "%llu", (unsigned long long)ids[i]);
+    hash_table_insert(strings, key, &ids[i]);
+  }
+  bench_report("hash_table insert (snprintf id)", count,
+               bench_now_ns() - start);
+
+  int_hash_table_create(&ints, 16, NULL, arena);
+  start = bench_now_ns();
+  for (unsigned int i = 0; i < count; i++) {
+    int_hash_table_insert(ints, ids[i], &ids[i]);
+  }
+  bench_report("int_hash_table insert", count, bench_now_ns() - start);
+
+  start = bench_now_ns();
+  for (unsigned int i = 0; i < count; i++) {
+    snprintf(key, KEY_SIZE, "%llu", (unsigned long long)ids[i]);
+    found += hash_table_lookup(strings, key, &value) == 0;
+  }
+  bench_report("hash_table lookup (snprintf id)", count,
+               bench_now_ns() - start);
+
+  start = bench_now_ns();
+  for (unsigned int i = 0; i < count; i++) {
+    found += int_hash_table_lookup(ints, ids[i], &value) == 0;
+  }
+  bench_report("int_hash_table lookup", count, bench_now_ns() - start);
+
+  if (found != 2ULL * count) {
+    fprintf(stderr, "unexpected number of hits: %llu\n",
+            (unsigned long long)found);
+  }
+
+  arena_destroy(&arena);
+
+  return 0;
+}
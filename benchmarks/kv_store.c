@@ -0,0 +1,162 @@
+/*
+ * Write throughput of kv_store in each durability mode, read latency and
+ * the time to reopen the store, from the hint files and from the logs.
+ *
+ * Syncing every write is measured on the first 10000 keys and grouped
+ * syncs on the first million, the other numbers on all of them.
+ *
+ * usage: kv_store [keys] [directory]
+ */
+#include "arena.h"
+#include "bench.h"
+#include "kv_store.h"
+
+#include <dirent.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define KEY_SIZE 16
+#define VALUE_SIZE 100
+#define READS 1000000
+#define ALWAYS_KEYS 10000
+#define GROUP_KEYS 1000000
+
+/**
+ * Delete the files of a previous run, keep the directory.
+ */
+static void empty_directory(const char *directory, const char *suffix) {
+  char path[4096];
+  DIR *dir = opendir(directory);
+  struct dirent *file;
+
+  if (dir == NULL) {
+    return;
+  }
+
+  while ((file = readdir(dir)) != NULL) {
+    const size_t length = strlen(file->d_name);
+
+    if (length > strlen(suffix) &&
+        strcmp(file->d_name + length - strlen(suffix), suffix) == 0) {
+      snprintf(path, sizeof(path), "%s/%s", directory, file->d_name);
+      unlink(path);
+    }
+  }
+
+  closedir(dir);
+}
+
+static int compare(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *)a;
+  const uint64_t y = *(const uint64_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+static void fill(arena *arena, const char *directory, unsigned int mode,
+                 const char *keys, unsigned int count, const char *label) {
+  kv_store *store;
+  char value[VALUE_SIZE];
+
+  memset(value, 'v', sizeof(value));
+  empty_directory(directory, ".log");
+  empty_directory(directory, ".hint");
+  arena_reset(arena);
+  kv_store_open(&store, directory, mode, arena);
+
+  uint64_t start = bench_now_ns();
+  for (unsigned int i = 0; i < count; i++) {
+    kv_store_put(store, keys + (uint64_t)i * KEY_SIZE, value, sizeof(value));
+  }
+  kv_store_sync(store);
+  bench_report(label, count, bench_now_ns() - start);
+
+  kv_store_close(store);
+}
+
+static void reopen(arena *arena, const char *directory, unsigned int count,
+                   const char *label) {
+  kv_store *store;
+
+  arena_reset(arena);
+  uint64_t start = bench_now_ns();
+  kv_store_open(&store, directory, KV_STORE_SYNC_NONE, arena);
+  const uint64_t elapsed = bench_now_ns() - start;
+
+  printf("%-40s %10.2f ms %8.2f ns/key\n", label, (double)elapsed / 1e6,
+         (double)elapsed / (double)count);
+
+  if (kv_store_size(store) != (int)count) {
+    fprintf(stderr, "unexpected size: %d\n", kv_store_size(store));
+  }
+  kv_store_close(store);
+}
+
+int main(int argc, char **argv) {
+  const unsigned int count = argc > 1 ? atoi(argv[1]) : 10000000;
+  const char *directory = argc > 2 ? argv[2] : "/tmp/kv_store_bench";
+  arena *scratch; // declared first, 'arena' shadows the type below
+  arena *arena;
+  kv_store *store;
+  uint64_t state = 42;
+  char value[VALUE_SIZE];
+  uint32_t size;
+
+  printf("=========kv_store benchmark========\n");
+  printf("keys: %u, value size: %d, directory: %s\n", count, VALUE_SIZE,
+         directory);
+
+  arena_create(&scratch, GB(1));
+  arena_create(&arena, GB(4));
+
+  char *keys =
+      arena_alloc(scratch, (uint64_t)count * KEY_SIZE, alignof(char), 0);
+  for (unsigned int i = 0; i < count; i++) {
+    snprintf(keys + (uint64_t)i * KEY_SIZE, KEY_SIZE, "user:%010u", i);
+  }
+
+  fill(arena, directory, KV_STORE_SYNC_ALWAYS, keys,
+       count < ALWAYS_KEYS ? count : ALWAYS_KEYS, "put sync always");
+  fill(arena, directory, KV_STORE_SYNC_GROUP, keys,
+       count < GROUP_KEYS ? count : GROUP_KEYS, "put sync group");
+  fill(arena, directory, KV_STORE_SYNC_NONE, keys, count, "put sync none");
+
+  // Random reads of a store whose segments are in the page cache.
+  uint64_t *latencies =
+      arena_alloc(scratch, sizeof(uint64_t) * READS, alignof(uint64_t), 0);
+
+  arena_reset(arena);
+  kv_store_open(&store, directory, KV_STORE_SYNC_NONE, arena);
+
+  uint64_t total = 0;
+  for (unsigned int i = 0; i < READS; i++) {
+    const char *key = keys + bench_random(&state) % count * KEY_SIZE;
+    const uint64_t start = bench_now_ns();
+
+    if (kv_store_get(store, key, value, sizeof(value), &size) == 1) {
+      fprintf(stderr, "missing key: %s\n", key);
+    }
+
+    latencies[i] = bench_now_ns() - start;
+    total += latencies[i];
+  }
+  bench_report("get", READS, total);
+
+  qsort(latencies, READS, sizeof(uint64_t), compare);
+  printf("%-40s %8llu ns p50 %8llu ns p99 %8llu ns p99.9\n", "get latency",
+         (unsigned long long)latencies[READS / 2],
+         (unsigned long long)latencies[READS * 99 / 100],
+         (unsigned long long)latencies[READS * 999 / 1000]);
+  kv_store_close(store);
+
+  reopen(arena, directory, count, "open from hints");
+  empty_directory(directory, ".hint");
+  reopen(arena, directory, count, "open from logs");
+
+  arena_destroy(&arena);
+  arena_destroy(&scratch);
+
+  return 0;
+}
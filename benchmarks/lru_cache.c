@@ -0,0 +1,149 @@
+/*
+ * Hit rate and throughput of lru_cache on a Zipfian key stream, for
+ * several cache sizes and thread counts.
+ *
+ * Every miss is followed by a put, like a read-through cache.
+ *
+ * usage: lru_cache [keys] [max_threads]
+ */
+#include "arena.h"
+#include "bench.h"
+#include "lru_cache.h"
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdlib.h>
+
+#define KEY_SIZE 24
+#define OPERATIONS 4000000 // split across the threads
+#define MAX_THREADS 64
+
+typedef struct run {
+  lru_cache *cache;
+  const char *keys;
+  const unsigned int *stream;
+  unsigned int operations;
+} run;
+
+static void *worker(void *arg) {
+  run *r = arg;
+  void *value;
+
+  for (unsigned int i = 0; i < r->operations; i++) {
+    const char *key = r->keys + (uint64_t)r->stream[i] * KEY_SIZE;
+
+    if (lru_cache_get(r->cache, key, &value) == 1) {
+      lru_cache_put(r->cache, key, (void *)key, 0);
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Draw OPERATIONS key indexes, key i with probability proportional to
+ * 1 / (i + 1), Zipf with exponent 1.
+ */
+static unsigned int *zipf_stream(arena *arena, unsigned int count,
+                                 uint64_t *state) {
+  double *cdf = arena_alloc(arena, sizeof(double) * count, alignof(double), 0);
+  unsigned int *stream = arena_alloc(arena, sizeof(unsigned int) * OPERATIONS,
+                                     alignof(unsigned int), 0);
+  double total = 0;
+
+  for (unsigned int i = 0; i < count; i++) {
+    total += 1.0 / (i + 1);
+    cdf[i] = total;
+  }
+
+  for (unsigned int i = 0; i < OPERATIONS; i++) {
+    const double u = (bench_random(state) >> 11) * 0x1.0p-53 * total;
+    unsigned int low = 0, high = count - 1;
+
+    while (low < high) {
+      const unsigned int middle = (low + high) / 2;
+
+      if (cdf[middle] < u) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+
+    // scatter the popular keys over the key space
+    stream[i] = (uint64_t)low * 2654435761U % count;
+  }
+
+  return stream;
+}
+
+/**
+ * Run the stream split over 'threads', report throughput and hit rate.
+ */
+static void measure(arena *arena, const char *label, unsigned int capacity,
+                    unsigned int shards, unsigned int threads,
+                    const char *keys, const unsigned int *stream) {
+  lru_cache *cache;
+  pthread_t workers[MAX_THREADS];
+  run runs[MAX_THREADS];
+  uint64_t hits, misses, evictions;
+
+  lru_cache_create(&cache, capacity, 0, KEY_SIZE, shards, arena);
+
+  const uint64_t start = bench_now_ns();
+  for (unsigned int i = 0; i < threads; i++) {
+    runs[i].cache = cache;
+    runs[i].keys = keys;
+    runs[i].operations = OPERATIONS / threads;
+    runs[i].stream = stream + (uint64_t)i * runs[i].operations;
+    pthread_create(&workers[i], NULL, worker, &runs[i]);
+  }
+  for (unsigned int i = 0; i < threads; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  bench_report(label, OPERATIONS, bench_now_ns() - start);
+
+  lru_cache_stats(cache, &hits, &misses, &evictions);
+  printf("%-40s hit rate %.3f, %llu evictions\n", "",
+         (double)hits / (hits + misses), (unsigned long long)evictions);
+}
+
+int main(int argc, char **argv) {
+  const unsigned int count = argc > 1 ? atoi(argv[1]) : 1 << 20;
+  unsigned int max_threads = argc > 2 ? atoi(argv[2]) : 4;
+  static const double sizes[] = {0.01, 0.05, 0.1, 0.25};
+  arena *arena;
+  uint64_t state = 42;
+  char label[64];
+
+  if (max_threads > MAX_THREADS) {
+    max_threads = MAX_THREADS;
+  }
+
+  printf("=========lru_cache benchmark========\n");
+  printf("keys: %u, zipf exponent: 1\n", count);
+
+  arena_create(&arena, GB(4));
+
+  char *keys = arena_alloc(arena, (uint64_t)count * KEY_SIZE, alignof(char), 0);
+  for (unsigned int i = 0; i < count; i++) {
+    snprintf(keys + (uint64_t)i * KEY_SIZE, KEY_SIZE, "key:%u", i);
+  }
+  const unsigned int *stream = zipf_stream(arena, count, &state);
+
+  for (unsigned int s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+    snprintf(label, sizeof(label), "capacity %.0f%% of keys", sizes[s] * 100);
+    measure(arena, label, count * sizes[s], 1, 1, keys, stream);
+  }
+
+  for (unsigned int t = 1; t <= max_threads; t <<= 1) {
+    snprintf(label, sizeof(label), "%u threads, 1 shard", t);
+    measure(arena, label, count / 10, 1, t, keys, stream);
+    snprintf(label, sizeof(label), "%u threads, 64 shards", t);
+    measure(arena, label, count / 10, 64, t, keys, stream);
+  }
+
+  arena_destroy(&arena);
+
+  return 0;
+}
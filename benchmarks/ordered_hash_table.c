@@ -0,0 +1,143 @@
+/*
+ * Memory, iteration and lookup of ordered_hash_table against hash_table.
+ *
+ * Iteration is measured on a full table and on a sparse one, sized for
+ * 'entries' but holding a tenth of them.
+ *
+ * usage: ordered_hash_table [entries]
+ */
+#include "arena.h"
+#include "bench.h"
+#include "hash_table.h"
+#include "ordered_hash_table.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+
+#define KEY_SIZE 40
+#define LOOKUPS 4000000
+#define ROUNDS 10
+
+static uint64_t iterate_hash_table(hash_table *ht) {
+  hash_table_iterator *it;
+  hash_table_entry *entry;
+  uint64_t count = 0;
+
+  hash_table_iterator_create(&it, ht);
+  for (unsigned int r = 0; r < ROUNDS; r++) {
+    hash_table_iterator_reset(it);
+    while (hash_table_iterator_next(it, &entry) == 0) {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+static uint64_t iterate_ordered(ordered_hash_table *ht) {
+  ordered_hash_table_iterator *it;
+  ordered_hash_table_entry *entry;
+  uint64_t count = 0;
+
+  ordered_hash_table_iterator_create(&it, ht);
+  for (unsigned int r = 0; r < ROUNDS; r++) {
+    ordered_hash_table_iterator_reset(it);
+    while (ordered_hash_table_iterator_next(it, &entry) == 0) {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+int main(int argc, char **argv) {
+  const unsigned int count = argc > 1 ? atoi(argv[1]) : 1 << 20;
+  arena *arena;
+  hash_table *ht;
+  ordered_hash_table *ordered;
+  uint64_t state = 42;
+  uint64_t bytes;
+  uint64_t visited = 0;
+  void *value;
+
+  printf("=========ordered_hash_table benchmark========\n");
+  printf("entries: %u\n", count);
+
+  arena_create(&arena, GB(4));
+  hash_table_create(&ht, 16, NULL, arena);
+  ordered_hash_table_create(&ordered, 16, arena);
+
+  // keys too long to be inline in hash_table, so neither counts them
+  char *keys = arena_alloc(arena, (uint64_t)count * KEY_SIZE, alignof(char), 0);
+  for (unsigned int i = 0; i < count; i++) {
+    char *key = keys + (uint64_t)i * KEY_SIZE;
+    snprintf(key, KEY_SIZE, "snapshot/object/%020llu",
+             (unsigned long long)bench_random(&state));
+    hash_table_insert(ht, key, key);
+    ordered_hash_table_insert(ordered, key, key);
+  }
+
+  hash_table_memory(ht, &bytes);
+  printf("%-40s %8.2f bytes/key\n", "hash_table", (double)bytes / count);
+  ordered_hash_table_memory(ordered, &bytes);
+  printf("%-40s %8.2f bytes/key\n", "ordered_hash_table",
+         (double)bytes / count);
+
+  uint64_t start = bench_now_ns();
+  visited += iterate_hash_table(ht);
+  bench_report("hash_table iterate", (uint64_t)count * ROUNDS,
+               bench_now_ns() - start);
+
+  start = bench_now_ns();
+  visited += iterate_ordered(ordered);
+  bench_report("ordered_hash_table iterate", (uint64_t)count * ROUNDS,
+               bench_now_ns() - start);
+
+  const char **order =
+      arena_alloc(arena, sizeof(char *) * LOOKUPS, alignof(char *), 0);
+  for (unsigned int i = 0; i < LOOKUPS; i++) {
+    order[i] = keys + (bench_random(&state) % count) * KEY_SIZE;
+  }
+
+  uint64_t hits = 0;
+  start = bench_now_ns();
+  for (unsigned int i = 0; i < LOOKUPS; i++) {
+    hits += hash_table_lookup(ht, order[i], &value) == 0;
+  }
+  bench_report("hash_table lookup", LOOKUPS, bench_now_ns() - start);
+
+  start = bench_now_ns();
+  for (unsigned int i = 0; i < LOOKUPS; i++) {
+    hits += ordered_hash_table_lookup(ordered, order[i], &value) == 0;
+  }
+  bench_report("ordered_hash_table lookup", LOOKUPS, bench_now_ns() - start);
+
+  // sized for every key, holding a tenth of them
+  const unsigned int sparse = count / 10;
+  hash_table_create(&ht, count, NULL, arena);
+  ordered_hash_table_create(&ordered, count, arena);
+  for (unsigned int i = 0; i < sparse; i++) {
+    hash_table_insert(ht, keys + (uint64_t)i * KEY_SIZE, NULL);
+    ordered_hash_table_insert(ordered, keys + (uint64_t)i * KEY_SIZE, NULL);
+  }
+
+  start = bench_now_ns();
+  visited += iterate_hash_table(ht);
+  bench_report("hash_table iterate sparse", (uint64_t)sparse * ROUNDS,
+               bench_now_ns() - start);
+
+  start = bench_now_ns();
+  visited += iterate_ordered(ordered);
+  bench_report("ordered_hash_table iterate sparse", (uint64_t)sparse * ROUNDS,
+               bench_now_ns() - start);
+
+  if (hits != 2ULL * LOOKUPS ||
+      visited != 2ULL * ROUNDS * ((uint64_t)count + sparse)) {
+    fprintf(stderr, "unexpected results: %llu hits, %llu visited\n",
+            (unsigned long long)hits, (unsigned long long)visited);
+  }
+
+  arena_destroy(&arena);
+
+  return 0;
+}
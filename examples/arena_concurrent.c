@@ -0,0 +1,94 @@
+/*
+ * Threads allocating from one arena with arena_alloc_concurrent. Every
+ * block is filled with the id of its thread and checked afterwards, so two
+ * threads handed the same memory show up as corrupted blocks.
+ *
+ * Build it with -fsanitize=thread to check the allocator for data races.
+ */
+#include "arena.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define THREAD_COUNT 8
+#define BLOCKS_PER_THREAD 20000
+#define BLOCK_SIZE 40
+
+typedef struct worker {
+  arena *shared;
+  unsigned char id;
+  unsigned char *blocks[BLOCKS_PER_THREAD];
+} worker;
+
+static void *allocate_blocks(void *arg) {
+  worker *w = arg;
+
+  for (int i = 0; i < BLOCKS_PER_THREAD; i++) {
+    // Sizes and alignments vary so claims start at unaligned offsets.
+    const uint64_t alignment = (uint64_t)1 << (i % 5);
+
+    w->blocks[i] = arena_alloc_concurrent(w->shared, BLOCK_SIZE, alignment, 0);
+    if (w->blocks[i] != NULL) {
+      memset(w->blocks[i], w->id, BLOCK_SIZE);
+    }
+  }
+
+  return NULL;
+}
+
+int main(void) {
+  printf("=========arena concurrent example========\n");
+
+  static worker workers[THREAD_COUNT];
+  pthread_t threads[THREAD_COUNT];
+  arena *arena;
+  int corrupted = 0;
+  int missing = 0;
+
+  arena_create(&arena, MB(64));
+
+  printf("allocating %d blocks from each of %d threads\n", BLOCKS_PER_THREAD,
+         THREAD_COUNT);
+  for (int i = 0; i < THREAD_COUNT; i++) {
+    workers[i].shared = arena;
+    workers[i].id = (unsigned char)(i + 1);
+    pthread_create(&threads[i], NULL, allocate_blocks, &workers[i]);
+  }
+
+  for (int i = 0; i < THREAD_COUNT; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  for (int i = 0; i < THREAD_COUNT; i++) {
+    for (int j = 0; j < BLOCKS_PER_THREAD; j++) {
+      const unsigned char *block = workers[i].blocks[j];
+
+      if (block == NULL) {
+        missing++;
+        continue;
+      }
+
+      for (int k = 0; k < BLOCK_SIZE; k++) {
+        if (block[k] != workers[i].id) {
+          corrupted++;
+          break;
+        }
+      }
+    }
+  }
+
+  printf("failed allocations: %d, overlapping blocks: %d\n\n", missing,
+         corrupted);
+
+  // A request that does not fit must leave the arena usable.
+  printf("allocating more than the reservation: %p\n",
+         arena_alloc_concurrent(arena, GB(1), 8, 0));
+  printf("small allocation afterwards succeeds 0(yes), 1(no): %d\n",
+         arena_alloc_concurrent(arena, BLOCK_SIZE, 8, 0) == NULL);
+
+  // de-allocate
+  arena_destroy(&arena);
+
+  return 0;
+}
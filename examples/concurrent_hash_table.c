@@ -0,0 +1,97 @@
+#include "concurrent_hash_table.h"
+#include "arena.h"
+#include <pthread.h>
+#include <stdio.h>
+
+#define THREAD_COUNT 4
+#define KEYS_PER_THREAD 1000
+#define STRESS_THREADS 8
+#define STRESS_ROUNDS 20
+
+static concurrent_hash_table *table;
+
+static void *insert_keys(void *arg) {
+  const long id = (long)arg;
+  char key[32];
+
+  for (long i = 0; i < KEYS_PER_THREAD; i++) {
+    snprintf(key, sizeof(key), "thread%ld:%ld", id, i);
+    concurrent_hash_table_insert(table, key, (void *)id);
+  }
+
+  return NULL;
+}
+
+/**
+ * Insert a batch of keys then delete half of it, round after round, so the
+ * writers keep resizing the table under each other.
+ */
+static void *insert_delete_keys(void *arg) {
+  const long id = (long)arg;
+  char key[32];
+
+  for (long round = 0; round < STRESS_ROUNDS; round++) {
+    for (long i = 0; i < KEYS_PER_THREAD; i++) {
+      snprintf(key, sizeof(key), "stress%ld:%ld:%ld", id, round, i);
+      concurrent_hash_table_insert(table, key, (void *)id);
+    }
+
+    for (long i = 0; i < KEYS_PER_THREAD; i += 2) {
+      snprintf(key, sizeof(key), "stress%ld:%ld:%ld", id, round, i);
+      concurrent_hash_table_delete(table, key);
+    }
+  }
+
+  return NULL;
+}
+
+int main(void) {
+  printf("=========concurrent_hash_table example========\n");
+
+  arena *arena;
+  pthread_t threads[THREAD_COUNT];
+  void *value;
+
+  arena_create(&arena, MB(64));
+  concurrent_hash_table_create(&table, 16, NULL, arena);
+
+  printf("inserting %d keys from each of %d threads\n", KEYS_PER_THREAD,
+         THREAD_COUNT);
+  for (long i = 0; i < THREAD_COUNT; i++) {
+    pthread_create(&threads[i], NULL, insert_keys, (void *)i);
+  }
+
+  for (int i = 0; i < THREAD_COUNT; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  printf("hash table size: %d\n\n", concurrent_hash_table_size(table));
+  printf("searching for 'thread2:500', found 0(yes), 1(no): %d\n",
+         concurrent_hash_table_lookup(table, "thread2:500", &value));
+  printf("inserted by thread: %ld\n\n", (long)value);
+
+  concurrent_hash_table_delete(table, "thread2:500");
+  printf("hash table size after delete: %d\n",
+         concurrent_hash_table_size(table));
+
+  printf("\ninserting and deleting from %d threads\n", STRESS_THREADS);
+  pthread_t stress_threads[STRESS_THREADS];
+  const int before = concurrent_hash_table_size(table);
+
+  for (long i = 0; i < STRESS_THREADS; i++) {
+    pthread_create(&stress_threads[i], NULL, insert_delete_keys, (void *)i);
+  }
+
+  for (int i = 0; i < STRESS_THREADS; i++) {
+    pthread_join(stress_threads[i], NULL);
+  }
+
+  printf("hash table size: %d, expected: %d\n",
+         concurrent_hash_table_size(table),
+         before + STRESS_THREADS * STRESS_ROUNDS * KEYS_PER_THREAD / 2);
+
+  // de-allocate
+  arena_destroy(&arena);
+
+  return 0;
+}
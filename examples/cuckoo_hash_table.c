@@ -0,0 +1,35 @@
+#include "cuckoo_hash_table.h"
+#include "arena.h"
+#include <stdio.h>
+
+int main(void) {
+  printf("=========cuckoo_hash_table example========\n");
+
+  arena *arena;
+  cuckoo_hash_table *allowed;
+  char *value;
+
+  arena_create(&arena, KB(16));
+  cuckoo_hash_table_create(&allowed, 16, arena);
+
+  cuckoo_hash_table_insert(allowed, "10.0.0.1", "office");
+  cuckoo_hash_table_insert(allowed, "10.0.0.2", "build server");
+  cuckoo_hash_table_insert(allowed, "192.168.1.7", "vpn");
+  printf("cuckoo hash table size: %d\n\n", cuckoo_hash_table_size(allowed));
+
+  printf("every lookup reads at most two buckets\n");
+  printf("searching for 10.0.0.2, found 0(yes), 1(no): %d\n",
+         cuckoo_hash_table_lookup(allowed, "10.0.0.2", (void **)&value));
+  printf("10.0.0.2: %s\n\n", value);
+
+  printf("deleting 10.0.0.2, deleted 0(yes), 1(no): %d\n",
+         cuckoo_hash_table_delete(allowed, "10.0.0.2"));
+  printf("searching for 10.0.0.2, found 0(yes), 1(no): %d\n",
+         cuckoo_hash_table_lookup(allowed, "10.0.0.2", (void **)&value));
+  printf("cuckoo hash table size: %d\n", cuckoo_hash_table_size(allowed));
+
+  // de-allocate
+  arena_destroy(&arena);
+
+  return 0;
+}
@@ -0,0 +1,57 @@
+#include "flat_hash_table.h"
+#include "arena.h"
+#include <stdio.h>
+
+typedef struct {
+  double latitude;
+  double longitude;
+} location;
+
+int main(void) {
+  printf("=========flat_hash_table example========\n");
+
+  arena *arena;
+  flat_hash_table *cities;
+  flat_hash_table_iterator *it;
+  flat_hash_table_entry *entry;
+  location lisbon = {38.72, -9.14};
+  location tokyo = {35.68, 139.69};
+  location found;
+  char *key;
+  void *value;
+
+  arena_create(&arena, KB(16));
+  flat_hash_table_create(&cities, 16, sizeof(location), arena);
+
+  printf("inserting lisbon and tokyo, values are copied into the table\n");
+  flat_hash_table_insert(cities, "lisbon", &lisbon);
+  flat_hash_table_insert(cities, "tokyo", &tokyo);
+  printf("flat hash table size: %d\n\n", flat_hash_table_size(cities));
+
+  printf("searching for tokyo, found 0(yes), 1(no): %d\n",
+         flat_hash_table_lookup(cities, "tokyo", &found));
+  printf("tokyo: %.2f, %.2f\n\n", found.latitude, found.longitude);
+
+  tokyo.latitude = 0;
+  flat_hash_table_lookup(cities, "tokyo", &found);
+  printf("changing the local copy leaves the table alone: %.2f\n\n",
+         found.latitude);
+
+  printf("deleting lisbon, deleted 0(yes), 1(no): %d\n",
+         flat_hash_table_delete(cities, "lisbon"));
+  printf("flat hash table size: %d\n\n", flat_hash_table_size(cities));
+
+  printf("iterating:\n");
+  flat_hash_table_iterator_create(&it, cities);
+  while (flat_hash_table_iterator_next(it, &entry) == 0) {
+    flat_hash_table_entry_key(entry, &key);
+    flat_hash_table_entry_value(entry, &value);
+    printf("%s: %.2f, %.2f\n", key, ((location *)value)->latitude,
+           ((location *)value)->longitude);
+  }
+
+  // de-allocate
+  arena_destroy(&arena);
+
+  return 0;
+}
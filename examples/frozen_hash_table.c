@@ -0,0 +1,44 @@
+#include "frozen_hash_table.h"
+#include "arena.h"
+#include "hash_table.h"
+#include <stdio.h>
+
+#define ROUTE_COUNT 5
+
+int main(void) {
+  printf("=========frozen_hash_table example========\n");
+
+  arena *arena;
+  hash_table *routes;
+  frozen_hash_table *frozen;
+  static const char *paths[ROUTE_COUNT] = {"/", "/login", "/logout",
+                                           "/users", "/users/settings"};
+  static const char *handlers[ROUTE_COUNT] = {"index", "login", "logout",
+                                              "list_users", "settings"};
+  char *value;
+
+  arena_create(&arena, KB(16));
+  hash_table_create(&routes, 16, NULL, arena);
+
+  printf("inserting routes: ");
+  for (int i = 0; i < ROUTE_COUNT; i++) {
+    hash_table_insert(routes, paths[i], handlers[i]);
+    printf("%s ", paths[i]);
+  }
+  printf("\n\n");
+
+  hash_table_freeze(routes, &frozen, arena);
+  printf("frozen hash table size: %d\n\n", frozen_hash_table_size(frozen));
+
+  printf("searching for /users, found 0(yes), 1(no): %d\n",
+         frozen_hash_table_lookup(frozen, "/users", (void **)&value));
+  printf("handler: %s\n\n", value);
+
+  printf("searching for /admin, found 0(yes), 1(no): %d\n",
+         frozen_hash_table_lookup(frozen, "/admin", (void **)&value));
+
+  // de-allocate
+  arena_destroy(&arena);
+
+  return 0;
+}
@@ -0,0 +1,35 @@
+#include "hash_set.h"
+#include "arena.h"
+#include <stdio.h>
+
+int main(void) {
+  printf("=========hash_set example========\n");
+
+  arena *arena;
+  hash_set *seen;
+  static const char *words[] = {"the", "quick", "fox", "jumps", "over",
+                                "the", "lazy",  "fox"};
+
+  arena_create(&arena, KB(16));
+  hash_set_create(&seen, 16, arena);
+
+  printf("adding words, repeats are reported:\n");
+  for (unsigned int i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+    if (hash_set_add(seen, words[i]) == 1) {
+      printf("repeated: %s\n", words[i]);
+    }
+  }
+  printf("hash set size: %d\n\n", hash_set_size(seen));
+
+  printf("contains fox, 0(yes), 1(no): %d\n", hash_set_contains(seen, "fox"));
+  printf("contains dog, 0(yes), 1(no): %d\n\n", hash_set_contains(seen, "dog"));
+
+  printf("removing fox, removed 0(yes), 1(no): %d\n",
+         hash_set_remove(seen, "fox"));
+  printf("contains fox, 0(yes), 1(no): %d\n", hash_set_contains(seen, "fox"));
+
+  // de-allocate
+  arena_destroy(&arena);
+
+  return 0;
+}
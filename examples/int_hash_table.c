@@ -0,0 +1,52 @@
+#include "int_hash_table.h"
+#include "arena.h"
+#include <stdio.h>
+
+#define ID_COUNT 10
+
+int main(void) {
+  printf("=========int_hash_table example========\n");
+
+  arena *arena;
+  int_hash_table *ids;
+  int_hash_table_iterator *iterator;
+  int_hash_table_entry *entry;
+  static const char *names[ID_COUNT] = {"zero", "one", "two", "three",
+                                        "four", "five", "six", "seven",
+                                        "eight", "nine"};
+  uint64_t key;
+  char *value;
+
+  arena_create(&arena, KB(4));
+  int_hash_table_create(&ids, 16, NULL, arena);
+
+  printf("inserting ids 1000000000000 to 1000000000009\n");
+  for (uint64_t i = 0; i < ID_COUNT; i++) {
+    int_hash_table_insert(ids, 1000000000000ULL + i, names[i]);
+  }
+
+  printf("hash table size: %d\n\n", int_hash_table_size(ids));
+  printf("searching for 1000000000003, found 0(yes), 1(no): %d\n\n",
+         int_hash_table_lookup(ids, 1000000000003ULL, (void **)&value));
+
+  int_hash_table_delete(ids, 1000000000003ULL);
+  printf("hash table size after delete: %d\n\n", int_hash_table_size(ids));
+
+  int_hash_table_iterator_create(&iterator, ids);
+
+  printf("hash table contents: ");
+  while ((int_hash_table_iterator_next(iterator, &entry)) == 0) {
+    int_hash_table_entry_key(entry, &key);
+    int_hash_table_entry_value(entry, (void **)&value);
+    printf("{%llu: %s} ", (unsigned long long)key, value);
+  }
+
+  int_hash_table_iterator_reset(iterator);
+
+  printf("\n");
+
+  // de-allocate
+  arena_destroy(&arena);
+
+  return 0;
+}
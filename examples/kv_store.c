@@ -0,0 +1,48 @@
+#include "kv_store.h"
+#include "arena.h"
+#include <stdio.h>
+
+int main(void) {
+  printf("=========kv_store example========\n");
+
+  const char *directory = "/tmp/kv_store_example";
+  arena *arena;
+  kv_store *store;
+  char value[64];
+  uint32_t size;
+
+  arena_create(&arena, MB(64));
+  kv_store_open(&store, directory, KV_STORE_SYNC_GROUP, arena);
+
+  kv_store_put(store, "user:1", "ada", 3);
+  kv_store_put(store, "user:2", "grace", 5);
+  kv_store_put(store, "user:1", "ada lovelace", 12);
+  printf("kv store size: %d\n\n", kv_store_size(store));
+
+  printf("searching for user:1, found 0(yes), 1(no): %d\n",
+         kv_store_get(store, "user:1", value, sizeof(value), &size));
+  printf("user:1: %.*s\n\n", (int)size, value);
+
+  printf("deleting user:2, deleted 0(yes), 1(no): %d\n",
+         kv_store_delete(store, "user:2"));
+  kv_store_close(store);
+
+  printf("the index is rebuilt from the files on open\n");
+  kv_store_open(&store, directory, KV_STORE_SYNC_GROUP, arena);
+  printf("kv store size: %d\n", kv_store_size(store));
+  printf("searching for user:2, found 0(yes), 1(no): %d\n\n",
+         kv_store_get(store, "user:2", value, sizeof(value), &size));
+
+  printf("compaction drops the overwritten and deleted records\n");
+  kv_store_compact(store);
+  printf("compacted 0(yes), 1(no): %d\n", kv_store_compact_wait(store));
+  printf("searching for user:1, found 0(yes), 1(no): %d\n",
+         kv_store_get(store, "user:1", value, sizeof(value), &size));
+  printf("user:1: %.*s\n", (int)size, value);
+  kv_store_close(store);
+
+  // de-allocate
+  arena_destroy(&arena);
+
+  return 0;
+}
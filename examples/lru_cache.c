@@ -0,0 +1,44 @@
+#include "lru_cache.h"
+#include "arena.h"
+#include <stdio.h>
+
+int main(void) {
+  printf("=========lru_cache example========\n");
+
+  arena *arena;
+  lru_cache *cache;
+  char *value;
+  uint64_t hits, misses, evictions;
+
+  arena_create(&arena, KB(16));
+  // 3 entries, no byte limit, keys up to 15 bytes, 1 shard
+  lru_cache_create(&cache, 3, 0, 15, 1, arena);
+
+  printf("putting: one two three\n");
+  lru_cache_put(cache, "one", "1", 0);
+  lru_cache_put(cache, "two", "2", 0);
+  lru_cache_put(cache, "three", "3", 0);
+
+  printf("getting one, found 0(yes), 1(no): %d\n",
+         lru_cache_get(cache, "one", (void **)&value));
+
+  printf("putting four, evicts the least recently used\n");
+  lru_cache_put(cache, "four", "4", 0);
+
+  printf("peeking two, found 0(yes), 1(no): %d\n",
+         lru_cache_peek(cache, "two", (void **)&value));
+  printf("peeking one, found 0(yes), 1(no): %d\n",
+         lru_cache_peek(cache, "one", (void **)&value));
+
+  lru_cache_remove(cache, "one");
+  printf("cache size after remove: %d\n\n", lru_cache_size(cache));
+
+  lru_cache_stats(cache, &hits, &misses, &evictions);
+  printf("hits: %llu misses: %llu evictions: %llu\n", (unsigned long long)hits,
+         (unsigned long long)misses, (unsigned long long)evictions);
+
+  // de-allocate
+  arena_destroy(&arena);
+
+  return 0;
+}
@@ -0,0 +1,47 @@
+#include "ordered_hash_table.h"
+#include "arena.h"
+#include <stdio.h>
+
+int main(void) {
+  printf("=========ordered_hash_table example========\n");
+
+  arena *arena;
+  ordered_hash_table *config;
+  ordered_hash_table_iterator *it;
+  ordered_hash_table_entry *entry;
+  char *key;
+  void *value;
+
+  arena_create(&arena, KB(16));
+  ordered_hash_table_create(&config, 8, arena);
+
+  ordered_hash_table_insert(config, "host", "localhost");
+  ordered_hash_table_insert(config, "port", "8080");
+  ordered_hash_table_insert(config, "user", "admin");
+  ordered_hash_table_insert(config, "timeout", "30");
+  printf("ordered hash table size: %d\n\n",
+         ordered_hash_table_size(config));
+
+  printf("updating port keeps its place, deleting user and adding it back "
+         "moves it to the end\n");
+  ordered_hash_table_insert_or_update(config, "port", "9090");
+  ordered_hash_table_delete(config, "user");
+  ordered_hash_table_insert(config, "user", "guest");
+
+  printf("searching for port, found 0(yes), 1(no): %d\n",
+         ordered_hash_table_lookup(config, "port", &value));
+  printf("port: %s\n\n", (char *)value);
+
+  printf("iterating in insertion order:\n");
+  ordered_hash_table_iterator_create(&it, config);
+  while (ordered_hash_table_iterator_next(it, &entry) == 0) {
+    ordered_hash_table_entry_key(entry, &key);
+    ordered_hash_table_entry_value(entry, &value);
+    printf("%s = %s\n", key, (char *)value);
+  }
+
+  // de-allocate
+  arena_destroy(&arena);
+
+  return 0;
+}
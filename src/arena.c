@@ -1,7 +1,10 @@
 #include "arena.h"
+#include <pthread.h>
+#include <sched.h>
 #include <string.h>
 
 #define IS_NOT_POWER_OF_TWO(n) ((uint64_t)(n) & ((uint64_t)(n) - 1))
+#define FALSE 0
 
 /**
  * Aligns 'n' up to the nearest 'p'(power of 2).
@@ -10,59 +13,153 @@
   (((uint64_t)(n) + ((uint64_t)(p) - 1)) & (~((uint64_t)(p) - 1)))
 
 struct arena {
-  uint8_t *base_ptr;        // pointer to the start of the reserved size
+  arena_bump bump;          // base_ptr, offset and committed_size
   uint64_t reserved_size;   // max size of the block of memory
-  uint64_t committed_size;  // size of physical memory
-  uint64_t offset;          // bump pointer
+  uint64_t commit_granularity; // commits are multiples of it
+  uint64_t commit_ahead;    // committed past the need, 0 doubles
   uint64_t scratch_offset;  // store the offset for scratch arena
   int scratch_arena_active; //  track whether the scratch arena is active
+  int pooled;               // a slice of the thread-local reservation
+  int committing;           // a thread is extending 'committed_size'
 };
 
 /**
- * Get the size of a block of virtual memory from the OS.
+ * Slices of one reservation handed to threads by 'arena_thread_local'.
+ */
+static struct {
+  pthread_once_t once;
+  pthread_key_t key;          // runs 'release_thread_local' at thread exit
+  pthread_mutex_t lock;       // 'free_slices' and 'used'
+  uint8_t *base_ptr;          // NULL when the reservation failed
+  unsigned int used;          // slices handed out at least once
+  unsigned int free_count;
+  unsigned int free_slices[ARENA_THREAD_LOCAL_MAX];
+  arena arenas[ARENA_THREAD_LOCAL_MAX];
+} pool = {.once = PTHREAD_ONCE_INIT, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+static __thread arena *thread_arena;
+
+/**
+ * Get the size of a block of virtual memory from the OS, asked once.
  */
 static long int get_page_size() {
- long int result;
-  if ((result = sysconf(_SC_PAGESIZE)) == -1) {
-    return -1;
+  static long int page_size;
+  long int result = __atomic_load_n(&page_size, __ATOMIC_RELAXED);
+
+  if (result == 0) {
+    if ((result = sysconf(_SC_PAGESIZE)) == -1) {
+      return -1;
+    }
+    __atomic_store_n(&page_size, result, __ATOMIC_RELAXED);
   }
 
   return result;
 }
 
+/**
+ * Where to commit up to so that 'end' is covered, 'commit_ahead' past the
+ * committed memory when that is further.
+ */
+static uint64_t commit_target(arena *arena, uint64_t committed, uint64_t end) {
+  const uint64_t ahead =
+      arena->commit_ahead == 0 ? committed : arena->commit_ahead;
+  uint64_t target = ALIGN_UP_POW2(committed + ahead > end ? committed + ahead
+                                                          : end,
+                                  arena->commit_granularity);
+
+  // Clamp to the reservation limit
+  return target > arena->reserved_size ? arena->reserved_size : target;
+}
+
+/**
+ * Reserve 'size' bytes starting at a multiple of 'alignment', by trimming a
+ * larger reservation.
+ */
+static void *reserve_aligned(uint64_t size, uint64_t alignment) {
+  const uint64_t padding = alignment > (uint64_t)get_page_size() ? alignment : 0;
+  uint8_t *block = mmap(NULL, size + padding, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (block == MAP_FAILED) {
+    return NULL;
+  }
+
+  uint8_t *start = (uint8_t *)ALIGN_UP_POW2(block, alignment);
+  if (start > block) {
+    munmap(block, start - block);
+  }
+  if (start + size < block + size + padding) {
+    munmap(start + size, block + padding - start);
+  }
+
+  return start;
+}
+
 int arena_create(arena **a, uint64_t reserve_size) {
+  return arena_create_ex(a, reserve_size, 0);
+}
+
+int arena_create_ex(arena **a, uint64_t reserve_size, unsigned int flags) {
   if (((*a) = malloc(sizeof(arena))) == NULL) {
     return 1;
   }
 
-  const uint32_t page_size = get_page_size();
+  const uint64_t page_size = get_page_size();
+  const uint64_t alignment =
+      flags & (ARENA_HUGEPAGE | ARENA_HUGETLB | ARENA_COMMIT_HUGE)
+          ? ARENA_HUGE_PAGE_SIZE
+          : page_size;
+  uint64_t granularity = flags & ARENA_COMMIT_HUGE ? alignment : page_size;
 
   /// Align reservation up to the nearest page size
   // Align to a page boundary
-  if ((reserve_size = ALIGN_UP_POW2(reserve_size, page_size)) <= 0) {
+  if ((reserve_size = ALIGN_UP_POW2(reserve_size, alignment)) <= 0) {
+    free(*a);
     return 1;
   }
 
   // Reserve the Virtual Memory Area but does not allocate physical memory.
-  void *block;
-  if ((block = mmap(NULL, reserve_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
-                    -1, 0)) == MAP_FAILED) {
-    free(*a);
-    return 1;
+  void *block = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+  // Huge pages are set aside for the whole reservation, or the mmap fails.
+  if (flags & ARENA_HUGETLB) {
+    block = mmap(NULL, reserve_size, PROT_NONE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    granularity = block == MAP_FAILED ? granularity : ARENA_HUGE_PAGE_SIZE;
+  }
+#endif
+
+  // Without them, fall back to regular pages.
+  if (block == MAP_FAILED) {
+    if ((block = reserve_aligned(reserve_size, alignment)) == NULL) {
+      free(*a);
+      return 1;
+    }
+
+#ifdef MADV_HUGEPAGE
+    if (flags & ARENA_HUGEPAGE) {
+      madvise(block, reserve_size, MADV_HUGEPAGE);
+    }
+#endif
   }
 
-  (*a)->base_ptr = (uint8_t *)block;
+  (*a)->bump.base_ptr = (uint8_t *)block;
   (*a)->reserved_size = reserve_size;
-  (*a)->committed_size = 0;
-  (*a)->offset = 0;
+  (*a)->bump.committed_size = 0;
+  (*a)->commit_granularity = granularity;
+  (*a)->commit_ahead = ARENA_COMMIT_AHEAD_DEFAULT;
+  (*a)->bump.offset = 0;
   (*a)->scratch_offset = 0;
   (*a)->scratch_arena_active = 0; // false
+  (*a)->pooled = 0;
+  (*a)->committing = 0;
 
   return 0;
 }
 
-void *arena_alloc(arena *arena, uint64_t size, uint64_t alignment,
-                  unsigned int zero_out) {
+void *arena_alloc_commit(arena *arena, uint64_t size, uint64_t alignment,
+                         unsigned int zero_out) {
   if (arena == NULL || size <= 0 ||
       (IS_NOT_POWER_OF_TWO(alignment) && alignment != 0)) {
     return NULL;
@@ -70,25 +167,20 @@ void *arena_alloc(arena *arena, uint64_t size, uint64_t alignment,
 
   const uint64_t actual_alignment = (alignment == 0) ? 1 : alignment;
   const uint64_t aligned_offset =
-      ALIGN_UP_POW2(arena->offset, actual_alignment);
-  const uint32_t page_size = get_page_size();
+      ALIGN_UP_POW2(arena->bump.offset, actual_alignment);
   const uint64_t new_offset = aligned_offset + size;
-  if (new_offset > arena->reserved_size) {
+  if (new_offset > arena->reserved_size || new_offset < aligned_offset) {
     return NULL; // Out of reserved space
   }
 
   // check Virtual Memory Area has been commited.
-  if (new_offset > arena->committed_size) {
-    // Align the required commit size up to nearest page
-    uint64_t new_commit_target = ALIGN_UP_POW2(new_offset, page_size);
-    // Clamp to the reservation limit
-    if (new_commit_target > arena->reserved_size) {
-      new_commit_target = arena->reserved_size;
-    }
+  if (new_offset > arena->bump.committed_size) {
+    const uint64_t new_commit_target =
+        commit_target(arena, arena->bump.committed_size, new_offset);
 
-    const uint64_t size_to_commit = new_commit_target - arena->committed_size;
+    const uint64_t size_to_commit = new_commit_target - arena->bump.committed_size;
     void *commit_start_addr =
-        (void *)((uint8_t *)arena->base_ptr + arena->committed_size);
+        (void *)((uint8_t *)arena->bump.base_ptr + arena->bump.committed_size);
 
     // Allocate physical memory pages(4KB) to the reserved Virtual Memory Area.
     if (mprotect(commit_start_addr, size_to_commit, PROT_READ | PROT_WRITE) !=
@@ -96,11 +188,94 @@ void *arena_alloc(arena *arena, uint64_t size, uint64_t alignment,
       return NULL;
     }
 
-    arena->committed_size = new_commit_target;
+    arena->bump.committed_size = new_commit_target;
   }
 
-  void *memory = (void *)((uint8_t *)arena->base_ptr + aligned_offset);
-  arena->offset = new_offset;
+  void *memory = (void *)((uint8_t *)arena->bump.base_ptr + aligned_offset);
+  arena->bump.offset = new_offset;
+
+  if (zero_out == 1) {
+    memset(memory, 0, size);
+  }
+
+  return memory;
+}
+
+/**
+ * Commit up to 'end' for 'arena_alloc_concurrent'.
+ *
+ * The thread that wins the CAS on 'committing' runs the mprotect, the others
+ * wait for 'committed_size' to cover their allocation.
+ */
+static int commit_concurrent(arena *arena, uint64_t end) {
+  while (__atomic_load_n(&arena->bump.committed_size, __ATOMIC_ACQUIRE) < end) {
+    int expected = 0;
+
+    if (!__atomic_compare_exchange_n(&arena->committing, &expected, 1, FALSE,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      sched_yield();
+      continue;
+    }
+
+    const uint64_t committed =
+        __atomic_load_n(&arena->bump.committed_size, __ATOMIC_RELAXED);
+    int result = 0;
+
+    if (committed < end) {
+      const uint64_t target = commit_target(arena, committed, end);
+
+      if (mprotect(arena->bump.base_ptr + committed, target - committed,
+                   PROT_READ | PROT_WRITE) == 0) {
+        __atomic_store_n(&arena->bump.committed_size, target, __ATOMIC_RELEASE);
+      } else {
+        result = 1;
+      }
+    }
+
+    __atomic_store_n(&arena->committing, 0, __ATOMIC_RELEASE);
+
+    if (result == 1) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+void *arena_alloc_concurrent(arena *arena, uint64_t size, uint64_t alignment,
+                             unsigned int zero_out) {
+  if (arena == NULL || size <= 0 ||
+      (IS_NOT_POWER_OF_TWO(alignment) && alignment != 0)) {
+    return NULL;
+  }
+
+  uint64_t offset = __atomic_load_n(&arena->bump.offset, __ATOMIC_RELAXED);
+  uint64_t aligned_offset;
+
+  // Nothing is claimed unless it fits and is committed, so a failure leaves
+  // the arena as it was. A lost CAS reloads 'offset' and tries again.
+  while (1) {
+    aligned_offset = ALIGN_UP_POW2(offset, alignment == 0 ? 1 : alignment);
+    const uint64_t new_offset = aligned_offset + size;
+
+    if (new_offset < aligned_offset || new_offset > arena->reserved_size) {
+      return NULL; // Out of reserved space
+    }
+
+    if (new_offset >
+            __atomic_load_n(&arena->bump.committed_size, __ATOMIC_ACQUIRE) &&
+        commit_concurrent(arena, new_offset) == 1) {
+      return NULL;
+    }
+
+    if (__atomic_compare_exchange_n(&arena->bump.offset, &offset, new_offset,
+                                    FALSE, __ATOMIC_RELAXED,
+                                    __ATOMIC_RELAXED)) {
+      break;
+    }
+  }
+
+  void *memory = (void *)(arena->bump.base_ptr + aligned_offset);
 
   if (zero_out == 1) {
     memset(memory, 0, size);
@@ -132,12 +307,39 @@ void *arena_realloc(arena *arena, void *old_ptr, const uint64_t old_size,
   return memory;
 }
 
+int arena_set_commit_ahead(arena *arena, uint64_t commit_ahead) {
+  if (arena == NULL) {
+    return 1;
+  }
+
+  arena->commit_ahead = commit_ahead;
+
+  return 0;
+}
+
+int arena_free_last(arena *arena, void *ptr, const uint64_t size) {
+  if (arena == NULL || ptr == NULL) {
+    return 1;
+  }
+
+  const uint64_t start = (uint8_t *)ptr - arena->bump.base_ptr;
+
+  if (start + size != arena->bump.offset ||
+      (arena->scratch_arena_active && start < arena->scratch_offset)) {
+    return 1;
+  }
+
+  arena->bump.offset = start;
+
+  return 0;
+}
+
 int arena_start_scratch_arena(arena *a) {
   if (a == NULL || a->scratch_arena_active != 0) {
     return 1;
   }
 
-  a->scratch_offset = a->offset;
+  a->scratch_offset = a->bump.offset;
   a->scratch_arena_active = 1;
 
   return 0;
@@ -148,7 +350,7 @@ int arena_end_scratch_arena(arena *a) {
     return 1;
   }
 
-  a->offset = a->scratch_offset;
+  a->bump.offset = a->scratch_offset;
   a->scratch_arena_active = 0;
 
   return 0;
@@ -158,7 +360,7 @@ int arena_reset(arena *a) {
   if (a == NULL) {
     return 1;
   }
-  a->offset = 0;
+  a->bump.offset = 0;
   a->scratch_offset = 0;
   a->scratch_arena_active = 0; // Reset scratch state too
 
@@ -166,14 +368,79 @@ int arena_reset(arena *a) {
 }
 
 int arena_destroy(arena **a) {
-  if (*a == NULL) {
+  if (*a == NULL || (*a)->pooled) {
     return 1;
   }
 
-  munmap((*a)->base_ptr, (*a)->reserved_size);
+  munmap((*a)->bump.base_ptr, (*a)->reserved_size);
   free(*a);
 
   *a = NULL;
 
   return 0;
 }
+
+/**
+ * Thread exit, give the pages back and the slice to the pool.
+ */
+static void release_thread_local(void *slice) {
+  arena *a = slice;
+
+  madvise(a->bump.base_ptr, a->bump.committed_size, MADV_DONTNEED);
+  arena_reset(a);
+
+  pthread_mutex_lock(&pool.lock);
+  pool.free_slices[pool.free_count++] = a - pool.arenas;
+  pthread_mutex_unlock(&pool.lock);
+}
+
+static void reserve_thread_local(void) {
+  const uint64_t size = ARENA_THREAD_LOCAL_MAX * ARENA_THREAD_LOCAL_SIZE;
+  void *block = mmap(NULL, size, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+  if (block != MAP_FAILED &&
+      pthread_key_create(&pool.key, release_thread_local) == 0) {
+    pool.base_ptr = block;
+  } else if (block != MAP_FAILED) {
+    munmap(block, size);
+  }
+}
+
+arena *arena_thread_local(void) {
+  if (thread_arena != NULL) {
+    return thread_arena;
+  }
+
+  pthread_once(&pool.once, reserve_thread_local);
+  if (pool.base_ptr == NULL) {
+    return NULL;
+  }
+
+  arena *a = NULL;
+  pthread_mutex_lock(&pool.lock);
+
+  if (pool.free_count > 0) {
+    a = &pool.arenas[pool.free_slices[--pool.free_count]];
+  } else if (pool.used < ARENA_THREAD_LOCAL_MAX) {
+    a = &pool.arenas[pool.used];
+    a->bump.base_ptr = pool.base_ptr + pool.used * ARENA_THREAD_LOCAL_SIZE;
+    a->reserved_size = ARENA_THREAD_LOCAL_SIZE;
+    a->commit_granularity = get_page_size();
+    a->commit_ahead = ARENA_COMMIT_AHEAD_DEFAULT;
+    a->pooled = 1;
+    pool.used++;
+  }
+
+  pthread_mutex_unlock(&pool.lock);
+
+  if (a == NULL || pthread_setspecific(pool.key, a) != 0) {
+    if (a != NULL) {
+      release_thread_local(a);
+    }
+    return NULL;
+  }
+
+  thread_arena = a;
+  return a;
+}
@@ -0,0 +1,566 @@
+#include "concurrent_hash_table.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CONCURRENT_HASH_TABLE_LOAD_FACTOR 0.75
+#define FALSE 0
+#define TRUE 1
+
+#define STRIPES 64        // number of writer locks, power of 2
+#define STRIPE_BITS 6     // log2(STRIPES)
+#define MIGRATE_CHUNK 256 // slots a writer migrates per operation
+
+/**
+ * Every writer can overshoot the load factor by one claimed slot, keep the
+ * smallest table well above that.
+ */
+#define MIN_CAPACITY 512
+
+enum write_mode { WRITE_INSERT, WRITE_INSERT_OR_UPDATE, WRITE_DELETE };
+
+/**
+ * Immutable once published, shared by every table the key migrates to.
+ */
+typedef struct key_record {
+  unsigned int hash_code;
+  unsigned int key_length;
+  char key[];
+} key_record;
+
+typedef struct slot {
+  _Atomic(key_record *) key; // claimed once per table, never reused
+  _Atomic(void *) value;     // NULL when the key is absent
+} slot;
+
+typedef struct table {
+  slot *slots;
+  unsigned int capacity;         // number of buckets, power of 2
+  unsigned int threshold;        // claimed slots before resizing
+  unsigned int reserved;         // slots kept for entries migrating in
+  atomic_uint used;              // claimed slots, deleted keys included
+  _Atomic(struct table *) next;  // table being migrated to, NULL otherwise
+  atomic_uint chunks_claimed;    // chunks handed to migrating writers
+  atomic_uint chunks_done;       // chunks completely migrated
+} table;
+
+struct concurrent_hash_table {
+  _Atomic(table *) current; // newest fully populated table
+  unsigned int (*hashfn)(const char *, unsigned int); // used for hash code
+  arena *arena;                     // memory block for allocations
+  pthread_mutex_t arena_lock;       // the arena is single threaded
+  pthread_mutex_t resize_lock;      // one new table at a time
+  pthread_mutex_t stripes[STRIPES]; // writers of a key share a stripe
+  atomic_int size;                  // number of entries
+};
+
+// Sentinels, only their addresses matter.
+static char null_value;      // stored in place of a NULL value
+static char moved_value;     // the entry lives in the next table
+static key_record moved_key; // the slot was empty when migrated
+
+#define NULL_VALUE ((void *)&null_value)
+#define MOVED_VALUE ((void *)&moved_value)
+#define MOVED_KEY (&moved_key)
+
+/**
+ * FNV-1A hashing function.
+ *
+ * source:
+ * https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function`
+ */
+static unsigned int hash(const char *key, unsigned int length) {
+  unsigned int hash_code = 2166136261U;
+
+  for (unsigned int i = 0; i < length; i++) {
+    hash_code ^= (unsigned char)key[i];
+    hash_code *= 16777619;
+  }
+
+  return hash_code;
+}
+
+/**
+ * Writer lock of every key with 'hash_code'.
+ *
+ * Uses the top bits, the bottom ones pick the bucket.
+ */
+static pthread_mutex_t *stripe_of(concurrent_hash_table *ht,
+                                  unsigned int hash_code) {
+  return &ht->stripes[hash_code >> (32 - STRIPE_BITS)];
+}
+
+/**
+ * Allocate from the shared arena.
+ */
+static void *allocate(concurrent_hash_table *ht, uint64_t size,
+                      size_t alignment) {
+  pthread_mutex_lock(&ht->arena_lock);
+  void *memory = arena_alloc(ht->arena, size, alignment, FALSE);
+  pthread_mutex_unlock(&ht->arena_lock);
+
+  return memory;
+}
+
+/**
+ * Allocate a table with every slot empty.
+ *
+ * @param ht owner of the table.
+ * @param capacity number of buckets, power of 2.
+ * @param reserved slots kept for entries migrating in.
+ * @return the new table, NULL otherwise
+ */
+static table *table_create(concurrent_hash_table *ht, unsigned int capacity,
+                           unsigned int reserved) {
+  table *t = allocate(ht, sizeof(table), alignof(table));
+
+  if (t == NULL ||
+      (t->slots = allocate(ht, capacity * sizeof(slot), alignof(slot))) ==
+          NULL) {
+    return NULL;
+  }
+
+  // Zeroed outside the arena lock, NULL key and value mean empty.
+  memset(t->slots, 0, capacity * sizeof(slot));
+
+  t->capacity = capacity;
+  t->threshold = capacity * CONCURRENT_HASH_TABLE_LOAD_FACTOR;
+  t->reserved = reserved;
+  atomic_init(&t->used, 0);
+  atomic_init(&t->next, NULL);
+  atomic_init(&t->chunks_claimed, 0);
+  atomic_init(&t->chunks_done, 0);
+
+  return t;
+}
+
+/**
+ * Linear probe for 'key'.
+ *
+ * @param t table to search.
+ * @param key identifier used to search for.
+ * @param key_length length of 'key'.
+ * @param hash_code hash code of 'key'.
+ * @param end where to store the empty slot ending the probe, -1 when the
+ *        probe reached a migrated slot or the table is full.
+ * @return index of the slot holding 'key', -1 otherwise
+ */
+static long probe(table *t, const char *key, unsigned int key_length,
+                  unsigned int hash_code, long *end) {
+  const unsigned int mask = t->capacity - 1;
+  unsigned int index = hash_code & mask;
+
+  for (unsigned int n = 0; n < t->capacity; n++) {
+    key_record *record =
+        atomic_load_explicit(&t->slots[index].key, memory_order_acquire);
+
+    if (record == NULL) {
+      *end = index;
+      return -1;
+    }
+
+    // Empty when migrated, the key can only be in the next table.
+    if (record == MOVED_KEY) {
+      break;
+    }
+
+    if (record->hash_code == hash_code && record->key_length == key_length &&
+        memcmp(record->key, key, key_length) == 0) {
+      return index;
+    }
+
+    index = (index + 1) & mask;
+  }
+
+  *end = -1;
+  return -1;
+}
+
+/**
+ * Claim an empty slot of 't' for an entry known to be absent from it.
+ */
+static void table_put(table *t, key_record *record, void *value) {
+  const unsigned int mask = t->capacity - 1;
+  unsigned int index = record->hash_code & mask;
+
+  while (1) {
+    key_record *expected = NULL;
+
+    if (atomic_compare_exchange_strong_explicit(
+            &t->slots[index].key, &expected, record, memory_order_release,
+            memory_order_relaxed)) {
+      atomic_store_explicit(&t->slots[index].value, value,
+                            memory_order_release);
+      atomic_fetch_add_explicit(&t->used, 1, memory_order_relaxed);
+      return;
+    }
+
+    index = (index + 1) & mask;
+  }
+}
+
+/**
+ * Move slot 'index' of 't' into 'next'.
+ *
+ * The entry is copied under the stripe lock of its key, so it cannot race a
+ * writer of the same key. Empty slots are sealed with MOVED_KEY so no writer
+ * claims them afterwards.
+ *
+ * @param ht owner of both tables.
+ * @param t table being migrated.
+ * @param next table receiving the entries.
+ * @param index slot of 't' to move.
+ * @param locked whether the caller holds the stripe lock of the slot's key.
+ */
+static void migrate_slot(concurrent_hash_table *ht, table *t, table *next,
+                         unsigned int index, int locked) {
+  slot *s = &t->slots[index];
+  key_record *record = atomic_load_explicit(&s->key, memory_order_acquire);
+
+  if (record == NULL &&
+      atomic_compare_exchange_strong_explicit(&s->key, &record, MOVED_KEY,
+                                              memory_order_acq_rel,
+                                              memory_order_acquire)) {
+    return;
+  }
+
+  if (record == MOVED_KEY) {
+    return;
+  }
+
+  pthread_mutex_t *lock = stripe_of(ht, record->hash_code);
+
+  if (!locked) {
+    pthread_mutex_lock(lock);
+  }
+
+  void *value = atomic_load_explicit(&s->value, memory_order_acquire);
+
+  if (value != MOVED_VALUE) {
+    // deleted keys are dropped
+    if (value != NULL) {
+      table_put(next, record, value);
+    }
+
+    atomic_store_explicit(&s->value, MOVED_VALUE, memory_order_release);
+  }
+
+  if (!locked) {
+    pthread_mutex_unlock(lock);
+  }
+}
+
+/**
+ * Migrate one chunk of the running resize, if any.
+ *
+ * The writer finishing the last chunk publishes the new table.
+ *
+ * @param ht hash table to help.
+ * @return 1 when a resize is running, 0 otherwise
+ */
+static int help_migrate(concurrent_hash_table *ht) {
+  table *t = atomic_load_explicit(&ht->current, memory_order_acquire);
+  table *next = atomic_load_explicit(&t->next, memory_order_acquire);
+
+  if (next == NULL) {
+    return 0;
+  }
+
+  const unsigned int chunks = (t->capacity + MIGRATE_CHUNK - 1) / MIGRATE_CHUNK;
+  const unsigned int chunk =
+      atomic_fetch_add_explicit(&t->chunks_claimed, 1, memory_order_relaxed);
+
+  if (chunk < chunks) {
+    const unsigned int end = (chunk + 1) * MIGRATE_CHUNK;
+
+    for (unsigned int i = chunk * MIGRATE_CHUNK; i < end && i < t->capacity;
+         i++) {
+      migrate_slot(ht, t, next, i, FALSE);
+    }
+
+    if (atomic_fetch_add_explicit(&t->chunks_done, 1, memory_order_acq_rel) +
+            1 ==
+        chunks) {
+      atomic_store_explicit(&ht->current, next, memory_order_release);
+    }
+  } else {
+    // every chunk is taken, wait for the writers still copying
+    sched_yield();
+  }
+
+  return 1;
+}
+
+/**
+ * Make room in 't', the table that ran out of room.
+ *
+ * Starts a resize when 't' is current. When 't' is still receiving a
+ * migration, helps until it finishes. When another writer already replaced
+ * 't', there is nothing to do, the caller probes the newer table. Called
+ * without any stripe lock held.
+ *
+ * @param ht hash table to modify.
+ * @param t table that ran out of room.
+ */
+static void grow(concurrent_hash_table *ht, table *t) {
+  table *current = atomic_load_explicit(&ht->current, memory_order_acquire);
+
+  if (t != current) {
+    // 't' can only be the table migrated into or an already superseded one.
+    while (atomic_load_explicit(&current->next, memory_order_acquire) == t) {
+      help_migrate(ht);
+      current = atomic_load_explicit(&ht->current, memory_order_acquire);
+    }
+
+    return;
+  }
+
+  pthread_mutex_lock(&ht->resize_lock);
+
+  if (atomic_load_explicit(&t->next, memory_order_acquire) == NULL) {
+    // Mostly deleted keys only need a rehash at the same size.
+    const unsigned int live = atomic_load(&ht->size);
+    const unsigned int capacity =
+        (live + 1) * 2 > t->threshold ? t->capacity << 1 : t->capacity;
+    table *next = table_create(ht, capacity, t->threshold + STRIPES);
+
+    ASSERT(next != NULL, "arena is out of memory");
+
+    atomic_store_explicit(&t->next, next, memory_order_release);
+  }
+
+  pthread_mutex_unlock(&ht->resize_lock);
+}
+
+/**
+ * Insert, update or delete 'key' under its stripe lock.
+ *
+ * @param ht hash table to modify.
+ * @param key identifier of the entry.
+ * @param value value to store, ignored by WRITE_DELETE.
+ * @param mode operation to perform.
+ * @return 0 on success, 1 otherwise
+ */
+static int write_entry(concurrent_hash_table *ht, const char *key,
+                       void *value, enum write_mode mode) {
+  const unsigned int key_length = strlen(key);
+  const unsigned int hash_code = ht->hashfn(key, key_length);
+  pthread_mutex_t *lock = stripe_of(ht, hash_code);
+  key_record *record = NULL;
+
+  if (value == NULL) {
+    value = NULL_VALUE;
+  }
+
+  while (1) {
+    help_migrate(ht);
+    pthread_mutex_lock(lock);
+
+    table *t = atomic_load_explicit(&ht->current, memory_order_acquire);
+    table *next;
+    long end;
+    long index;
+
+    // Carry the key along until it sits in the newest table.
+    while (1) {
+      index = probe(t, key, key_length, hash_code, &end);
+
+      if ((next = atomic_load_explicit(&t->next, memory_order_acquire)) ==
+          NULL) {
+        break;
+      }
+
+      if (index != -1) {
+        migrate_slot(ht, t, next, index, TRUE);
+      }
+
+      t = next;
+    }
+
+    if (index != -1) {
+      slot *s = &t->slots[index];
+      void *old = atomic_load_explicit(&s->value, memory_order_relaxed);
+      int result = 0;
+
+      if (mode == WRITE_INSERT && old != NULL) {
+        result = 1; // entry with key exists
+      } else if (mode == WRITE_DELETE) {
+        if (old == NULL) {
+          result = 1;
+        } else {
+          atomic_store_explicit(&s->value, NULL, memory_order_release);
+          atomic_fetch_sub_explicit(&ht->size, 1, memory_order_relaxed);
+        }
+      } else {
+        atomic_store_explicit(&s->value, value, memory_order_release);
+
+        if (old == NULL) {
+          atomic_fetch_add_explicit(&ht->size, 1, memory_order_relaxed);
+        }
+      }
+
+      pthread_mutex_unlock(lock);
+      return result;
+    }
+
+    if (mode == WRITE_DELETE) {
+      pthread_mutex_unlock(lock);
+      return 1; // Key not found, there is no entry to delete.
+    }
+
+    // A table still receiving a migration keeps room for the incoming keys.
+    const unsigned int reserved =
+        t == atomic_load_explicit(&ht->current, memory_order_acquire)
+            ? 0
+            : t->reserved;
+    const unsigned int limit =
+        reserved >= t->threshold ? 0 : t->threshold - reserved;
+
+    if (end == -1 ||
+        atomic_load_explicit(&t->used, memory_order_relaxed) + 1 > limit) {
+      pthread_mutex_unlock(lock);
+      grow(ht, t);
+      continue;
+    }
+
+    if (record == NULL) {
+      if ((record = allocate(ht, sizeof(key_record) + key_length + 1,
+                             alignof(key_record))) == NULL) {
+        pthread_mutex_unlock(lock);
+        return 1;
+      }
+
+      record->hash_code = hash_code;
+      record->key_length = key_length;
+      memcpy(record->key, key, key_length + 1);
+    }
+
+    key_record *expected = NULL;
+
+    // Lost the slot to another key or to a migration, probe again.
+    if (!atomic_compare_exchange_strong_explicit(
+            &t->slots[end].key, &expected, record, memory_order_release,
+            memory_order_relaxed)) {
+      pthread_mutex_unlock(lock);
+      continue;
+    }
+
+    atomic_fetch_add_explicit(&t->used, 1, memory_order_relaxed);
+    atomic_store_explicit(&t->slots[end].value, value, memory_order_release);
+    atomic_fetch_add_explicit(&ht->size, 1, memory_order_relaxed);
+
+    pthread_mutex_unlock(lock);
+    return 0;
+  }
+}
+
+int concurrent_hash_table_create(concurrent_hash_table **ht,
+                                 unsigned int initial_capacity,
+                                 unsigned int (*hashfn)(const char *,
+                                                        unsigned int),
+                                 arena *arena) {
+  ASSERT(arena != NULL, "arena MUST be provided");
+
+  if ((*ht = arena_alloc(arena, sizeof(concurrent_hash_table),
+                         alignof(concurrent_hash_table), FALSE)) == NULL) {
+    return 1;
+  }
+
+  (*ht)->hashfn = hashfn == NULL ? hash : hashfn;
+  (*ht)->arena = arena;
+  atomic_init(&(*ht)->size, 0);
+  pthread_mutex_init(&(*ht)->arena_lock, NULL);
+  pthread_mutex_init(&(*ht)->resize_lock, NULL);
+
+  for (unsigned int i = 0; i < STRIPES; i++) {
+    pthread_mutex_init(&(*ht)->stripes[i], NULL);
+  }
+
+  const unsigned int capacity = initial_capacity < MIN_CAPACITY
+                                    ? MIN_CAPACITY
+                                    : (unsigned int)ROUND_POW2(initial_capacity);
+  table *t = table_create(*ht, capacity, 0);
+
+  if (t == NULL) {
+    return 1;
+  }
+
+  atomic_init(&(*ht)->current, t);
+
+  return 0;
+}
+
+int concurrent_hash_table_size(concurrent_hash_table *ht) {
+  if (ht == NULL) {
+    return -1;
+  }
+
+  return atomic_load_explicit(&ht->size, memory_order_relaxed);
+}
+
+int concurrent_hash_table_insert(concurrent_hash_table *ht, const char *key,
+                                 const void *value) {
+  if (ht == NULL || key == NULL) {
+    return 1;
+  }
+
+  return write_entry(ht, key, (void *)value, WRITE_INSERT);
+}
+
+int concurrent_hash_table_insert_or_update(concurrent_hash_table *ht,
+                                           const char *key, void *value) {
+  if (ht == NULL || key == NULL) {
+    return 1;
+  }
+
+  return write_entry(ht, key, value, WRITE_INSERT_OR_UPDATE);
+}
+
+int concurrent_hash_table_lookup(concurrent_hash_table *ht, const char *key,
+                                 void **value) {
+  if (ht == NULL || key == NULL) {
+    return 1;
+  }
+
+  const unsigned int key_length = strlen(key);
+  const unsigned int hash_code = ht->hashfn(key, key_length);
+  table *t = atomic_load_explicit(&ht->current, memory_order_acquire);
+
+  // Old tables stay readable, follow 'next' until the key is settled.
+  while (t != NULL) {
+    long end;
+    long index = probe(t, key, key_length, hash_code, &end);
+
+    if (index != -1) {
+      void *stored =
+          atomic_load_explicit(&t->slots[index].value, memory_order_acquire);
+
+      if (stored != MOVED_VALUE) {
+        if (stored == NULL) {
+          break; // deleted
+        }
+
+        *value = stored == NULL_VALUE ? NULL : stored;
+        return 0;
+      }
+    }
+
+    t = atomic_load_explicit(&t->next, memory_order_acquire);
+  }
+
+  *value = NULL;
+  return 1;
+}
+
+int concurrent_hash_table_delete(concurrent_hash_table *ht, const char *key) {
+  if (ht == NULL || key == NULL) {
+    return 1;
+  }
+
+  return write_entry(ht, key, NULL, WRITE_DELETE);
+}
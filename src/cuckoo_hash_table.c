@@ -0,0 +1,526 @@
+#include "cuckoo_hash_table.h"
+#include "hash_table.h"
+#include "utils.h"
+
+#include <stdalign.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FALSE 0
+
+/**
+ * Slots per bucket, one bucket fills a cache line.
+ */
+#define BUCKET_SLOTS 4
+
+/**
+ * Entries that found no bucket, checked by every lookup while not empty.
+ */
+#define STASH_SIZE 8
+
+/**
+ * Entries moved by one insertion before giving up on the buckets.
+ */
+#define MAX_KICKS 256
+
+/**
+ * Growing before the buckets are this full keeps insertions short.
+ */
+#define CUCKOO_HASH_TABLE_LOAD_FACTOR 0.95
+
+typedef struct cuckoo_bucket {
+  alignas(64) unsigned int hash_codes[BUCKET_SLOTS];
+  unsigned int key_lengths[BUCKET_SLOTS];
+  char *keys[BUCKET_SLOTS]; // NULL when the slot is empty
+} cuckoo_bucket;
+
+/**
+ * An entry moving between buckets, or kept in the stash.
+ */
+typedef struct cuckoo_entry {
+  char *key;
+  void *value;
+  unsigned int hash_code;
+  unsigned int key_length;
+} cuckoo_entry;
+
+struct cuckoo_hash_table {
+  cuckoo_bucket *buckets; // 'bucket_count' buckets
+  void **values;          // BUCKET_SLOTS per bucket, read only on a hit
+  arena *arena;           // memory block for allocations
+  uint64_t seed;          // passed to 'hash_table_hash64'
+  unsigned int size;         // number of entries, stash included
+  unsigned int bucket_count; // power of 2
+  unsigned int stash_size;   // entries in 'stash'
+  unsigned int kicks;        // picks the slot evicted next
+  cuckoo_entry stash[STASH_SIZE];
+};
+
+static inline unsigned int hash(const cuckoo_hash_table *ht, const char *key,
+                                unsigned int key_length) {
+  const uint64_t hash_code = hash_table_hash64(key, key_length, ht->seed);
+
+  return (unsigned int)(hash_code ^ (hash_code >> 32));
+}
+
+static inline unsigned int first_bucket(const cuckoo_hash_table *ht,
+                                        unsigned int hash_code) {
+  return hash_code & (ht->bucket_count - 1);
+}
+
+/**
+ * Second bucket of 'hash_code', from a remix of its bits so the two buckets
+ * are independent. Never the first bucket.
+ */
+static inline unsigned int second_bucket(const cuckoo_hash_table *ht,
+                                         unsigned int hash_code) {
+  unsigned int mixed = (hash_code ^ (hash_code >> 16)) * 0x85EBCA6BU;
+  mixed ^= mixed >> 13;
+
+  const unsigned int bucket = mixed & (ht->bucket_count - 1);
+
+  return bucket == first_bucket(ht, hash_code) ? bucket ^ 1 : bucket;
+}
+
+/**
+ * The bucket an entry of 'bucket' moves to when evicted.
+ */
+static inline unsigned int other_bucket(const cuckoo_hash_table *ht,
+                                        unsigned int bucket,
+                                        unsigned int hash_code) {
+  const unsigned int first = first_bucket(ht, hash_code);
+
+  return bucket == first ? second_bucket(ht, hash_code) : first;
+}
+
+static inline uint64_t slots_size(unsigned int bucket_count) {
+  return (uint64_t)bucket_count *
+         (sizeof(cuckoo_bucket) + sizeof(void *) * BUCKET_SLOTS);
+}
+
+/**
+ * Search 'bucket' for 'key'.
+ *
+ * @return slot of the entry with 'key', -1 otherwise
+ */
+static inline int find_in_bucket(const cuckoo_bucket *bucket, const char *key,
+                                 unsigned int key_length,
+                                 unsigned int hash_code) {
+  for (int slot = 0; slot < BUCKET_SLOTS; slot++) {
+    if (bucket->hash_codes[slot] == hash_code && bucket->keys[slot] != NULL &&
+        bucket->key_lengths[slot] == key_length &&
+        memcmp(bucket->keys[slot], key, key_length) == 0) {
+      return slot;
+    }
+  }
+
+  return -1;
+}
+
+/**
+ * Retreive where the value of 'key' is stored.
+ *
+ * Reads the two buckets of 'key', and the stash when it is not empty.
+ *
+ * @param ht hash table to search.
+ * @param key identifier used to search for.
+ * @param key_length length of 'key'.
+ * @param hash_code hash code of 'key'.
+ * @param index where to store the slot index in the buckets, -1 - stash
+ *        index when the entry is in the stash.
+ * @return pointer to the value of 'key', NULL otherwise
+ */
+static void **find_entry(cuckoo_hash_table *ht, const char *key,
+                         unsigned int key_length, unsigned int hash_code,
+                         long *index) {
+  const unsigned int first = first_bucket(ht, hash_code);
+  const unsigned int second = second_bucket(ht, hash_code);
+  int slot;
+
+  __builtin_prefetch(&ht->buckets[second]);
+
+  if ((slot = find_in_bucket(&ht->buckets[first], key, key_length,
+                             hash_code)) != -1) {
+    *index = (long)first * BUCKET_SLOTS + slot;
+    return &ht->values[*index];
+  }
+
+  if ((slot = find_in_bucket(&ht->buckets[second], key, key_length,
+                             hash_code)) != -1) {
+    *index = (long)second * BUCKET_SLOTS + slot;
+    return &ht->values[*index];
+  }
+
+  for (unsigned int i = 0; i < ht->stash_size; i++) {
+    const cuckoo_entry *entry = &ht->stash[i];
+
+    if (entry->hash_code == hash_code && entry->key_length == key_length &&
+        memcmp(entry->key, key, key_length) == 0) {
+      *index = -1 - (long)i;
+      return &ht->stash[i].value;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Store 'entry' in a free slot of 'bucket'.
+ *
+ * @return 0 on success, 1 when the bucket is full
+ */
+static int put_in_bucket(cuckoo_hash_table *ht, unsigned int bucket,
+                         const cuckoo_entry *entry) {
+  cuckoo_bucket *b = &ht->buckets[bucket];
+
+  for (int slot = 0; slot < BUCKET_SLOTS; slot++) {
+    if (b->keys[slot] == NULL) {
+      b->keys[slot] = entry->key;
+      b->hash_codes[slot] = entry->hash_code;
+      b->key_lengths[slot] = entry->key_length;
+      ht->values[(uint64_t)bucket * BUCKET_SLOTS + slot] = entry->value;
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/**
+ * Place a new entry, moving others to their second bucket until one lands
+ * in a free slot, or in the stash.
+ *
+ * @param ht hash table to modify.
+ * @param entry entry to place, on failure the entry left without a slot,
+ *        which may be another one.
+ * @return 0 on success, 1 when the table has to grow
+ */
+static int place_entry(cuckoo_hash_table *ht, cuckoo_entry *entry) {
+  unsigned int bucket = first_bucket(ht, entry->hash_code);
+
+  if (put_in_bucket(ht, bucket, entry) == 0 ||
+      put_in_bucket(ht, (bucket = second_bucket(ht, entry->hash_code)),
+                    entry) == 0) {
+    return 0;
+  }
+
+  // Random walk: evict a slot of the full bucket, and carry the evicted
+  // entry over to its other bucket.
+  for (unsigned int kick = 0; kick < MAX_KICKS; kick++) {
+    cuckoo_bucket *b = &ht->buckets[bucket];
+    const unsigned int slot = ht->kicks++ % BUCKET_SLOTS;
+    const uint64_t index = (uint64_t)bucket * BUCKET_SLOTS + slot;
+    const cuckoo_entry evicted = {b->keys[slot], ht->values[index],
+                                  b->hash_codes[slot], b->key_lengths[slot]};
+
+    b->keys[slot] = entry->key;
+    b->hash_codes[slot] = entry->hash_code;
+    b->key_lengths[slot] = entry->key_length;
+    ht->values[index] = entry->value;
+
+    *entry = evicted;
+    bucket = other_bucket(ht, bucket, entry->hash_code);
+
+    if (put_in_bucket(ht, bucket, entry) == 0) {
+      return 0;
+    }
+  }
+
+  if (ht->stash_size < STASH_SIZE) {
+    ht->stash[ht->stash_size++] = *entry;
+    return 0;
+  }
+
+  return 1;
+}
+
+/**
+ * Allocate empty buckets.
+ *
+ * @param ht hash table to modify.
+ * @param bucket_count number of buckets to allocate.
+ * @return 0 on success, 1 otherwise
+ */
+static int allocate_slots(cuckoo_hash_table *ht, unsigned int bucket_count) {
+  uint8_t *block = arena_alloc(ht->arena, slots_size(bucket_count),
+                               alignof(cuckoo_bucket), FALSE);
+
+  if (block == NULL) {
+    return 1;
+  }
+
+  ht->buckets = (cuckoo_bucket *)block;
+  ht->values = (void **)(block + (uint64_t)bucket_count * sizeof(cuckoo_bucket));
+  ht->bucket_count = bucket_count;
+  ht->stash_size = 0;
+
+  memset(block, 0, slots_size(bucket_count));
+
+  return 0;
+}
+
+/**
+ * Give the dropped buckets back to the arena.
+ *
+ * When the current buckets directly follow them, both are given back and
+ * the current ones slide down to the start of the dropped ones.
+ *
+ * @param ht hash table to modifiy.
+ * @param buckets the dropped buckets, followed by their values.
+ * @param bucket_count number of buckets in 'buckets'.
+ */
+static void release_slots(cuckoo_hash_table *ht, cuckoo_bucket *buckets,
+                          unsigned int bucket_count) {
+  uint8_t *block = (uint8_t *)buckets;
+  uint8_t *current = (uint8_t *)ht->buckets;
+  const uint64_t size = slots_size(bucket_count);
+  const uint64_t current_size = slots_size(ht->bucket_count);
+
+  if (block + size == current &&
+      arena_free_last(ht->arena, current, current_size) == 0) {
+    arena_free_last(ht->arena, block, size);
+    block = arena_alloc(ht->arena, current_size, alignof(cuckoo_bucket),
+                        FALSE);
+    memmove(block, current, current_size);
+
+    ht->buckets = (cuckoo_bucket *)block;
+    ht->values =
+        (void **)(block + (uint64_t)ht->bucket_count * sizeof(cuckoo_bucket));
+    return;
+  }
+
+  arena_free_last(ht->arena, block, size);
+}
+
+/**
+ * Move every entry into twice as many buckets.
+ *
+ * Placing the entries again can itself run out of room, the buckets then
+ * double again.
+ *
+ * @param ht hash table to modifiy.
+ * @return 0 on success, 1 otherwise
+ */
+static int cuckoo_hash_table_resize(cuckoo_hash_table *ht) {
+  cuckoo_bucket *old_buckets = ht->buckets;
+  void **old_values = ht->values;
+  const unsigned int old_bucket_count = ht->bucket_count;
+  cuckoo_entry old_stash[STASH_SIZE];
+  const unsigned int old_stash_size = ht->stash_size;
+  unsigned int bucket_count = old_bucket_count;
+
+  memcpy(old_stash, ht->stash, sizeof(cuckoo_entry) * old_stash_size);
+
+retry:
+  bucket_count <<= 1;
+
+  if (allocate_slots(ht, bucket_count) == 1) {
+    return 1;
+  }
+
+  for (uint64_t i = 0; i < (uint64_t)old_bucket_count * BUCKET_SLOTS; i++) {
+    const cuckoo_bucket *b = &old_buckets[i / BUCKET_SLOTS];
+    cuckoo_entry entry = {b->keys[i % BUCKET_SLOTS], old_values[i],
+                          b->hash_codes[i % BUCKET_SLOTS],
+                          b->key_lengths[i % BUCKET_SLOTS]};
+
+    if (entry.key != NULL && place_entry(ht, &entry) == 1) {
+      goto grow;
+    }
+  }
+
+  for (unsigned int i = 0; i < old_stash_size; i++) {
+    cuckoo_entry entry = old_stash[i];
+
+    if (place_entry(ht, &entry) == 1) {
+      goto grow;
+    }
+  }
+
+  release_slots(ht, old_buckets, old_bucket_count);
+
+  return 0;
+
+grow:
+  arena_free_last(ht->arena, ht->buckets, slots_size(bucket_count));
+  goto retry;
+}
+
+/**
+ *  Find the value of 'key', adding an entry when it is absent.
+ *
+ *  @param ht hash_table to modify
+ *  @param key the hash table entry key to search
+ *  @param value value of a new entry
+ *  @param is_new_key where to store whether 'key' was absent.
+ *  @return pointer to the value of 'key', NULL otherwise
+ */
+static void **handle_pre_insertion(cuckoo_hash_table *ht, const char *key,
+                                   const void *value, int *is_new_key) {
+  if (ht == NULL) {
+    return NULL;
+  }
+
+  if (ht->buckets == NULL && allocate_slots(ht, ht->bucket_count) == 1) {
+    return NULL;
+  }
+
+  const unsigned int key_length = strlen(key);
+  const unsigned int hash_code = hash(ht, key, key_length);
+  long index;
+  void **slot = find_entry(ht, key, key_length, hash_code, &index);
+
+  if (slot != NULL) {
+    *is_new_key = 0;
+    return slot;
+  }
+
+  if (ht->size + 1 > (uint64_t)ht->bucket_count * BUCKET_SLOTS *
+                         CUCKOO_HASH_TABLE_LOAD_FACTOR &&
+      cuckoo_hash_table_resize(ht) == 1) {
+    return NULL;
+  }
+
+  char *copy = arena_alloc(ht->arena, key_length + 1, alignof(char), FALSE);
+
+  if (copy == NULL) {
+    return NULL;
+  }
+
+  memcpy(copy, key, key_length + 1);
+
+  cuckoo_entry entry = {copy, (void *)value, hash_code, key_length};
+
+  // What is left without a slot may be another entry, place it after growing.
+  while (place_entry(ht, &entry) == 1) {
+    if (cuckoo_hash_table_resize(ht) == 1) {
+      return NULL;
+    }
+  }
+
+  ht->size++;
+  *is_new_key = 1;
+
+  // The new entry may have been moved since, look it up again.
+  return find_entry(ht, copy, key_length, hash_code, &index);
+}
+
+int cuckoo_hash_table_create(cuckoo_hash_table **ht,
+                             unsigned int initial_capacity, arena *arena) {
+  ASSERT(arena != NULL, "arena MUST be provided");
+
+  if ((*ht = arena_alloc(arena, sizeof(cuckoo_hash_table),
+                         alignof(cuckoo_hash_table), FALSE)) == NULL) {
+    return 1;
+  }
+
+  // At least 2 buckets, so the two buckets of a key always differ.
+  const unsigned int bucket_count =
+      ROUND_POW2((initial_capacity + BUCKET_SLOTS - 1) / BUCKET_SLOTS);
+
+  (*ht)->bucket_count = bucket_count < 2 ? 2 : bucket_count;
+  (*ht)->arena = arena;
+  (*ht)->seed = (uint64_t)(uintptr_t)*ht * 0x9E3779B97F4A7C15ULL;
+  (*ht)->buckets = NULL;
+  (*ht)->values = NULL;
+  (*ht)->size = 0;
+  (*ht)->stash_size = 0;
+  (*ht)->kicks = 0;
+
+  return 0;
+}
+
+int cuckoo_hash_table_size(cuckoo_hash_table *ht) {
+  if (ht == NULL) {
+    return -1;
+  }
+
+  return ht->size;
+}
+
+int cuckoo_hash_table_insert(cuckoo_hash_table *ht, const char *key,
+                             const void *value) {
+  int is_new_key;
+
+  if (handle_pre_insertion(ht, key, value, &is_new_key) == NULL ||
+      !is_new_key) {
+    return 1;
+  }
+
+  return 0;
+}
+
+int cuckoo_hash_table_insert_or_update(cuckoo_hash_table *ht, const char *key,
+                                       const void *value) {
+  int is_new_key;
+  void **slot = handle_pre_insertion(ht, key, value, &is_new_key);
+
+  if (slot == NULL) {
+    return 1;
+  }
+
+  *slot = (void *)value;
+
+  return 0;
+}
+
+int cuckoo_hash_table_lookup(cuckoo_hash_table *ht, const char *key,
+                             void **value) {
+  if (ht == NULL || ht->size == 0) {
+    return 1;
+  }
+
+  const unsigned int key_length = strlen(key);
+  long index;
+  void **slot =
+      find_entry(ht, key, key_length, hash(ht, key, key_length), &index);
+
+  if (slot == NULL) {
+    return 1;
+  }
+
+  *value = *slot;
+
+  return 0;
+}
+
+int cuckoo_hash_table_delete(cuckoo_hash_table *ht, const char *key) {
+  if (ht == NULL || ht->size == 0) {
+    return 1;
+  }
+
+  const unsigned int key_length = strlen(key);
+  long index;
+
+  if (find_entry(ht, key, key_length, hash(ht, key, key_length), &index) ==
+      NULL) {
+    return 1;
+  }
+
+  // No tombstones, no probe sequence goes past a slot.
+  if (index >= 0) {
+    ht->buckets[index / BUCKET_SLOTS].keys[index % BUCKET_SLOTS] = NULL;
+    ht->values[index] = NULL;
+  } else {
+    ht->stash[-1 - index] = ht->stash[--ht->stash_size];
+  }
+
+  ht->size--;
+
+  return 0;
+}
+
+int cuckoo_hash_table_memory(cuckoo_hash_table *ht, uint64_t *bytes) {
+  if (ht == NULL) {
+    *bytes = 0;
+    return 1;
+  }
+
+  *bytes = sizeof(cuckoo_hash_table);
+
+  if (ht->buckets != NULL) {
+    *bytes += slots_size(ht->bucket_count);
+  }
+
+  return 0;
+}
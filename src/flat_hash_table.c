@@ -0,0 +1,501 @@
+#include "flat_hash_table.h"
+#include "hash_group.h"
+#include "hash_table.h"
+#include "utils.h"
+
+#include <stdalign.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FLAT_HASH_TABLE_LOAD_FACTOR 0.875
+
+/**
+ * Below this load, reaching FLAT_HASH_TABLE_LOAD_FACTOR is mostly tombstones
+ * and rehashing at the same capacity frees enough room(25/32).
+ */
+#define FLAT_HASH_TABLE_PURGE_LOAD_FACTOR 0.78125
+#define FALSE 0
+
+/**
+ * Keys shorter than this are stored inside the entry, '\0' included.
+ */
+#define INLINE_KEY_SIZE 16
+
+/**
+ * Entry header, the 'data_size' bytes of the value follow it.
+ */
+struct flat_hash_table_entry {
+  unsigned int hash_code;  // hash of 'key', reused on resize
+  unsigned int key_length; // length of 'key' excluding '\0'
+  union {
+    char *pointer;                    // key_length >= INLINE_KEY_SIZE
+    char inline_key[INLINE_KEY_SIZE]; // key_length < INLINE_KEY_SIZE
+  } key;
+};
+
+#define ENTRY_KEY(entry)                                                       \
+  ((entry)->key_length < INLINE_KEY_SIZE ? (entry)->key.inline_key            \
+                                         : (entry)->key.pointer)
+
+#define ENTRY_VALUE(entry) ((void *)((entry) + 1))
+
+struct flat_hash_table {
+  uint8_t *entries;         // 'capacity' entries of 'stride' bytes
+  int8_t *ctrl;             // one tag per entry
+  arena *arena;             // memory block for allocations
+  uint64_t seed;            // passed to 'hash_table_hash64'
+  unsigned int data_size;   // bytes of every value
+  unsigned int stride;      // bytes of every entry, value included
+  unsigned int size;        // number of entries
+  unsigned int tombstones;  // number of deleted entries
+  unsigned int capacity;    // number of buckets
+};
+
+struct flat_hash_table_iterator {
+  uint8_t *entries;
+  int8_t *ctrl;
+  unsigned int stride;
+  unsigned int capacity;
+  unsigned int index; // current index
+};
+
+static inline flat_hash_table_entry *entry_at(uint8_t *entries,
+                                              unsigned int stride,
+                                              unsigned int index) {
+  return (flat_hash_table_entry *)(entries + (uint64_t)index * stride);
+}
+
+static inline unsigned int hash(const flat_hash_table *ht, const char *key,
+                                unsigned int key_length) {
+  const uint64_t hash_code = hash_table_hash64(key, key_length, ht->seed);
+
+  return (unsigned int)(hash_code ^ (hash_code >> 32));
+}
+
+/**
+ * Retreive the index of a hash table entry.
+ *
+ * @param ht hash table to search.
+ * @param key identifier used to search for.
+ * @param key_length length of 'key'.
+ * @param hash_code hash code of 'key'.
+ * @param free_index where to store the first empty/deleted index on the probe
+ *        sequence, can be NULL.
+ * @return index of the entry with 'key', -1 otherwise
+ */
+static long find_entry(const flat_hash_table *ht, const char *key,
+                       unsigned int key_length, unsigned int hash_code,
+                       long *free_index) {
+  const unsigned int mask = ht->capacity - 1;
+  const int8_t tag = H2(hash_code);
+  unsigned int position = H1(hash_code) & mask;
+  unsigned int stride = 0;
+
+  if (free_index != NULL) {
+    *free_index = -1;
+  }
+
+  while (1) {
+    const int8_t *group = ht->ctrl + position;
+
+    for (uint32_t match = group_match(group, tag); match != 0;
+         match &= match - 1) {
+      const unsigned int index = (position + __builtin_ctz(match)) & mask;
+      flat_hash_table_entry *entry = entry_at(ht->entries, ht->stride, index);
+
+      if (entry->hash_code == hash_code && entry->key_length == key_length &&
+          memcmp(ENTRY_KEY(entry), key, key_length) == 0) {
+        return index;
+      }
+    }
+
+    if (free_index != NULL && *free_index == -1) {
+      uint32_t free = group_match_free(group);
+
+      if (free != 0) {
+        *free_index = (position + __builtin_ctz(free)) & mask;
+      }
+    }
+
+    if (group_match(group, CTRL_EMPTY) != 0) {
+      return -1;
+    }
+
+    stride += GROUP_WIDTH;
+    position = (position + stride) & mask;
+  }
+}
+
+static inline uint64_t slots_size(const flat_hash_table *ht,
+                                  unsigned int capacity) {
+  return (uint64_t)capacity * ht->stride + capacity + GROUP_WIDTH;
+}
+
+/**
+ * Allocate entries and control tags, with every slot marked empty.
+ *
+ * @param ht hash table to modify.
+ * @param capacity number of slots to allocate.
+ * @return 0 on success, 1 otherwise
+ */
+static int allocate_slots(flat_hash_table *ht, unsigned int capacity) {
+  const uint64_t entries_size = (uint64_t)capacity * ht->stride;
+  uint8_t *block = arena_alloc(ht->arena, slots_size(ht, capacity),
+                               alignof(flat_hash_table_entry), FALSE);
+
+  if (block == NULL) {
+    return 1;
+  }
+
+  ht->entries = block;
+  ht->ctrl = (int8_t *)(block + entries_size);
+  ht->capacity = capacity;
+  ht->tombstones = 0;
+
+  memset(ht->ctrl, (uint8_t)CTRL_EMPTY, capacity + GROUP_WIDTH);
+
+  return 0;
+}
+
+/**
+ * Give back the dropped slots when they are the last arena allocation.
+ *
+ * When the current slots directly follow them, both are given back and the
+ * current ones slide down to the start of the dropped ones.
+ *
+ * @param ht hash table to modifiy.
+ * @param entries the dropped entries, followed by their tags.
+ * @param capacity number of buckets in 'entries'.
+ */
+static void release_slots(flat_hash_table *ht, uint8_t *entries,
+                          unsigned int capacity) {
+  const uint64_t size = slots_size(ht, capacity);
+  const uint64_t current_size = slots_size(ht, ht->capacity);
+
+  if (entries + size == ht->entries &&
+      arena_free_last(ht->arena, ht->entries, current_size) == 0) {
+    arena_free_last(ht->arena, entries, size);
+    uint8_t *block = arena_alloc(ht->arena, current_size,
+                                 alignof(flat_hash_table_entry), FALSE);
+    memmove(block, ht->entries, current_size);
+
+    ht->entries = block;
+    ht->ctrl = (int8_t *)(block + (uint64_t)ht->capacity * ht->stride);
+    return;
+  }
+
+  arena_free_last(ht->arena, entries, size);
+}
+
+/**
+ * Rehash every entry into a new array, dropping the tombstones.
+ *
+ * @param ht hash table to modifiy.
+ * @param capacity the new number of buckets.
+ * @return 0 on success, 1 otherwise
+ */
+static int flat_hash_table_resize(flat_hash_table *ht, unsigned int capacity) {
+  uint8_t *old_entries = ht->entries;
+  int8_t *old_ctrl = ht->ctrl;
+  const unsigned int old_capacity = ht->capacity;
+
+  if (allocate_slots(ht, capacity) == 1) {
+    return 1;
+  }
+
+  for (unsigned int i = 0; i < old_capacity; i++) {
+    if (old_ctrl[i] < 0) {
+      continue;
+    }
+
+    flat_hash_table_entry *entry = entry_at(old_entries, ht->stride, i);
+    const unsigned int index =
+        find_free_slot(ht->ctrl, ht->capacity, entry->hash_code);
+
+    set_ctrl(ht->ctrl, ht->capacity, index, H2(entry->hash_code));
+    memcpy(entry_at(ht->entries, ht->stride, index), entry, ht->stride);
+  }
+
+  release_slots(ht, old_entries, old_capacity);
+
+  return 0;
+}
+
+/**
+ *  Find the entry for 'key', claiming a free slot when it is absent.
+ *
+ *  A new entry has its key stored, the caller copies the value.
+ *
+ *  @param ht hash_table to modify
+ *  @param key the hash table entry key to search
+ *  @param is_new_key where to store whether 'key' was absent.
+ *  @return hash table entry with 'key', NULL otherwise
+ */
+static flat_hash_table_entry *
+handle_pre_insertion(flat_hash_table *ht, const char *key, int *is_new_key) {
+  if (ht == NULL) {
+    return NULL;
+  }
+
+  if (ht->entries == NULL && allocate_slots(ht, ht->capacity) == 1) {
+    return NULL;
+  }
+
+  const unsigned int key_length = strlen(key);
+  const unsigned int hash_code = hash(ht, key, key_length);
+  long free_index;
+  long index = find_entry(ht, key, key_length, hash_code, &free_index);
+
+  if (index != -1) {
+    *is_new_key = 0;
+    return entry_at(ht->entries, ht->stride, index);
+  }
+
+  // Rehash at the same capacity when it is mostly tombstones.
+  if (ht->size + ht->tombstones + 1 >
+      ht->capacity * FLAT_HASH_TABLE_LOAD_FACTOR) {
+    const unsigned int capacity =
+        ht->size + 1 > ht->capacity * FLAT_HASH_TABLE_PURGE_LOAD_FACTOR
+            ? ht->capacity << 1
+            : ht->capacity;
+
+    if (flat_hash_table_resize(ht, capacity) == 1) {
+      return NULL;
+    }
+
+    free_index = find_free_slot(ht->ctrl, ht->capacity, hash_code);
+  }
+
+  flat_hash_table_entry *entry =
+      entry_at(ht->entries, ht->stride, free_index);
+  char *copy = entry->key.inline_key;
+
+  if (key_length >= INLINE_KEY_SIZE &&
+      (copy = arena_alloc(ht->arena, key_length + 1, alignof(char), FALSE)) ==
+          NULL) {
+    return NULL;
+  }
+
+  memcpy(copy, key, key_length);
+  copy[key_length] = '\0';
+
+  if (key_length >= INLINE_KEY_SIZE) {
+    entry->key.pointer = copy;
+  }
+
+  if (ht->ctrl[free_index] == CTRL_DELETED) {
+    ht->tombstones--;
+  }
+
+  set_ctrl(ht->ctrl, ht->capacity, free_index, H2(hash_code));
+  entry->hash_code = hash_code;
+  entry->key_length = key_length;
+  ht->size++;
+  *is_new_key = 1;
+
+  return entry;
+}
+
+int flat_hash_table_create(flat_hash_table **ht, unsigned int initial_capacity,
+                           unsigned int data_size, arena *arena) {
+  ASSERT(arena != NULL, "arena MUST be provided");
+
+  if ((*ht = arena_alloc(arena, sizeof(flat_hash_table),
+                         alignof(flat_hash_table), FALSE)) == NULL) {
+    return 1;
+  }
+
+  (*ht)->capacity = initial_capacity < GROUP_WIDTH
+                        ? GROUP_WIDTH
+                        : (unsigned int)ROUND_POW2(initial_capacity);
+  (*ht)->arena = arena;
+  (*ht)->seed = (uint64_t)(uintptr_t)*ht * 0x9E3779B97F4A7C15ULL;
+  (*ht)->data_size = data_size;
+  // Keep every entry header aligned.
+  (*ht)->stride = (sizeof(flat_hash_table_entry) + data_size +
+                   alignof(flat_hash_table_entry) - 1) &
+                  ~(alignof(flat_hash_table_entry) - 1);
+  (*ht)->size = 0;
+  (*ht)->tombstones = 0;
+  (*ht)->entries = NULL;
+  (*ht)->ctrl = NULL;
+
+  return 0;
+}
+
+int flat_hash_table_size(flat_hash_table *ht) {
+  if (ht == NULL) {
+    return -1;
+  }
+
+  return ht->size;
+}
+
+int flat_hash_table_insert(flat_hash_table *ht, const char *key,
+                           const void *value) {
+  int is_new_key;
+  flat_hash_table_entry *entry = handle_pre_insertion(ht, key, &is_new_key);
+
+  if (entry == NULL || !is_new_key) {
+    return 1;
+  }
+
+  if (ht->data_size > 0) {
+    memcpy(ENTRY_VALUE(entry), value, ht->data_size);
+  }
+
+  return 0;
+}
+
+int flat_hash_table_insert_or_update(flat_hash_table *ht, const char *key,
+                                     const void *value) {
+  int is_new_key;
+  flat_hash_table_entry *entry = handle_pre_insertion(ht, key, &is_new_key);
+
+  if (entry == NULL) {
+    return 1;
+  }
+
+  if (ht->data_size > 0) {
+    memcpy(ENTRY_VALUE(entry), value, ht->data_size);
+  }
+
+  return 0;
+}
+
+int flat_hash_table_lookup(flat_hash_table *ht, const char *key, void *value) {
+  if (ht == NULL || ht->size == 0) {
+    return 1;
+  }
+
+  const unsigned int key_length = strlen(key);
+  long index = find_entry(ht, key, key_length, hash(ht, key, key_length), NULL);
+
+  if (index == -1) {
+    return 1;
+  }
+
+  if (value != NULL) {
+    memcpy(value, ENTRY_VALUE(entry_at(ht->entries, ht->stride, index)),
+           ht->data_size);
+  }
+
+  return 0;
+}
+
+int flat_hash_table_delete(flat_hash_table *ht, const char *key) {
+  if (ht == NULL || ht->size == 0) {
+    return 1;
+  }
+
+  const unsigned int key_length = strlen(key);
+  long index = find_entry(ht, key, key_length, hash(ht, key, key_length), NULL);
+
+  if (index == -1) {
+    return 1;
+  }
+
+  // Only leave a tombstone when a probe could have passed this slot.
+  if (was_never_full(ht->ctrl, ht->capacity, index)) {
+    set_ctrl(ht->ctrl, ht->capacity, index, CTRL_EMPTY);
+  } else {
+    set_ctrl(ht->ctrl, ht->capacity, index, CTRL_DELETED);
+    ht->tombstones++;
+  }
+
+  ht->size--;
+
+  return 0;
+}
+
+int flat_hash_table_memory(flat_hash_table *ht, uint64_t *bytes) {
+  if (ht == NULL) {
+    *bytes = 0;
+    return 1;
+  }
+
+  *bytes = sizeof(flat_hash_table);
+
+  if (ht->entries != NULL) {
+    *bytes += slots_size(ht, ht->capacity);
+  }
+
+  return 0;
+}
+
+int flat_hash_table_entry_key(flat_hash_table_entry *entry, char **key) {
+  if (entry == NULL) {
+    *key = NULL;
+    return 1;
+  }
+  *key = ENTRY_KEY(entry);
+  return 0;
+}
+
+int flat_hash_table_entry_value(flat_hash_table_entry *entry, void **value) {
+  if (entry == NULL) {
+    *value = NULL;
+    return 1;
+  }
+  *value = ENTRY_VALUE(entry);
+  return 0;
+}
+
+int flat_hash_table_iterator_create(flat_hash_table_iterator **it,
+                                    flat_hash_table *ht) {
+  if (ht == NULL || ht->size == 0) {
+    return 1;
+  }
+
+  if (((*it) = arena_alloc(ht->arena, sizeof(flat_hash_table_iterator),
+                           alignof(flat_hash_table_iterator), FALSE)) ==
+      NULL) {
+    return 1;
+  }
+
+  (*it)->entries = ht->entries;
+  (*it)->ctrl = ht->ctrl;
+  (*it)->stride = ht->stride;
+  (*it)->capacity = ht->capacity;
+  (*it)->index = 0;
+
+  return 0;
+}
+
+int flat_hash_table_iterator_next(flat_hash_table_iterator *it,
+                                  flat_hash_table_entry **entry) {
+  if (it == NULL) {
+    return 1;
+  }
+
+  // Skip empty entries and tombstones a group of tags at a time.
+  while (it->index < it->capacity) {
+    const unsigned int remaining = it->capacity - it->index;
+    uint32_t full = group_match_full(it->ctrl + it->index);
+
+    // The tags past the end mirror the first group.
+    if (remaining < GROUP_WIDTH) {
+      full &= (1U << remaining) - 1;
+    }
+
+    if (full != 0) {
+      it->index += __builtin_ctz(full);
+      *entry = entry_at(it->entries, it->stride, it->index++);
+      return 0;
+    }
+
+    it->index += GROUP_WIDTH;
+  }
+
+  return 1;
+}
+
+int flat_hash_table_iterator_reset(flat_hash_table_iterator *it) {
+  if (it == NULL) {
+    return 1;
+  }
+
+  it->index = 0;
+
+  return 0;
+}
@@ -0,0 +1,374 @@
+#include "frozen_hash_table.h"
+#include "utils.h"
+
+#include <stdalign.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FALSE 0
+
+/**
+ * Average number of keys per bucket, each bucket stores one 32 bit pilot.
+ */
+#define BUCKET_LOAD 4
+
+/**
+ * Number of seeds tried before giving up on building the index.
+ */
+#define MAX_SEEDS 16
+
+typedef struct frozen_hash_table_slot {
+  const char *key;
+  void *value;
+  uint32_t key_length;
+  uint32_t fingerprint; // high half of the hash code, skips most key compares
+} frozen_hash_table_slot;
+
+struct frozen_hash_table {
+  frozen_hash_table_slot *slots; // exactly one per entry
+  uint32_t *pilots;              // displacement of every bucket
+  uint64_t seed;                 // passed to 'hash_table_hash64'
+  unsigned int size;             // number of entries
+  unsigned int buckets;          // number of pilots
+};
+
+/**
+ * Bucket of 'hash_code', from its low half.
+ */
+static inline unsigned int bucket_index(uint64_t hash_code,
+                                        unsigned int buckets) {
+  return ((uint64_t)(uint32_t)hash_code * buckets) >> 32;
+}
+
+/**
+ * Slot of 'hash_code' once its bucket is displaced by 'pilot'.
+ *
+ * The pilot is mixed with the whole hash code, so keys sharing a bucket
+ * land in unrelated slots for every pilot.
+ */
+static inline unsigned int slot_index(uint64_t hash_code, uint32_t pilot,
+                                      unsigned int size) {
+  uint64_t x = hash_code ^ (pilot * 0x9E3779B97F4A7C15ULL);
+
+  x ^= x >> 33;
+  x *= 0xFF51AFD7ED558CCDULL;
+  x ^= x >> 33;
+
+  return ((__uint128_t)x * size) >> 64;
+}
+
+/**
+ * Find a pilot for every bucket, largest buckets first.
+ *
+ * @param ft frozen hash table with 'size' and 'buckets' set.
+ * @param hash_codes hash code of every key.
+ * @param keys key indexes grouped by bucket.
+ * @param bucket_start where each bucket starts in 'keys', 'buckets' + 1.
+ * @param bucket_order bucket indexes, largest first.
+ * @param taken one byte per slot, zeroed.
+ * @param positions room for the slots of the largest bucket.
+ * @return 0 on success, 1 otherwise
+ */
+static int place_buckets(frozen_hash_table *ft, const uint64_t *hash_codes,
+                         const unsigned int *keys,
+                         const unsigned int *bucket_start,
+                         const unsigned int *bucket_order, uint8_t *taken,
+                         unsigned int *positions) {
+  // The last buckets only have a few free slots left to hit.
+  const uint64_t max_pilot = (uint64_t)ft->size * 64 + 1024 < UINT32_MAX
+                                 ? (uint64_t)ft->size * 64 + 1024
+                                 : UINT32_MAX;
+
+  for (unsigned int b = 0; b < ft->buckets; b++) {
+    const unsigned int bucket = bucket_order[b];
+    const unsigned int start = bucket_start[bucket];
+    const unsigned int count = bucket_start[bucket + 1] - start;
+    uint64_t pilot = 0;
+
+    if (count == 0) {
+      break; // sorted by size, every remaining bucket is empty
+    }
+
+    for (; pilot <= max_pilot; pilot++) {
+      unsigned int placed = 0;
+
+      for (; placed < count; placed++) {
+        const unsigned int position =
+            slot_index(hash_codes[keys[start + placed]], pilot, ft->size);
+        unsigned int j = 0;
+
+        while (j < placed && positions[j] != position) {
+          j++;
+        }
+
+        if (taken[position] || j < placed) {
+          break;
+        }
+
+        positions[placed] = position;
+      }
+
+      if (placed == count) {
+        break;
+      }
+    }
+
+    if (pilot > max_pilot) {
+      return 1;
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+      taken[positions[i]] = 1;
+    }
+
+    ft->pilots[bucket] = pilot;
+  }
+
+  return 0;
+}
+
+/**
+ * Hash every key with 'ft->seed', group the keys by bucket and place them.
+ *
+ * @param ft frozen hash table with 'size', 'buckets' and 'seed' set.
+ * @param pending entries to place, in iteration order.
+ * @param hash_codes where to store the hash code of every key.
+ * @param scratch arena for temporary arrays.
+ * @return 0 on success, 1 otherwise
+ */
+static int build(frozen_hash_table *ft, const frozen_hash_table_slot *pending,
+                 uint64_t *hash_codes, arena *scratch) {
+  const unsigned int size = ft->size;
+  const unsigned int buckets = ft->buckets;
+  unsigned int *keys, *bucket_start, *bucket_order, *positions, *by_size;
+  uint8_t *taken;
+  unsigned int max_count = 0;
+
+  if ((keys = arena_alloc(scratch, sizeof(unsigned int) * size,
+                          alignof(unsigned int), FALSE)) == NULL ||
+      (bucket_start = arena_alloc(scratch, sizeof(unsigned int) * (buckets + 1),
+                                  alignof(unsigned int), 1)) == NULL ||
+      (bucket_order = arena_alloc(scratch, sizeof(unsigned int) * buckets,
+                                  alignof(unsigned int), FALSE)) == NULL ||
+      (taken = arena_alloc(scratch, size, alignof(uint8_t), 1)) == NULL) {
+    return 1;
+  }
+
+  for (unsigned int i = 0; i < size; i++) {
+    hash_codes[i] =
+        hash_table_hash64(pending[i].key, pending[i].key_length, ft->seed);
+    bucket_start[bucket_index(hash_codes[i], buckets) + 1]++;
+  }
+
+  for (unsigned int b = 0; b < buckets; b++) {
+    if (bucket_start[b + 1] > max_count) {
+      max_count = bucket_start[b + 1];
+    }
+    bucket_start[b + 1] += bucket_start[b];
+  }
+
+  // Counting sort of the keys by bucket, 'positions' is the fill cursor
+  // before holding the slots of one bucket.
+  if ((positions = arena_alloc(
+           scratch,
+           sizeof(unsigned int) * (buckets > max_count ? buckets : max_count),
+           alignof(unsigned int), FALSE)) == NULL ||
+      (by_size = arena_alloc(scratch, sizeof(unsigned int) * (max_count + 2),
+                             alignof(unsigned int), 1)) == NULL) {
+    return 1;
+  }
+
+  memcpy(positions, bucket_start, sizeof(unsigned int) * buckets);
+  for (unsigned int i = 0; i < size; i++) {
+    keys[positions[bucket_index(hash_codes[i], buckets)]++] = i;
+  }
+
+  // Two keys with the same hash code collide for every pilot.
+  for (unsigned int b = 0; b < buckets; b++) {
+    for (unsigned int i = bucket_start[b]; i < bucket_start[b + 1]; i++) {
+      for (unsigned int j = bucket_start[b]; j < i; j++) {
+        if (hash_codes[keys[i]] == hash_codes[keys[j]]) {
+          return 1;
+        }
+      }
+    }
+  }
+
+  // Counting sort of the buckets by size, largest first.
+  for (unsigned int b = 0; b < buckets; b++) {
+    by_size[max_count - (bucket_start[b + 1] - bucket_start[b]) + 1]++;
+  }
+  for (unsigned int s = 0; s <= max_count; s++) {
+    by_size[s + 1] += by_size[s];
+  }
+  for (unsigned int b = 0; b < buckets; b++) {
+    bucket_order[by_size[max_count - (bucket_start[b + 1] - bucket_start[b])]++] =
+        b;
+  }
+
+  return place_buckets(ft, hash_codes, keys, bucket_start, bucket_order, taken,
+                       positions);
+}
+
+int hash_table_freeze(hash_table *ht, frozen_hash_table **frozen,
+                      arena *arena) {
+  ASSERT(arena != NULL, "arena MUST be provided");
+
+  hash_table_iterator *it = NULL;
+  hash_table_entry *entry;
+  uint64_t key_bytes = 0;
+
+  // There is no iterator over an empty hash table.
+  if (ht == NULL ||
+      (hash_table_size(ht) > 0 && hash_table_iterator_create(&it, ht) == 1)) {
+    return 1;
+  }
+
+  if ((*frozen = arena_alloc(arena, sizeof(frozen_hash_table),
+                             alignof(frozen_hash_table), FALSE)) == NULL) {
+    return 1;
+  }
+
+  frozen_hash_table *ft = *frozen;
+  ft->size = hash_table_size(ht);
+  ft->buckets = ft->size / BUCKET_LOAD + 1;
+  ft->seed = 0;
+
+  while (it != NULL && hash_table_iterator_next(it, &entry) == 0) {
+    unsigned int key_length;
+    hash_table_entry_key_length(entry, &key_length);
+    key_bytes += key_length + 1;
+  }
+
+  char *key_data = NULL;
+
+  if ((ft->pilots = arena_alloc(arena, sizeof(uint32_t) * ft->buckets,
+                                alignof(uint32_t), 1)) == NULL ||
+      (ft->size > 0 &&
+       ((ft->slots = arena_alloc(arena,
+                                 sizeof(frozen_hash_table_slot) * ft->size,
+                                 alignof(frozen_hash_table_slot), FALSE)) ==
+            NULL ||
+        (key_data = arena_alloc(arena, key_bytes, alignof(char), FALSE)) ==
+            NULL))) {
+    return 1;
+  }
+
+  if (ft->size == 0) {
+    return 0;
+  }
+
+  // Everything below is only needed while building.
+  const int scratch = arena_start_scratch_arena(arena) == 0;
+  frozen_hash_table_slot *pending;
+  uint64_t *hash_codes;
+  int result = 1;
+
+  if ((pending = arena_alloc(arena, sizeof(frozen_hash_table_slot) * ft->size,
+                             alignof(frozen_hash_table_slot), FALSE)) ==
+          NULL ||
+      (hash_codes = arena_alloc(arena, sizeof(uint64_t) * ft->size,
+                                alignof(uint64_t), FALSE)) == NULL) {
+    goto exit;
+  }
+
+  hash_table_iterator_reset(it);
+  for (unsigned int i = 0; hash_table_iterator_next(it, &entry) == 0; i++) {
+    char *key;
+    hash_table_entry_key(entry, &key);
+    hash_table_entry_key_length(entry, &pending[i].key_length);
+    hash_table_entry_value(entry, &pending[i].value);
+
+    memcpy(key_data, key, pending[i].key_length);
+    key_data[pending[i].key_length] = '\0';
+    pending[i].key = key_data;
+    key_data += pending[i].key_length + 1;
+  }
+
+  for (unsigned int attempt = 0; attempt < MAX_SEEDS; attempt++) {
+    ft->seed = (attempt + 1) * 0x9E3779B97F4A7C15ULL;
+
+    if (build(ft, pending, hash_codes, arena) == 0) {
+      result = 0;
+      break;
+    }
+  }
+
+  if (result == 0) {
+    for (unsigned int i = 0; i < ft->size; i++) {
+      const uint32_t pilot = ft->pilots[bucket_index(hash_codes[i], ft->buckets)];
+      frozen_hash_table_slot *slot =
+          &ft->slots[slot_index(hash_codes[i], pilot, ft->size)];
+
+      *slot = pending[i];
+      slot->fingerprint = hash_codes[i] >> 32;
+    }
+  }
+
+exit:
+  if (scratch) {
+    arena_end_scratch_arena(arena);
+  }
+
+  return result;
+}
+
+int frozen_hash_table_size(frozen_hash_table *ft) {
+  if (ft == NULL) {
+    return -1;
+  }
+
+  return ft->size;
+}
+
+int frozen_hash_table_lookup(frozen_hash_table *ft, const char *key,
+                             void **value) {
+  return frozen_hash_table_lookup_n(ft, key, strlen(key), value);
+}
+
+int frozen_hash_table_lookup_n(frozen_hash_table *ft, const char *key,
+                               unsigned int key_length, void **value) {
+  if (ft == NULL || ft->size == 0) {
+    return 1;
+  }
+
+  const uint64_t hash_code = hash_table_hash64(key, key_length, ft->seed);
+  const uint32_t pilot = ft->pilots[bucket_index(hash_code, ft->buckets)];
+  const frozen_hash_table_slot *slot =
+      &ft->slots[slot_index(hash_code, pilot, ft->size)];
+
+  // A missing key still maps to some slot, the key decides.
+  if (slot->fingerprint != (uint32_t)(hash_code >> 32) ||
+      slot->key_length != key_length ||
+      memcmp(slot->key, key, key_length) != 0) {
+    *value = NULL;
+    return 1;
+  }
+
+  *value = slot->value;
+
+  return 0;
+}
+
+int frozen_hash_table_lookup_view(frozen_hash_table *ft,
+                                  const string_view *key, void **value) {
+  if (key == NULL) {
+    return 1;
+  }
+
+  return frozen_hash_table_lookup_n(ft, string_view_data(key),
+                                    string_view_size(key), value);
+}
+
+int frozen_hash_table_memory(frozen_hash_table *ft, uint64_t *bytes) {
+  if (ft == NULL) {
+    *bytes = 0;
+    return 1;
+  }
+
+  *bytes = sizeof(frozen_hash_table) +
+           sizeof(frozen_hash_table_slot) * (uint64_t)ft->size +
+           sizeof(uint32_t) * (uint64_t)ft->buckets;
+
+  return 0;
+}
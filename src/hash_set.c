@@ -0,0 +1,71 @@
+#include "hash_set.h"
+#include "flat_hash_table.h"
+#include "utils.h"
+
+#include <stdalign.h>
+#include <stdio.h>
+
+#define FALSE 0
+
+struct hash_set {
+  flat_hash_table *keys; // values of 0 bytes
+};
+
+int hash_set_create(hash_set **set, unsigned int initial_capacity,
+                    arena *arena) {
+  ASSERT(arena != NULL, "arena MUST be provided");
+
+  if ((*set = arena_alloc(arena, sizeof(hash_set), alignof(hash_set),
+                          FALSE)) == NULL) {
+    return 1;
+  }
+
+  return flat_hash_table_create(&(*set)->keys, initial_capacity, 0, arena);
+}
+
+int hash_set_size(hash_set *set) {
+  if (set == NULL) {
+    return -1;
+  }
+
+  return flat_hash_table_size(set->keys);
+}
+
+int hash_set_add(hash_set *set, const char *key) {
+  if (set == NULL) {
+    return 1;
+  }
+
+  return flat_hash_table_insert(set->keys, key, NULL);
+}
+
+int hash_set_contains(hash_set *set, const char *key) {
+  if (set == NULL) {
+    return 1;
+  }
+
+  return flat_hash_table_lookup(set->keys, key, NULL);
+}
+
+int hash_set_remove(hash_set *set, const char *key) {
+  if (set == NULL) {
+    return 1;
+  }
+
+  return flat_hash_table_delete(set->keys, key);
+}
+
+int hash_set_memory(hash_set *set, uint64_t *bytes) {
+  if (set == NULL) {
+    *bytes = 0;
+    return 1;
+  }
+
+  if (flat_hash_table_memory(set->keys, bytes) == 1) {
+    return 1;
+  }
+
+  *bytes += sizeof(hash_set);
+
+  return 0;
+}
@@ -1,237 +1,1495 @@
 #include "hash_table.h"
+#include "hash_group.h"
 #include "utils.h"
 
+#include <pthread.h>
 #include <stdalign.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
-#define HASH_TABLE_LOAD_FACTOR 0.75
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#define HASH_TABLE_LOAD_FACTOR 0.875
+
+/**
+ * Below this load, reaching HASH_TABLE_LOAD_FACTOR is mostly tombstones and
+ * dropping them frees enough room without doubling(25/32).
+ */
+#define HASH_TABLE_PURGE_LOAD_FACTOR 0.78125
 #define FALSE 0
 
-struct hash_table_entry {
-  char *key;
-  void *value;
-};
+/**
+ * Number of old slots moved by each operation during an incremental resize.
+ */
+#define MIGRATE_SLOTS 32
+
+/**
+ * Number of keys hashed and prefetched ahead of resolving them in the batch
+ * operations.
+ */
+#define BATCH_SIZE 16
+
+/**
+ * Most threads 'hash_table_bulk_load' starts, and the number of keys below
+ * which it inserts them in the calling thread instead.
+ */
+#define BULK_LOAD_MAX_THREADS 64
+#define BULK_LOAD_MIN_KEYS 65536
+
+/**
+ * Smallest slot region 'hash_table_bulk_load' gives a thread, so that few
+ * probes cross into the next region.
+ */
+#define BULK_LOAD_MIN_REGION 1024
+
+/**
+ * Keys shorter than this are stored inside the entry, '\0' included.
+ */
+#define INLINE_KEY_SIZE 24
+
+struct hash_table_entry {
+  union {
+    char *pointer;                   // key_length >= INLINE_KEY_SIZE
+    char inline_key[INLINE_KEY_SIZE]; // key_length < INLINE_KEY_SIZE
+  } key;
+  void *value;
+  uint64_t hash_code;      // full hash of 'key', reused on resize
+  unsigned int key_length; // length of 'key' excluding '\0'
+};
+
+/**
+ * Where the key of 'entry' is stored.
+ */
+#define ENTRY_KEY(entry)                                                       \
+  ((entry)->key_length < INLINE_KEY_SIZE ? (entry)->key.inline_key            \
+                                         : (entry)->key.pointer)
+
+struct hash_table {
+  hash_table_entry *entries;                          // array of entries
+  int8_t *ctrl;                                       // one tag per entry
+  unsigned int (*hashfn)(const char *, unsigned int); // 32 bit hash, or NULL
+  uint64_t (*hashfn64)(const char *, unsigned int, uint64_t); // 64 bit hash
+  uint64_t seed;            // passed to 'hashfn64'
+  arena *arena;             // memory block for allocations
+  unsigned int flags;       // HASH_TABLE_* creation flags
+  unsigned int size;        // number of entries
+  unsigned int tombstones;  // number of deleted entries
+  unsigned int capacity;    // number of buckets
+
+  // Incremental resize, 'old_entries' is NULL unless a migration is running.
+  hash_table_entry *old_entries; // entries not migrated yet
+  int8_t *old_ctrl;              // tags of 'old_entries'
+  unsigned int old_capacity;     // number of buckets in 'old_entries'
+  unsigned int migrate_index;    // next old bucket to migrate
+
+  uint64_t reclaimable; // bytes of dropped entry arrays left in the arena
+
+  // 'hash_table_clear' only bumps 'generation'. A group of GROUP_WIDTH slots
+  // whose generation differs is empty, its tags are reset on the next write.
+  uint8_t *generations; // one per group, NULL when every tag is current
+  uint8_t generation;   // generation of the groups written since the clear
+};
+
+/**
+ * Shared state of 'hash_table_bulk_load'.
+ *
+ * Slice 's' of the keys is hashed and partitioned by thread 's'. The slots
+ * are split into 'regions' aligned regions, a key belongs to the region of
+ * its home slot and every region is filled by a single thread.
+ */
+typedef struct bulk_load {
+  hash_table *ht;
+  const char *const *keys;
+  void *const *values;
+  unsigned int n;
+  unsigned int threads;
+  unsigned int regions;      // power of 2
+  unsigned int region_shift; // log2 of the slots per region
+  uint64_t *hash_codes;      // hash code of every key
+  unsigned int *partition;   // key indexes grouped by region
+  unsigned int *cursors;     // threads x regions, partition write positions
+  uint64_t *key_bytes;       // threads x regions, bytes of long key copies
+  unsigned int *region_end;  // end of every region in 'partition'
+  unsigned int *deferred;    // keys left for the calling thread, per region
+  unsigned int *inserted;    // keys inserted per region
+  unsigned int *reused;      // tombstones reused per region
+  char **key_data;           // where every region copies its long keys
+  uint64_t slice_bytes[BULK_LOAD_MAX_THREADS]; // long key bytes per slice
+  int existed[BULK_LOAD_MAX_THREADS];          // a key was already present
+} bulk_load;
+
+typedef struct bulk_load_thread {
+  bulk_load *load;
+  unsigned int id;
+  void (*phase)(bulk_load *, unsigned int);
+} bulk_load_thread;
+
+struct hash_table_iterator {
+  hash_table_entry *entries;
+  int8_t *ctrl;
+  unsigned int size;
+  unsigned int capacity;
+  unsigned int begin; // first slot of the range
+  unsigned int end;   // one past the last slot of the range
+  unsigned int index; // current index
+};
+
+// wyhash secrets, odd 64 bit constants with 32 bits set.
+#define WYP0 0xa0761d6478bd642fULL
+#define WYP1 0xe7037ed1a0b428dbULL
+#define WYP2 0x8ebc6af09c88c6e3ULL
+#define WYP3 0x589965cc75374cc3ULL
+
+static inline uint64_t read64(const char *p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static inline uint64_t read32(const char *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+/**
+ * Multiply into 128 bits and fold the halves.
+ */
+static inline uint64_t mix(uint64_t a, uint64_t b) {
+  const __uint128_t product = (__uint128_t)a * b;
+
+  return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+uint64_t hash_table_hash64(const char *key, unsigned int length,
+                           uint64_t seed) {
+  const char *p = key;
+  uint64_t a, b;
+
+  seed ^= mix(seed ^ WYP0, WYP1);
+
+  if (length <= 16) {
+    if (length >= 4) {
+      // two overlapping reads cover 4..16 bytes without a loop
+      const unsigned int middle = (length >> 3) << 2;
+      a = (read32(p) << 32) | read32(p + middle);
+      b = (read32(p + length - 4) << 32) | read32(p + length - 4 - middle);
+    } else if (length > 0) {
+      a = ((uint64_t)(uint8_t)p[0] << 16) |
+          ((uint64_t)(uint8_t)p[length >> 1] << 8) | (uint8_t)p[length - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    unsigned int i = length;
+
+    if (i > 48) {
+      // three independent lanes of 16 bytes keep the multipliers busy
+      uint64_t lane1 = seed, lane2 = seed;
+
+      do {
+        seed = mix(read64(p) ^ WYP1, read64(p + 8) ^ seed);
+        lane1 = mix(read64(p + 16) ^ WYP2, read64(p + 24) ^ lane1);
+        lane2 = mix(read64(p + 32) ^ WYP3, read64(p + 40) ^ lane2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+
+      seed ^= lane1 ^ lane2;
+    }
+
+    while (i > 16) {
+      seed = mix(read64(p) ^ WYP1, read64(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+
+    a = read64(p + i - 16);
+    b = read64(p + i - 8);
+  }
+
+  const __uint128_t product = (__uint128_t)(a ^ WYP1) * (b ^ seed);
+
+  return mix((uint64_t)product ^ WYP0 ^ length,
+             (uint64_t)(product >> 64) ^ WYP1);
+}
+
+#if defined(__x86_64__)
+/**
+ * CRC32C of 'key' on two lanes, 16 bytes per step.
+ */
+__attribute__((target("sse4.2"))) static uint64_t
+hash_crc32c_sse42(const char *key, unsigned int length, uint64_t seed) {
+  uint64_t low = (uint32_t)seed;
+  uint64_t high = seed >> 32;
+  unsigned int i = 0;
+
+  for (; i + 16 <= length; i += 16) {
+    low = _mm_crc32_u64(low, read64(key + i));
+    high = _mm_crc32_u64(high, read64(key + i + 8));
+  }
+
+  if (i + 8 <= length) {
+    low = _mm_crc32_u64(low, read64(key + i));
+    i += 8;
+  }
+
+  if (i < length) {
+    uint64_t tail = 0;
+    memcpy(&tail, key + i, length - i);
+    high = _mm_crc32_u64(high, tail);
+  }
+
+  // CRC is linear, finish with a multiply so every output bit depends on
+  // every input bit. Keys whose CRCs collide still collide, for any seed.
+  return mix(((low << 32) | high) ^ WYP0, length ^ WYP1);
+}
+#endif
+
+uint64_t hash_table_hash_crc32c(const char *key, unsigned int length,
+                                uint64_t seed) {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("sse4.2")) {
+    return hash_crc32c_sse42(key, length, seed);
+  }
+#endif
+
+  return hash_table_hash64(key, length, seed);
+}
+
+/**
+ * Hash 'key' with the hash function of 'ht'.
+ *
+ * The probe start(H1) takes the bits above the tag, a 32 bit hash alone
+ * would leave only 25 of them. It is spread over 64 bits by an odd multiply,
+ * which keeps distinct hashes distinct.
+ */
+static inline uint64_t hash_key(const hash_table *ht, const char *key,
+                                unsigned int key_length) {
+  if (ht->hashfn != NULL) {
+    return ht->hashfn(key, key_length) * WYP0;
+  }
+
+  return ht->hashfn64(key, key_length, ht->seed);
+}
+
+/**
+ * Pick a different seed for every hash table.
+ *
+ * Mixes a global counter with the address of the table, which ASLR already
+ * randomizes between runs.
+ */
+static uint64_t next_seed(const hash_table *ht) {
+  static uint64_t counter = 0;
+  const uint64_t count =
+      __atomic_add_fetch(&counter, 0x9E3779B97F4A7C15ULL, __ATOMIC_RELAXED);
+
+  return mix(count ^ (uint64_t)(uintptr_t)ht, WYP2);
+}
+
+/**
+ * Bitmask of the slots in the group at 'position' that were written since the
+ * last clear, the others are empty whatever their tag.
+ *
+ * The group may start in the middle of a generation group and end in the
+ * next one.
+ */
+static inline uint32_t group_match_current(const uint8_t *generations,
+                                           uint8_t generation,
+                                           unsigned int capacity,
+                                           unsigned int position) {
+  const unsigned int group = position / GROUP_WIDTH;
+  const unsigned int shift = position % GROUP_WIDTH;
+  const uint32_t first = generations[group] == generation ? 0xFFFF : 0;
+  const uint32_t second =
+      generations[(group + 1) & (capacity / GROUP_WIDTH - 1)] == generation
+          ? 0xFFFF
+          : 0;
+
+  return ((first >> shift) | (second << (GROUP_WIDTH - shift))) & 0xFFFF;
+}
+
+/**
+ * Retreive the index of a hash table entry.
+ *
+ * Probes GROUP_WIDTH tags at a time, only comparing keys when the 7 bit tag
+ * matches. Used in search/insert/delete operations.
+ *
+ * @param entries array of hash table entries.
+ * @param ctrl control tags of 'entries'.
+ * @param generations generation of every group of 'ctrl', can be NULL.
+ * @param generation current generation.
+ * @param capacity max number of entries the hash table can hold at this time.
+ * @param key identifier used to search for.
+ * @param key_length length of 'key'.
+ * @param hash_code hash code of 'key'.
+ * @param free_index where to store the first empty/deleted index on the probe
+ *        sequence, can be NULL.
+ * @return index of the entry with 'key', -1 otherwise
+ */
+static long find_entry(const hash_table_entry *entries, const int8_t *ctrl,
+                       const uint8_t *generations, uint8_t generation,
+                       unsigned int capacity, const char *key,
+                       unsigned int key_length, uint64_t hash_code,
+                       long *free_index) {
+  const unsigned int mask = capacity - 1;
+  const int8_t tag = H2(hash_code);
+  unsigned int position = H1(hash_code) & mask;
+  unsigned int stride = 0;
+
+  if (free_index != NULL) {
+    *free_index = -1;
+  }
+
+  while (1) {
+    const int8_t *group = ctrl + position;
+    const uint32_t stale =
+        generations == NULL
+            ? 0
+            : ~group_match_current(generations, generation, capacity,
+                                   position) &
+                  0xFFFF;
+
+    for (uint32_t match = group_match(group, tag) & ~stale; match != 0;
+         match &= match - 1) {
+      const unsigned int index = (position + __builtin_ctz(match)) & mask;
+      const hash_table_entry *entry = &entries[index];
+
+      // Only touch the key memory when the stored hash and length agree.
+      if (entry->hash_code == hash_code && entry->key_length == key_length &&
+          memcmp(ENTRY_KEY(entry), key, key_length) == 0) {
+        return index; // found collision
+      }
+    }
+
+    if (free_index != NULL && *free_index == -1) {
+      uint32_t free = group_match_free(group) | stale;
+
+      if (free != 0) {
+        *free_index = (position + __builtin_ctz(free)) & mask;
+      }
+    }
+
+    // An empty slot ends every probe sequence that passes through this group.
+    if ((group_match(group, CTRL_EMPTY) | stale) != 0) {
+      return -1;
+    }
+
+    // triangular probing visits every group when capacity is a power of 2
+    stride += GROUP_WIDTH;
+    position = (position + stride) & mask;
+  }
+}
+
+/**
+ * Size of the arena block holding 'capacity' entries and their tags.
+ */
+static inline uint64_t slots_size(unsigned int capacity) {
+  return (uint64_t)capacity * sizeof(hash_table_entry) + capacity +
+         GROUP_WIDTH;
+}
+
+/**
+ * Allocate entries and control tags, with every slot marked empty.
+ *
+ * Both arrays share one arena block, the tags follow the entries.
+ *
+ * @param ht hash table to modify.
+ * @param capacity number of slots to allocate.
+ * @return 0 on success, 1 otherwise
+ */
+static int allocate_slots(hash_table *ht, unsigned int capacity) {
+  const uint64_t entries_size = (uint64_t)capacity * sizeof(hash_table_entry);
+  uint8_t *block = arena_alloc(ht->arena, slots_size(capacity),
+                               alignof(hash_table_entry), FALSE);
+
+  if (block == NULL) {
+    return 1;
+  }
+
+  ht->entries = (hash_table_entry *)block;
+  ht->ctrl = (int8_t *)(block + entries_size);
+  ht->capacity = capacity;
+  ht->tombstones = 0;
+
+  // Only the tags need initializing, entries are written on insertion.
+  memset(ht->ctrl, (uint8_t)CTRL_EMPTY, capacity + GROUP_WIDTH);
+
+  return 0;
+}
+
+/**
+ * Give an entries array that is no longer used back to the arena.
+ *
+ * Only the most recent allocation can be given back. When the current
+ * array was allocated right after the dropped one, it slides down over it
+ * first, unless resizes are incremental, where copying the whole array
+ * would defeat the point. What cannot be given back is counted as
+ * reclaimable.
+ *
+ * @param ht hash table that dropped the array.
+ * @param entries the dropped entries, followed by their tags.
+ * @param capacity number of buckets in 'entries'.
+ */
+static void release_slots(hash_table *ht, hash_table_entry *entries,
+                          unsigned int capacity) {
+  uint8_t *block = (uint8_t *)entries;
+  uint8_t *current = (uint8_t *)ht->entries;
+  const uint64_t size = slots_size(capacity);
+  const uint64_t current_size = slots_size(ht->capacity);
+
+  if (!(ht->flags & HASH_TABLE_INCREMENTAL_RESIZE) && block + size == current &&
+      arena_free_last(ht->arena, current, current_size) == 0) {
+    // Both blocks are given back, then the current one is allocated again at
+    // the start of the dropped one, which the arena has already committed.
+    arena_free_last(ht->arena, block, size);
+    block = arena_alloc(ht->arena, current_size, alignof(hash_table_entry),
+                        FALSE);
+    memmove(block, current, current_size);
+
+    ht->entries = (hash_table_entry *)block;
+    ht->ctrl = (int8_t *)(block +
+                          (uint64_t)ht->capacity * sizeof(hash_table_entry));
+    return;
+  }
+
+  if (arena_free_last(ht->arena, block, size) == 1) {
+    ht->reclaimable += size;
+  }
+}
+
+/**
+ * Reset the tags of a group left over from before the last clear.
+ *
+ * @param ht hash table to modify.
+ * @param group index of the group of GROUP_WIDTH slots.
+ */
+static void refresh_group(hash_table *ht, unsigned int group) {
+  memset(ht->ctrl + group * GROUP_WIDTH, (uint8_t)CTRL_EMPTY, GROUP_WIDTH);
+
+  // mirrored past the end
+  if (group == 0) {
+    memset(ht->ctrl + ht->capacity, (uint8_t)CTRL_EMPTY, GROUP_WIDTH);
+  }
+
+  ht->generations[group] = ht->generation;
+}
+
+/**
+ * Reset every group left over from before the last clear, and drop the
+ * generations.
+ *
+ * Only used by operations that visit every slot anyway.
+ *
+ * @param ht hash table to modify.
+ */
+static void refresh_slots(hash_table *ht) {
+  if (ht->generations == NULL) {
+    return;
+  }
+
+  const unsigned int groups = ht->capacity / GROUP_WIDTH;
+
+  for (unsigned int i = 0; i < groups; i++) {
+    if (ht->generations[i] != ht->generation) {
+      refresh_group(ht, i);
+    }
+  }
+
+  if (arena_free_last(ht->arena, ht->generations, groups) == 1) {
+    ht->reclaimable += groups;
+  }
+
+  ht->generations = NULL;
+}
+
+/**
+ * Move a full old bucket of an incremental resize into the new entries.
+ *
+ * The old bucket is marked deleted, which keeps the probe sequences of the
+ * entries still waiting intact.
+ *
+ * @param ht hash table to modify.
+ * @param old_index full bucket of the old entries.
+ * @return index of the entry in the new entries
+ */
+static unsigned int migrate_entry(hash_table *ht, unsigned int old_index) {
+  hash_table_entry *entry = &ht->old_entries[old_index];
+  const unsigned int index =
+      find_free_slot(ht->ctrl, ht->capacity, entry->hash_code);
+
+  if (ht->ctrl[index] == CTRL_DELETED) {
+    ht->tombstones--;
+  }
+
+  set_ctrl(ht->ctrl, ht->capacity, index, H2(entry->hash_code));
+  set_ctrl(ht->old_ctrl, ht->old_capacity, old_index, CTRL_DELETED);
+  ht->entries[index] = *entry;
+
+  return index;
+}
+
+/**
+ * Move up to 'count' buckets of an incremental resize into the new entries.
+ *
+ * @param ht hash table to modify.
+ * @param count maximum number of old buckets to visit.
+ */
+static void migrate_slots(hash_table *ht, unsigned int count) {
+  if (ht->old_entries == NULL) {
+    return;
+  }
+
+  const unsigned int end = ht->old_capacity - ht->migrate_index < count
+                               ? ht->old_capacity
+                               : ht->migrate_index + count;
+
+  for (unsigned int i = ht->migrate_index; i < end; i++) {
+    if (ht->old_ctrl[i] >= 0) {
+      migrate_entry(ht, i);
+    }
+  }
+
+  ht->migrate_index = end;
+
+  if (end == ht->old_capacity) {
+    release_slots(ht, ht->old_entries, ht->old_capacity);
+    ht->old_entries = NULL;
+    ht->old_ctrl = NULL;
+  }
+}
+
+/**
+ * Rehash the entries in place, turning every tombstone back into empty.
+ *
+ * Full tags are first marked deleted, meaning "not placed yet". Each such
+ * entry then moves to the first free slot of its probe sequence, swapping
+ * with an unplaced entry when needed. No memory is allocated.
+ *
+ * @param ht hash table to modify.
+ */
+static void drop_tombstones(hash_table *ht) {
+  int8_t *ctrl = ht->ctrl;
+  const unsigned int capacity = ht->capacity;
+  const unsigned int mask = capacity - 1;
+
+  for (unsigned int i = 0; i < capacity; i++) {
+    ctrl[i] = ctrl[i] < 0 ? CTRL_EMPTY : CTRL_DELETED;
+  }
+  memcpy(ctrl + capacity, ctrl, GROUP_WIDTH);
+
+  for (unsigned int i = 0; i < capacity; i++) {
+    if (ctrl[i] != CTRL_DELETED) {
+      continue;
+    }
+
+    const uint64_t hash_code = ht->entries[i].hash_code;
+    const unsigned int start = H1(hash_code) & mask;
+    const unsigned int target = find_free_slot(ctrl, capacity, hash_code);
+
+    // Already in the first group its probe sequence can reach.
+    if (((target - start) & mask) / GROUP_WIDTH ==
+        ((i - start) & mask) / GROUP_WIDTH) {
+      set_ctrl(ctrl, capacity, i, H2(hash_code));
+      continue;
+    }
+
+    if (ctrl[target] == CTRL_EMPTY) {
+      ht->entries[target] = ht->entries[i];
+      set_ctrl(ctrl, capacity, i, CTRL_EMPTY);
+    } else {
+      // 'target' holds another unplaced entry, swap and place that one next.
+      hash_table_entry entry = ht->entries[target];
+      ht->entries[target] = ht->entries[i];
+      ht->entries[i] = entry;
+      i--;
+    }
+
+    set_ctrl(ctrl, capacity, target, H2(hash_code));
+  }
+
+  ht->tombstones = 0;
+}
+
+/**
+ * Resize the hash table after load factor has been reached/exceeded.
+ *
+ * With HASH_TABLE_INCREMENTAL_RESIZE the entries are only handed over to the
+ * new array, later operations migrate them MIGRATE_SLOTS at a time.
+ * Otherwise a resize to the same capacity drops the tombstones in place.
+ *
+ * @param ht hash table to modify.
+ * @param capacity the new number of buckets.
+ * @return 0 on success, 1 otherwise
+ */
+static int hash_table_resize(hash_table *ht, unsigned int capacity) {
+  // The previous migration has to finish before the next one starts.
+  migrate_slots(ht, ht->old_capacity);
+  refresh_slots(ht);
+
+  if (capacity == ht->capacity &&
+      !(ht->flags & HASH_TABLE_INCREMENTAL_RESIZE)) {
+    drop_tombstones(ht);
+    return 0;
+  }
+
+  hash_table_entry *old_entries = ht->entries;
+  int8_t *old_ctrl = ht->ctrl;
+  const unsigned int old_capacity = ht->capacity;
+
+  if (allocate_slots(ht, capacity) == 1) {
+    return 1;
+  }
+
+  ht->old_entries = old_entries;
+  ht->old_ctrl = old_ctrl;
+  ht->old_capacity = old_capacity;
+  ht->migrate_index = 0;
+
+  if (!(ht->flags & HASH_TABLE_INCREMENTAL_RESIZE)) {
+    migrate_slots(ht, old_capacity);
+  }
+
+  return 0;
+}
+
+/**
+ *  This function checks entries array, and checks when to resize is needed.
+ *
+ *  A new entry has its hash code and key length filled in, the caller
+ *  stores the key and value.
+ *
+ *  @param ht hash_table to modify
+ *  @param key the hash table entry key to search
+ *  @param key_length length of 'key'
+ *  @param hash_code hash code of 'key'
+ *  @param is_new_key where to store whether 'key' was absent.
+ *  @return hash table entry with 'key', empty entry otherwise
+ */
+static hash_table_entry *handle_pre_insertion(hash_table *ht, const char *key,
+                                              unsigned int key_length,
+                                              uint64_t hash_code,
+                                              int *is_new_key) {
+  if (ht->entries == NULL && allocate_slots(ht, ht->capacity) == 1) {
+    return NULL;
+  }
+
+  migrate_slots(ht, MIGRATE_SLOTS);
+
+  long free_index;
+  long index = find_entry(ht->entries, ht->ctrl, ht->generations,
+                          ht->generation, ht->capacity, key, key_length,
+                          hash_code, &free_index);
+
+  if (index != -1) {
+    *is_new_key = 0;
+    return &ht->entries[index];
+  }
+
+  // The key may still be waiting to migrate. Move it now, a later lookup
+  // migrating it would leave the caller with a stale entry.
+  if (ht->old_entries != NULL &&
+      (index = find_entry(ht->old_entries, ht->old_ctrl, NULL, 0,
+                          ht->old_capacity, key, key_length, hash_code, NULL)) != -1) {
+    *is_new_key = 0;
+    return &ht->entries[migrate_entry(ht, index)];
+  }
+
+  // Tombstones count towards the load, otherwise probing could never find an
+  // empty slot. When enough of it is tombstones, clearing them is enough.
+  // Otherwise double the capacity of the ht.
+  if (ht->size + ht->tombstones + 1 > ht->capacity * HASH_TABLE_LOAD_FACTOR) {
+    const unsigned int capacity =
+        ht->size + 1 > ht->capacity * HASH_TABLE_PURGE_LOAD_FACTOR
+            ? ht->capacity << 1
+            : ht->capacity;
+
+    if (hash_table_resize(ht, capacity) == 1) {
+      return NULL;
+    }
+
+    free_index = find_free_slot(ht->ctrl, ht->capacity, hash_code);
+  }
+
+  if (ht->generations != NULL &&
+      ht->generations[free_index / GROUP_WIDTH] != ht->generation) {
+    refresh_group(ht, free_index / GROUP_WIDTH);
+  }
+
+  if (ht->ctrl[free_index] == CTRL_DELETED) {
+    ht->tombstones--;
+  }
+
+  set_ctrl(ht->ctrl, ht->capacity, free_index, H2(hash_code));
+  ht->entries[free_index].hash_code = hash_code;
+  ht->entries[free_index].key_length = key_length;
+  ht->size++;
+  *is_new_key = 1;
+
+  return &ht->entries[free_index];
+}
+
+/**
+ * Search both entry arrays for 'key'.
+ *
+ * @param ht hash table to search.
+ * @param key identifier used to search for.
+ * @param key_length length of 'key'.
+ * @param hash_code hash code of 'key'.
+ * @return hash table entry with 'key', NULL otherwise
+ */
+static hash_table_entry *lookup_entry(hash_table *ht, const char *key,
+                                      unsigned int key_length,
+                                      uint64_t hash_code) {
+  long index = find_entry(ht->entries, ht->ctrl, ht->generations,
+                          ht->generation, ht->capacity, key, key_length,
+                          hash_code, NULL);
+
+  if (index != -1) {
+    return &ht->entries[index];
+  }
+
+  if (ht->old_entries != NULL &&
+      (index = find_entry(ht->old_entries, ht->old_ctrl, NULL, 0,
+                          ht->old_capacity, key, key_length, hash_code, NULL)) != -1) {
+    return &ht->old_entries[index];
+  }
+
+  return NULL;
+}
+
+/**
+ * Start loading the home group of 'hash_code' into the cache.
+ *
+ * @param ht hash table that will be probed.
+ * @param hash_code hash code of the key that will be probed for.
+ */
+static void prefetch_home(const hash_table *ht, uint64_t hash_code) {
+  const unsigned int position = H1(hash_code) & (ht->capacity - 1);
+
+  __builtin_prefetch(ht->ctrl + position);
+  __builtin_prefetch(ht->entries + position);
+}
+
+/**
+ * Store 'key' in a new entry.
+ *
+ * Short keys are copied inside the entry. Longer keys are copied into the
+ * arena, unless the table borrows its keys.
+ *
+ * @param ht hash table that owns the key.
+ * @param entry entry returned by handle_pre_insertion.
+ * @param key the key to store.
+ * @param key_length length of 'key'.
+ * @return 0 on success, 1 otherwise
+ */
+/**
+ * Drop the entry in slot 'index' of the current entries.
+ *
+ * A tombstone keeps probe sequences passing through this slot intact. It is
+ * only needed when a probe could have passed, otherwise go back to empty so
+ * churn does not build up tombstones.
+ *
+ * @param ht hash table to modify.
+ * @param index full slot of 'ht->entries'.
+ */
+static void remove_slot(hash_table *ht, unsigned int index) {
+  if (was_never_full(ht->ctrl, ht->capacity, index)) {
+    set_ctrl(ht->ctrl, ht->capacity, index, CTRL_EMPTY);
+  } else {
+    set_ctrl(ht->ctrl, ht->capacity, index, CTRL_DELETED);
+    ht->tombstones++;
+  }
+
+  ht->size--;
+}
+
+static int store_key(hash_table *ht, hash_table_entry *entry, const char *key,
+                     unsigned int key_length) {
+  char *copy;
+
+  if (key_length < INLINE_KEY_SIZE) {
+    copy = entry->key.inline_key;
+  } else if (ht->flags & HASH_TABLE_BORROWED_KEYS) {
+    entry->key.pointer = (char *)key;
+    return 0;
+  } else if ((copy = arena_alloc(ht->arena, sizeof(char) * (key_length + 1),
+                                 alignof(char), FALSE)) == NULL) {
+    // The slot was claimed for this key, give it back so no probe compares
+    // against an entry without a key.
+    remove_slot(ht, entry - ht->entries);
+    return 1;
+  } else {
+    entry->key.pointer = copy;
+  }
+
+  memcpy(copy, key, key_length);
+  copy[key_length] = '\0';
+
+  return 0;
+}
+
+int hash_table_create(hash_table **ht, unsigned int initial_capacity,
+                      unsigned int (*hashfn)(const char *, unsigned int),
+                      arena *arena) {
+  return hash_table_create_ex(ht, initial_capacity, hashfn, 0, arena);
+}
+
+int hash_table_create_ex(hash_table **ht, unsigned int initial_capacity,
+                         unsigned int (*hashfn)(const char *, unsigned int),
+                         unsigned int flags, arena *arena) {
+  if (hash_table_create_seeded(ht, initial_capacity, NULL, 0, flags, arena) ==
+      1) {
+    return 1;
+  }
+
+  if (hashfn != NULL) {
+    (*ht)->hashfn = hashfn;
+  } else {
+    (*ht)->seed = next_seed(*ht);
+  }
+
+  return 0;
+}
+
+int hash_table_create_seeded(hash_table **ht, unsigned int initial_capacity,
+                             uint64_t (*hashfn)(const char *, unsigned int,
+                                                uint64_t),
+                             uint64_t seed, unsigned int flags, arena *arena) {
+  ASSERT(arena != NULL, "arena MUST be provided");
+
+  if ((*ht = arena_alloc(arena, sizeof(hash_table), alignof(hash_table),
+                         FALSE)) == NULL) {
+    return 1;
+  }
+
+  // At least one full group, so probing never reads the same tag twice.
+  (*ht)->capacity = initial_capacity < GROUP_WIDTH
+                        ? GROUP_WIDTH
+                        : (unsigned int)ROUND_POW2(initial_capacity);
+  (*ht)->arena = arena;
+  (*ht)->flags = flags;
+  (*ht)->size = 0;
+  (*ht)->tombstones = 0;
+  (*ht)->hashfn = NULL;
+  (*ht)->hashfn64 = hashfn == NULL ? hash_table_hash64 : hashfn;
+  (*ht)->seed = seed;
+  (*ht)->entries = NULL;
+  (*ht)->ctrl = NULL;
+  (*ht)->old_entries = NULL;
+  (*ht)->old_ctrl = NULL;
+  (*ht)->old_capacity = 0;
+  (*ht)->migrate_index = 0;
+  (*ht)->reclaimable = 0;
+  (*ht)->generations = NULL;
+  (*ht)->generation = 0;
+
+  return 0;
+}
+
+int hash_table_insert(hash_table *ht, const char *key, const void *value) {
+  return hash_table_insert_n(ht, key, strlen(key), value);
+}
+
+int hash_table_insert_n(hash_table *ht, const char *key,
+                        unsigned int key_length, const void *value) {
+  if (ht == NULL) {
+    return 1;
+  }
+
+  int is_new_key;
+  hash_table_entry *entry = handle_pre_insertion(
+      ht, key, key_length, hash_key(ht, key, key_length), &is_new_key);
+
+  if (entry == NULL) {
+    return 1;
+  }
+
+  if (!is_new_key) {
+    return 1; // entry with key exists
+  }
+
+  if (store_key(ht, entry, key, key_length) == 1) {
+    return 1;
+  }
+
+  entry->value = (void *)value;
+
+  return 0;
+}
+
+int hash_table_insert_view(hash_table *ht, const string_view *key,
+                           const void *value) {
+  if (key == NULL) {
+    return 1;
+  }
+
+  return hash_table_insert_n(ht, string_view_data(key), string_view_size(key),
+                             value);
+}
+
+int hash_table_insert_batch(hash_table *ht, const char *const *keys,
+                            void *const *values, unsigned int n) {
+  if (ht == NULL) {
+    return 1;
+  }
+
+  // Grow once up front instead of doubling repeatedly inside the batch.
+  unsigned int capacity = ht->capacity;
+
+  while (ht->size + ht->tombstones + n > capacity * HASH_TABLE_LOAD_FACTOR) {
+    capacity <<= 1;
+  }
+
+  if (ht->entries == NULL) {
+    ht->capacity = capacity;
+  } else if (capacity != ht->capacity &&
+             hash_table_resize(ht, capacity) == 1) {
+    return 1;
+  }
+
+  if (ht->entries == NULL && allocate_slots(ht, ht->capacity) == 1) {
+    return 1;
+  }
+
+  unsigned int key_lengths[BATCH_SIZE];
+  uint64_t hash_codes[BATCH_SIZE];
+  int result = 0;
+
+  for (unsigned int start = 0; start < n; start += BATCH_SIZE) {
+    const unsigned int count = n - start < BATCH_SIZE ? n - start : BATCH_SIZE;
+    const char *const *batch = keys + start;
+
+    for (unsigned int i = 0; i < count; i++) {
+      key_lengths[i] = strlen(batch[i]);
+      hash_codes[i] = hash_key(ht, batch[i], key_lengths[i]);
+      prefetch_home(ht, hash_codes[i]);
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+      int is_new_key;
+      hash_table_entry *entry = handle_pre_insertion(
+          ht, batch[i], key_lengths[i], hash_codes[i], &is_new_key);
+
+      if (entry == NULL) {
+        return 1;
+      }
+
+      if (!is_new_key) {
+        result = 1; // entry with key exists
+        continue;
+      }
+
+      if (store_key(ht, entry, batch[i], key_lengths[i]) == 1) {
+        return 1;
+      }
+
+      entry->value = values[start + i];
+    }
+  }
+
+  return result;
+}
+
+/**
+ * Whether a key of 'key_length' bytes is copied into the arena.
+ */
+static inline int copies_key(const hash_table *ht, unsigned int key_length) {
+  return key_length >= INLINE_KEY_SIZE &&
+         !(ht->flags & HASH_TABLE_BORROWED_KEYS);
+}
+
+static inline unsigned int bulk_load_region(const bulk_load *load,
+                                            uint64_t hash_code) {
+  return (H1(hash_code) & (load->ht->capacity - 1)) >> load->region_shift;
+}
+
+/**
+ * First and one past the last key of slice 'id'.
+ */
+static inline void bulk_load_slice(const bulk_load *load, unsigned int id,
+                                   unsigned int *begin, unsigned int *end) {
+  *begin = (uint64_t)load->n * id / load->threads;
+  *end = (uint64_t)load->n * (id + 1) / load->threads;
+}
+
+/**
+ * Count the bytes of the long keys of a slice, to size the key copies.
+ */
+static void bulk_load_measure(bulk_load *load, unsigned int id) {
+  unsigned int begin, end;
+  uint64_t bytes = 0;
+
+  bulk_load_slice(load, id, &begin, &end);
+
+  for (unsigned int i = begin; i < end; i++) {
+    const unsigned int key_length = strlen(load->keys[i]);
+
+    if (copies_key(load->ht, key_length)) {
+      bytes += key_length + 1;
+    }
+  }
+
+  load->slice_bytes[id] = bytes;
+}
+
+/**
+ * Hash the keys of a slice and count them per region.
+ */
+static void bulk_load_hash(bulk_load *load, unsigned int id) {
+  unsigned int *counts = load->cursors + (uint64_t)id * load->regions;
+  uint64_t *bytes = load->key_bytes + (uint64_t)id * load->regions;
+  unsigned int begin, end;
+
+  bulk_load_slice(load, id, &begin, &end);
+
+  for (unsigned int i = begin; i < end; i++) {
+    const unsigned int key_length = strlen(load->keys[i]);
+    const uint64_t hash_code = hash_key(load->ht, load->keys[i], key_length);
+    const unsigned int region = bulk_load_region(load, hash_code);
+
+    load->hash_codes[i] = hash_code;
+    counts[region]++;
+
+    if (copies_key(load->ht, key_length)) {
+      bytes[region] += key_length + 1;
+    }
+  }
+}
+
+/**
+ * Write the keys of a slice to their region of the partition, in order.
+ */
+static void bulk_load_scatter(bulk_load *load, unsigned int id) {
+  unsigned int *cursors = load->cursors + (uint64_t)id * load->regions;
+  unsigned int begin, end;
+
+  bulk_load_slice(load, id, &begin, &end);
+
+  for (unsigned int i = begin; i < end; i++) {
+    load->partition[cursors[bulk_load_region(load, load->hash_codes[i])]++] =
+        i;
+  }
+}
+
+/**
+ * Same as store_key, with the copy taken from the block of the region.
+ */
+static inline void bulk_load_store_key(const hash_table *ht,
+                                       hash_table_entry *entry,
+                                       const char *key,
+                                       unsigned int key_length,
+                                       char **key_data) {
+  if (key_length < INLINE_KEY_SIZE) {
+    memcpy(entry->key.inline_key, key, key_length + 1);
+  } else if (ht->flags & HASH_TABLE_BORROWED_KEYS) {
+    entry->key.pointer = (char *)key;
+  } else {
+    memcpy(*key_data, key, key_length + 1);
+    entry->key.pointer = *key_data;
+    *key_data += key_length + 1;
+  }
+}
+
+/**
+ * Insert the keys of one region, only touching the tags of that region.
+ *
+ * A probe reaching a group that is not entirely inside the region stops, the
+ * key is moved to the front of the region's partition for the calling
+ * thread to insert afterwards.
+ */
+static void bulk_load_region_fill(bulk_load *load, unsigned int region,
+                                  unsigned int *existed) {
+  hash_table *ht = load->ht;
+  const unsigned int mask = ht->capacity - 1;
+  const unsigned int first_slot = region << load->region_shift;
+  const unsigned int last_slot = first_slot + (1U << load->region_shift);
+  const unsigned int begin = region == 0 ? 0 : load->region_end[region - 1];
+  unsigned int deferred = begin;
+  unsigned int inserted = 0;
+  unsigned int reused = 0;
+  char *key_data = load->key_data[region];
+
+  for (unsigned int p = begin; p < load->region_end[region]; p++) {
+    const unsigned int i = load->partition[p];
+    const char *key = load->keys[i];
+    const unsigned int key_length = strlen(key);
+    const uint64_t hash_code = load->hash_codes[i];
+    const int8_t tag = H2(hash_code);
+    unsigned int position = H1(hash_code) & mask;
+    unsigned int stride = 0;
+    long free_index = -1;
+
+    while (1) {
+      if (position < first_slot || position + GROUP_WIDTH > last_slot) {
+        load->partition[deferred++] = i;
+        goto next;
+      }
+
+      const int8_t *group = ht->ctrl + position;
+
+      for (uint32_t match = group_match(group, tag); match != 0;
+           match &= match - 1) {
+        const hash_table_entry *entry =
+            &ht->entries[position + __builtin_ctz(match)];
+
+        if (entry->hash_code == hash_code && entry->key_length == key_length &&
+            memcmp(ENTRY_KEY(entry), key, key_length) == 0) {
+          *existed = 1;
+          goto next;
+        }
+      }
+
+      if (free_index == -1) {
+        uint32_t free = group_match_free(group);
+
+        if (free != 0) {
+          free_index = position + __builtin_ctz(free);
+        }
+      }
+
+      if (group_match(group, CTRL_EMPTY) != 0) {
+        break;
+      }
+
+      stride += GROUP_WIDTH;
+      position = (position + stride) & mask;
+    }
+
+    hash_table_entry *entry = &ht->entries[free_index];
+
+    if (ht->ctrl[free_index] == CTRL_DELETED) {
+      reused++;
+    }
+
+    set_ctrl(ht->ctrl, ht->capacity, free_index, tag);
+    entry->hash_code = hash_code;
+    entry->key_length = key_length;
+    entry->value = load->values[i];
+
+    bulk_load_store_key(ht, entry, key, key_length, &key_data);
+    inserted++;
+
+  next:;
+  }
+
+  // What is left of the key block goes to the deferred keys.
+  load->key_data[region] = key_data;
+  load->deferred[region] = deferred;
+  load->inserted[region] = inserted;
+  load->reused[region] = reused;
+}
+
+/**
+ * Fill the regions 'id', 'id' + threads, ...
+ */
+static void bulk_load_fill(bulk_load *load, unsigned int id) {
+  unsigned int existed = 0;
+
+  for (unsigned int region = id; region < load->regions;
+       region += load->threads) {
+    bulk_load_region_fill(load, region, &existed);
+  }
+
+  load->existed[id] = existed;
+}
+
+static void *bulk_load_worker(void *arg) {
+  bulk_load_thread *thread = arg;
+
+  thread->phase(thread->load, thread->id);
+
+  return NULL;
+}
+
+/**
+ * Run 'phase' on every thread id and wait for all of them.
+ *
+ * Id 0 runs in the calling thread, as does any id whose thread could not be
+ * started.
+ */
+static void bulk_load_run(bulk_load *load,
+                          void (*phase)(bulk_load *, unsigned int)) {
+  pthread_t threads[BULK_LOAD_MAX_THREADS];
+  bulk_load_thread args[BULK_LOAD_MAX_THREADS];
+  int started[BULK_LOAD_MAX_THREADS];
+
+  for (unsigned int id = 1; id < load->threads; id++) {
+    args[id] = (bulk_load_thread){load, id, phase};
+    started[id] =
+        pthread_create(&threads[id], NULL, bulk_load_worker, &args[id]) == 0;
+
+    if (!started[id]) {
+      phase(load, id);
+    }
+  }
+
+  phase(load, 0);
+
+  for (unsigned int id = 1; id < load->threads; id++) {
+    if (started[id]) {
+      pthread_join(threads[id], NULL);
+    }
+  }
+}
+
+int hash_table_bulk_load(hash_table *ht, const char *const *keys,
+                         void *const *values, unsigned int n,
+                         unsigned int nthreads) {
+  if (ht == NULL) {
+    return 1;
+  }
+
+  if (nthreads <= 1 || n < BULK_LOAD_MIN_KEYS) {
+    return hash_table_insert_batch(ht, keys, values, n);
+  }
+
+  // Size for every key up front, so no insertion below resizes.
+  if (hash_table_reserve(ht, ht->size + ht->tombstones + n) == 1) {
+    return 1;
+  }
+
+  migrate_slots(ht, ht->old_capacity);
+  refresh_slots(ht);
 
-struct hash_table {
-  hash_table_entry *entries;                          // array of entries
-  unsigned int (*hashfn)(const char *, unsigned int); // used for hash code
-  arena *arena;          // memory block for allocations
-  unsigned int size;         // number of entries
-  unsigned int capacity; // number of buckets
-};
+  bulk_load load = {.ht = ht, .keys = keys, .values = values, .n = n};
+  const unsigned int max_regions = ht->capacity / BULK_LOAD_MIN_REGION;
 
-struct hash_table_iterator {
-  hash_table_entry *entries;
-  unsigned int size;
-  unsigned int capacity;
-  unsigned int index; // current index
-};
+  load.threads =
+      nthreads < BULK_LOAD_MAX_THREADS ? nthreads : BULK_LOAD_MAX_THREADS;
+  // A few regions per thread evens out their load.
+  load.regions = ROUND_POW2(load.threads * 4);
+  if (load.regions > max_regions) {
+    load.regions = max_regions > 0 ? max_regions : 1;
+  }
+  load.region_shift =
+      __builtin_ctz(ht->capacity) - __builtin_ctz(load.regions);
 
-/**
- * FNV-1A hashing function.
- *
- * source:
- * https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function`
- */
-static unsigned int hash(const char *key, unsigned int length) {
-  unsigned int hash_code = 2166136261U;
+  // The key copies outlive the scratch arrays, allocate them first.
+  bulk_load_run(&load, bulk_load_measure);
 
-  for (unsigned int i = 0; i < length; i++) {
-    // for FNV-1 switch the order below
-    hash_code ^= (unsigned char)key[i];
-    hash_code *= 16777619;
+  uint64_t total_bytes = 0;
+  for (unsigned int id = 0; id < load.threads; id++) {
+    total_bytes += load.slice_bytes[id];
   }
 
-  return hash_code;
-}
+  char *key_block = NULL;
+  if (total_bytes > 0 && (key_block = arena_alloc(ht->arena, total_bytes,
+                                                  alignof(char), FALSE)) ==
+                             NULL) {
+    return 1;
+  }
 
-/**
- * Retreive a hash table entry.
- *
- * Used in search/insert/delete operations.
- *
- * @param entries array of hash table entries.
- * @param capacity max number of entries the hash table can hold at this time.
- * @param key identifier used to search for.
- * @param hashfn hashing function
- * @return hash table entry to modify.
- */
-static hash_table_entry *
-find_entry(hash_table_entry *entries, unsigned int capacity, const char *key,
-           unsigned int (*hashfn)(const char *, unsigned int)) {
-  unsigned int key_length = strlen(key);
-  unsigned int index = hashfn(key, key_length) & (capacity - 1);
-  hash_table_entry *tombstone = NULL;
+  const int scratch = arena_start_scratch_arena(ht->arena) == 0;
+  const uint64_t cells = (uint64_t)load.threads * load.regions;
+  int result = 1;
+
+  if ((load.hash_codes = arena_alloc(ht->arena, sizeof(uint64_t) * n,
+                                     alignof(uint64_t), FALSE)) == NULL ||
+      (load.partition = arena_alloc(ht->arena, sizeof(unsigned int) * n,
+                                    alignof(unsigned int), FALSE)) == NULL ||
+      (load.cursors = arena_alloc(ht->arena, sizeof(unsigned int) * cells,
+                                  alignof(unsigned int), FALSE)) == NULL ||
+      (load.key_bytes = arena_alloc(ht->arena, sizeof(uint64_t) * cells,
+                                    alignof(uint64_t), FALSE)) == NULL ||
+      (load.region_end =
+           arena_alloc(ht->arena, sizeof(unsigned int) * load.regions,
+                       alignof(unsigned int), FALSE)) == NULL ||
+      (load.deferred = arena_alloc(ht->arena, sizeof(unsigned int) * load.regions,
+                                   alignof(unsigned int), FALSE)) == NULL ||
+      (load.inserted = arena_alloc(ht->arena, sizeof(unsigned int) * load.regions,
+                                   alignof(unsigned int), FALSE)) == NULL ||
+      (load.reused = arena_alloc(ht->arena, sizeof(unsigned int) * load.regions,
+                                 alignof(unsigned int), FALSE)) == NULL ||
+      (load.key_data = arena_alloc(ht->arena, sizeof(char *) * load.regions,
+                                   alignof(char *), FALSE)) == NULL) {
+    goto exit;
+  }
 
-  while (1) {
-    hash_table_entry *entry = &entries[index];
-
-    if (entry->key == NULL) {
-      // Found empty entry
-      if (entry->value == NULL) {
-        return tombstone != NULL ? tombstone : entry;
-      } else {
-        // Found tombstone(prevously deleted entry).
-        if (tombstone == NULL) {
-          tombstone = entry;
-        }
-      }
-    } else if (strncmp(entry->key, key, key_length) == 0) {
-      return entry; // found collision
+  memset(load.cursors, 0, sizeof(unsigned int) * cells);
+  memset(load.key_bytes, 0, sizeof(uint64_t) * cells);
+
+  bulk_load_run(&load, bulk_load_hash);
+
+  // Turn the counts into write positions: regions in order, and within a
+  // region the slices in order, so every region keeps the key order.
+  unsigned int position = 0;
+  char *key_data = key_block;
+
+  for (unsigned int region = 0; region < load.regions; region++) {
+    load.key_data[region] = key_data;
+
+    for (unsigned int id = 0; id < load.threads; id++) {
+      const uint64_t cell = (uint64_t)id * load.regions + region;
+      const unsigned int count = load.cursors[cell];
+
+      load.cursors[cell] = position;
+      position += count;
+      key_data += load.key_bytes[cell];
     }
 
-    // increment by one, or wrap around to 0 index
-    index = (index + 1) & (capacity - 1);
+    load.region_end[region] = position;
   }
-}
 
-/**
- * Resize the hash table after load factor has been reached/exceeded.
- *
- * @param ht hash table to modifiy.
- */
-static void hash_table_resize(hash_table *ht) {
-  const unsigned int old_capacity = ht->capacity;
-  hash_table_entry *new_entries =
-      arena_alloc(ht->arena, (ht->capacity <<= 1) * sizeof(hash_table_entry),
-                  alignof(hash_table_entry), FALSE);
+  bulk_load_run(&load, bulk_load_scatter);
+  bulk_load_run(&load, bulk_load_fill);
 
-  // zero out new_entries
-  for (unsigned int i = 0; i < ht->capacity; i++) {
-    new_entries[i].key = NULL;
-    new_entries[i].value = NULL;
+  result = 0;
+  for (unsigned int id = 0; id < load.threads; id++) {
+    result |= load.existed[id];
+  }
+
+  for (unsigned int region = 0; region < load.regions; region++) {
+    ht->size += load.inserted[region];
+    ht->tombstones -= load.reused[region];
   }
 
-  ht->size = 0; // reset size
+  // Keys whose probe crossed a region boundary, in region order.
+  for (unsigned int region = 0; region < load.regions; region++) {
+    const unsigned int begin = region == 0 ? 0 : load.region_end[region - 1];
 
-  // populate the new_entries
-  for (unsigned i = 0; i < old_capacity; i++) {
-    hash_table_entry *entry = &ht->entries[i];
+    for (unsigned int p = begin; p < load.deferred[region]; p++) {
+      const unsigned int i = load.partition[p];
+      const unsigned int key_length = strlen(keys[i]);
+      int is_new_key;
+      hash_table_entry *entry = handle_pre_insertion(
+          ht, keys[i], key_length, load.hash_codes[i], &is_new_key);
 
-    if (entry->key == NULL) {
-      continue;
-    }
+      if (entry == NULL) {
+        result = 1;
+        goto exit;
+      }
 
-    hash_table_entry *dest =
-        find_entry(new_entries, ht->capacity, entry->key, ht->hashfn);
+      if (!is_new_key) {
+        result = 1;
+        continue;
+      }
+
+      // store_key would allocate in the scratch arena.
+      bulk_load_store_key(ht, entry, keys[i], key_length,
+                          &load.key_data[region]);
+      entry->value = values[i];
+    }
+  }
 
-    dest->key = entry->key;
-    dest->value = entry->value;
-    ht->size++;
+exit:
+  if (scratch) {
+    arena_end_scratch_arena(ht->arena);
   }
 
-  ht->entries = new_entries;
+  return result;
 }
 
-/**
- *  This function checks entries array, and checks when to resize is needed.
- *
- *  @param ht hash_table to modify
- *  @param key the hash table entry key to search
- *  @return hash table entry with 'key', empty entry otherwise
- */
-static hash_table_entry *handle_pre_insertion(hash_table *ht, const char *key) {
+int hash_table_insert_or_update(hash_table *ht, const char *key, void *value) {
+  return hash_table_insert_or_update_n(ht, key, strlen(key), value);
+}
+
+int hash_table_insert_or_update_n(hash_table *ht, const char *key,
+                                  unsigned int key_length, void *value) {
   if (ht == NULL) {
-    return NULL;
+    return 1;
   }
 
-  if (ht->size == 0) {
-    ht->entries =
-        arena_alloc(ht->arena, ht->capacity * sizeof(hash_table_entry),
-                    alignof(hash_table_entry), FALSE);
+  int is_new_key;
+  hash_table_entry *entry = handle_pre_insertion(
+      ht, key, key_length, hash_key(ht, key, key_length), &is_new_key);
 
-    // Setting keys and values to NULL indicates the position is empty. As
-    // opposed to a tombstone.
-    for (unsigned i = 0; i < ht->capacity; i++) {
-      ht->entries[i].key = NULL;
-      ht->entries[i].value = NULL;
-    }
+  if (entry == NULL) {
+    return 1;
   }
 
-  // Double the capacity of the ht when load factor is reached.
-  if (ht->size + 1 >= ht->capacity * HASH_TABLE_LOAD_FACTOR) {
-    hash_table_resize(ht);
+  if (is_new_key && store_key(ht, entry, key, key_length) == 1) {
+    return 1;
   }
 
-  return find_entry(ht->entries, ht->capacity, key, ht->hashfn);
-}
+  entry->value = value;
 
-int hash_table_create(hash_table **ht, unsigned int initial_capacity,
-                      unsigned int (*hashfn)(const char *, unsigned int),
-                      arena *arena) {
-  ASSERT(arena != NULL, "arena MUST be provided");
+  return 0;
+}
 
-  if ((*ht = arena_alloc(arena, sizeof(hash_table), alignof(hash_table),
-                         FALSE)) == NULL) {
+int hash_table_insert_or_update_view(hash_table *ht, const string_view *key,
+                                     void *value) {
+  if (key == NULL) {
     return 1;
   }
 
-  (*ht)->capacity = ROUND_POW2(initial_capacity);
-  (*ht)->arena = arena;
-  (*ht)->size = 0;
-  (*ht)->hashfn = hashfn == NULL ? hash : hashfn;
-  (*ht)->entries = NULL;
+  return hash_table_insert_or_update_n(ht, string_view_data(key),
+                                       string_view_size(key), value);
+}
 
-  return 0;
+int hash_table_get_or_insert_slot(hash_table *ht, const char *key,
+                                  void ***value_slot, int *was_inserted) {
+  return hash_table_get_or_insert_slot_n(ht, key, strlen(key), value_slot,
+                                         was_inserted);
 }
 
-int hash_table_insert(hash_table *ht, const char *key, const void *value) {
-  hash_table_entry *entry = handle_pre_insertion(ht, key);
-  int is_new_key = entry->key == 0;
-  int key_length = strlen(key);
+int hash_table_get_or_insert_slot_n(hash_table *ht, const char *key,
+                                    unsigned int key_length,
+                                    void ***value_slot, int *was_inserted) {
+  if (ht == NULL) {
+    return 1;
+  }
 
-  if (!is_new_key) {
-    return 1; // entry with key exists
+  hash_table_entry *entry = handle_pre_insertion(
+      ht, key, key_length, hash_key(ht, key, key_length), was_inserted);
+
+  if (entry == NULL) {
+    return 1;
   }
 
-  if (entry->value != (void *)1) {
-    ht->size++;
+  if (*was_inserted) {
+    if (store_key(ht, entry, key, key_length) == 1) {
+      *was_inserted = 0;
+      return 1;
+    }
+
+    entry->value = NULL;
   }
 
-  entry->key = arena_alloc(ht->arena, sizeof(char) * (key_length + 1),
-                           alignof(char), FALSE);
-  strcpy(entry->key, key);
-  entry->key[key_length] = '\0';
-  entry->value = (void *)value;
+  *value_slot = &entry->value;
 
   return 0;
 }
 
-int hash_table_insert_or_update(hash_table *ht, const char *key, void *value) {
-  hash_table_entry *entry = handle_pre_insertion(ht, key);
-  int is_new_key = entry->key == NULL;
-  int key_length = strlen(key);
-
-  if (is_new_key) {
-    ht->size++;
-
-    entry->key = arena_alloc(ht->arena, sizeof(char) * (key_length + 1),
-                             alignof(char), FALSE);
-    strcpy(entry->key, key);
-    entry->key[key_length] = '\0';
-    entry->value = value;
-  } else {
-    entry->value = value;
+int hash_table_upsert(hash_table *ht, const char *key, void *value,
+                      void *(*merge)(void *existing, void *value)) {
+  void **slot;
+  int was_inserted;
+
+  if (hash_table_get_or_insert_slot(ht, key, &slot, &was_inserted) == 1) {
+    return 1;
   }
 
+  *slot = was_inserted ? value : merge(*slot, value);
+
   return 0;
 }
 
 int hash_table_lookup(hash_table *ht, const char *key, void **value) {
+  return hash_table_lookup_n(ht, key, strlen(key), value);
+}
+
+int hash_table_lookup_n(hash_table *ht, const char *key,
+                        unsigned int key_length, void **value) {
   if (ht == NULL || ht->size == 0) {
     return 1;
   }
 
-  if (strlen(key) == 0) { // key is invalid
+  if (key_length == 0) { // key is invalid
     *value = NULL;
     return 1;
   }
 
+  migrate_slots(ht, MIGRATE_SLOTS);
+
   hash_table_entry *entry =
-      find_entry(ht->entries, ht->capacity, key, ht->hashfn);
+      lookup_entry(ht, key, key_length, hash_key(ht, key, key_length));
 
-  if (entry->key == NULL) {
+  if (entry == NULL) {
     *value = NULL;
     return 1;
   }
@@ -241,26 +1499,102 @@ int hash_table_lookup(hash_table *ht, const char *key, void **value) {
   return 0;
 }
 
+int hash_table_lookup_view(hash_table *ht, const string_view *key,
+                           void **value) {
+  if (key == NULL) {
+    return 1;
+  }
+
+  return hash_table_lookup_n(ht, string_view_data(key), string_view_size(key),
+                             value);
+}
+
+int hash_table_lookup_batch(hash_table *ht, const char *const *keys,
+                            unsigned int n, void **values_out) {
+  if (ht == NULL) {
+    return 1;
+  }
+
+  if (ht->size == 0) {
+    memset(values_out, 0, sizeof(void *) * n);
+    return 0;
+  }
+
+  unsigned int key_lengths[BATCH_SIZE];
+  uint64_t hash_codes[BATCH_SIZE];
+
+  for (unsigned int start = 0; start < n; start += BATCH_SIZE) {
+    const unsigned int count = n - start < BATCH_SIZE ? n - start : BATCH_SIZE;
+    const char *const *batch = keys + start;
+
+    migrate_slots(ht, MIGRATE_SLOTS);
+
+    // Hash everything and start every home group loading before the first
+    // probe, so the cache misses overlap instead of running one after another.
+    for (unsigned int i = 0; i < count; i++) {
+      key_lengths[i] = strlen(batch[i]);
+      hash_codes[i] = hash_key(ht, batch[i], key_lengths[i]);
+      prefetch_home(ht, hash_codes[i]);
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+      hash_table_entry *entry =
+          key_lengths[i] == 0
+              ? NULL
+              : lookup_entry(ht, batch[i], key_lengths[i], hash_codes[i]);
+
+      values_out[start + i] = entry != NULL ? entry->value : NULL;
+    }
+  }
+
+  return 0;
+}
+
 int hash_table_delete(hash_table *ht, const char *key) {
+  return hash_table_delete_n(ht, key, strlen(key));
+}
+
+int hash_table_delete_n(hash_table *ht, const char *key,
+                        unsigned int key_length) {
   if (ht == NULL || ht->size == 0) {
     return 1;
   }
 
-  hash_table_entry *entry =
-      find_entry(ht->entries, ht->capacity, key, ht->hashfn);
-
-  if (entry->key == NULL) { // Key not found, there is no entry to delete.
+  const uint64_t hash_code = hash_key(ht, key, key_length);
+
+  migrate_slots(ht, MIGRATE_SLOTS);
+
+  long index = find_entry(ht->entries, ht->ctrl, ht->generations,
+                          ht->generation, ht->capacity, key, key_length,
+                          hash_code, NULL);
+
+  if (index != -1) {
+    remove_slot(ht, index);
+    ht->entries[index].value = NULL;
+    return 0;
+  } else if (ht->old_entries != NULL &&
+             (index = find_entry(ht->old_entries, ht->old_ctrl, NULL, 0,
+                                 ht->old_capacity, key, key_length, hash_code,
+                                 NULL)) != -1) {
+    // The old array is dropped after migrating, its tombstones are not counted
+    set_ctrl(ht->old_ctrl, ht->old_capacity, index, CTRL_DELETED);
+  } else { // Key not found, there is no entry to delete.
     return 1;
   }
 
   ht->size--; // decrement hash table size
 
-  entry->key = NULL;
-  entry->value = (void *)1; // entry value of 1 means the entry is a tombstone.
-
   return 0;
 }
 
+int hash_table_delete_view(hash_table *ht, const string_view *key) {
+  if (key == NULL) {
+    return 1;
+  }
+
+  return hash_table_delete_n(ht, string_view_data(key), string_view_size(key));
+}
+
 int hash_table_size(hash_table *ht) {
   if (ht == NULL) {
     return -1;
@@ -269,12 +1603,189 @@ int hash_table_size(hash_table *ht) {
   return ht->size;
 }
 
+int hash_table_capacity(hash_table *ht) {
+  if (ht == NULL) {
+    return -1;
+  }
+
+  // Iterators finish a running migration, so only the current array counts.
+  return ht->capacity;
+}
+
+int hash_table_clear(hash_table *ht) {
+  if (ht == NULL) {
+    return 1;
+  }
+
+  if (ht->entries == NULL) {
+    return 0;
+  }
+
+  // Entries waiting to migrate are dropped with the rest.
+  if (ht->old_entries != NULL) {
+    release_slots(ht, ht->old_entries, ht->old_capacity);
+    ht->old_entries = NULL;
+    ht->old_ctrl = NULL;
+  }
+
+  const unsigned int groups = ht->capacity / GROUP_WIDTH;
+
+  if (ht->generations == NULL) {
+    if ((ht->generations = arena_alloc(ht->arena, groups, alignof(uint8_t),
+                                       FALSE)) == NULL) {
+      return 1;
+    }
+
+    memset(ht->generations, 0, groups);
+    ht->generation = 0;
+  }
+
+  // Once every 255 clears an old generation could come back, start over.
+  if (++ht->generation == 0) {
+    memset(ht->generations, 0, groups);
+    ht->generation = 1;
+  }
+
+  ht->size = 0;
+  ht->tombstones = 0;
+
+  return 0;
+}
+
+int hash_table_reserve(hash_table *ht, unsigned int n) {
+  if (ht == NULL) {
+    return 1;
+  }
+
+  unsigned int capacity = ht->capacity;
+
+  while (n > capacity * HASH_TABLE_LOAD_FACTOR) {
+    capacity <<= 1;
+  }
+
+  if (ht->entries == NULL) {
+    return allocate_slots(ht, capacity);
+  }
+
+  if (capacity == ht->capacity) {
+    return 0;
+  }
+
+  return hash_table_resize(ht, capacity);
+}
+
+int hash_table_shrink_to_fit(hash_table *ht) {
+  if (ht == NULL) {
+    return 1;
+  }
+
+  if (ht->entries == NULL) {
+    return 0;
+  }
+
+  unsigned int capacity = GROUP_WIDTH;
+
+  while (ht->size > capacity * HASH_TABLE_LOAD_FACTOR) {
+    capacity <<= 1;
+  }
+
+  if (capacity == ht->capacity && ht->tombstones == 0) {
+    return 0;
+  }
+
+  return hash_table_resize(ht, capacity);
+}
+
+int hash_table_reclaimable(hash_table *ht, uint64_t *bytes) {
+  if (ht == NULL) {
+    *bytes = 0;
+    return 1;
+  }
+
+  *bytes = ht->reclaimable;
+
+  return 0;
+}
+
+int hash_table_memory(hash_table *ht, uint64_t *bytes) {
+  if (ht == NULL) {
+    *bytes = 0;
+    return 1;
+  }
+
+  *bytes = sizeof(hash_table);
+
+  if (ht->entries != NULL) {
+    *bytes += slots_size(ht->capacity);
+  }
+
+  if (ht->old_entries != NULL) {
+    *bytes += slots_size(ht->old_capacity);
+  }
+
+  if (ht->generations != NULL) {
+    *bytes += ht->capacity / GROUP_WIDTH;
+  }
+
+  return 0;
+}
+
+int hash_table_probe_stats(hash_table *ht, double *mean_probe_length,
+                           unsigned int *max_probe_length) {
+  if (ht == NULL || ht->size == 0) {
+    return 1;
+  }
+
+  // Only the current array is measured.
+  migrate_slots(ht, ht->old_capacity);
+  refresh_slots(ht);
+
+  const unsigned int mask = ht->capacity - 1;
+  uint64_t total = 0;
+  *max_probe_length = 0;
+
+  for (unsigned int i = 0; i < ht->capacity; i++) {
+    if (ht->ctrl[i] < 0) {
+      continue;
+    }
+
+    unsigned int position = H1(ht->entries[i].hash_code) & mask;
+    unsigned int stride = 0;
+    unsigned int length = 1;
+
+    while (((i - position) & mask) >= GROUP_WIDTH) {
+      stride += GROUP_WIDTH;
+      position = (position + stride) & mask;
+      length++;
+    }
+
+    total += length;
+    if (length > *max_probe_length) {
+      *max_probe_length = length;
+    }
+  }
+
+  *mean_probe_length = (double)total / ht->size;
+
+  return 0;
+}
+
 int hash_table_entry_key(hash_table_entry *entry, char **key) {
   if (entry == NULL) {
     *key = NULL;
     return 1;
   }
-  *key = entry->key;
+  *key = ENTRY_KEY(entry);
+  return 0;
+}
+
+int hash_table_entry_key_length(hash_table_entry *entry,
+                                 unsigned int *key_length) {
+  if (entry == NULL) {
+    *key_length = 0;
+    return 1;
+  }
+  *key_length = entry->key_length;
   return 0;
 }
 
@@ -288,48 +1799,85 @@ int hash_table_entry_value(hash_table_entry *entry, void **value) {
 }
 
 int hash_table_iterator_create(hash_table_iterator **it, hash_table *ht) {
+  return hash_table_iterator_create_range(it, ht, 0, UINT32_MAX);
+}
+
+int hash_table_iterator_create_range(hash_table_iterator **it, hash_table *ht,
+                                     unsigned int begin_slot,
+                                     unsigned int end_slot) {
   if (ht == NULL || ht->size == 0) {
     return 1;
   }
 
   ASSERT(ht->arena != NULL, "arena MUST be provided");
 
+  // Iterate over a single array, finish any running migration first.
+  migrate_slots(ht, ht->old_capacity);
+  refresh_slots(ht);
+
   if (((*it) = arena_alloc(ht->arena, sizeof(hash_table_iterator),
                            alignof(hash_table_iterator), FALSE)) == NULL) {
     return 1;
   }
 
   (*it)->entries = ht->entries;
+  (*it)->ctrl = ht->ctrl;
   (*it)->size = ht->size;
   (*it)->capacity = ht->capacity;
-  (*it)->index = 0;
+  (*it)->end = end_slot < ht->capacity ? end_slot : ht->capacity;
+  (*it)->begin = begin_slot < (*it)->end ? begin_slot : (*it)->end;
+  (*it)->index = (*it)->begin;
+
+  return 0;
+}
+
+int hash_table_split_iterators(hash_table *ht, unsigned int k,
+                               hash_table_iterator **its) {
+  if (ht == NULL || k == 0) {
+    return 1;
+  }
+
+  // Whole groups per range, so no two ranges scan the same tag group.
+  const unsigned int groups = ht->capacity / GROUP_WIDTH;
+
+  for (unsigned int i = 0; i < k; i++) {
+    const unsigned int begin = (uint64_t)groups * i / k * GROUP_WIDTH;
+    const unsigned int end = (uint64_t)groups * (i + 1) / k * GROUP_WIDTH;
+
+    if (hash_table_iterator_create_range(&its[i], ht, begin, end) == 1) {
+      return 1;
+    }
+  }
 
   return 0;
 }
 
 int hash_table_iterator_next(hash_table_iterator *it,
                              hash_table_entry **entry) {
-  if (it == NULL || it->size == 0 || it->index > it->capacity - 1) {
+  if (it == NULL || it->size == 0) {
     return 1;
   }
 
-  for (unsigned int i = it->index; i <= it->capacity - 1; i++) {
-    *entry = &it->entries[i];
+  // Skip empty entries and tombstones a group of tags at a time.
+  while (it->index < it->end) {
+    const unsigned int remaining = it->end - it->index;
+    uint32_t full = group_match_full(it->ctrl + it->index);
 
-    if ((*entry)->key != NULL && (*entry)->value != NULL) {
-      it->index++;
-      break;
+    // Tags past 'end' belong to another range, or mirror the first group.
+    if (remaining < GROUP_WIDTH) {
+      full &= (1U << remaining) - 1;
     }
 
-    // If there is no entry at the last index there is no need to print.
-    if (it->index >= it->capacity - 1) {
-      return 1;
+    if (full != 0) {
+      it->index += __builtin_ctz(full);
+      *entry = &it->entries[it->index++];
+      return 0;
     }
 
-    it->index++;
+    it->index += GROUP_WIDTH;
   }
 
-  return 0;
+  return 1;
 }
 
 int hash_table_iterator_reset(hash_table_iterator *it) {
@@ -337,7 +1885,7 @@ int hash_table_iterator_reset(hash_table_iterator *it) {
     return 1;
   }
 
-  it->index = 0;
+  it->index = it->begin;
 
   return 0;
 }
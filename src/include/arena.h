@@ -14,6 +14,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
@@ -38,8 +39,57 @@
  */
 #define GB(s) ((uint64_t)(s) << 30)
 
+/**
+ * @brief Back the reservation with transparent huge pages, madvise
+ * MADV_HUGEPAGE. The kernel only uses them for 2 MB ranges that are fully
+ * committed, combine with ARENA_COMMIT_HUGE.
+ */
+#define ARENA_HUGEPAGE (1U << 0)
+
+/**
+ * @brief Reserve explicit huge pages with MAP_HUGETLB, committed 2 MB at a
+ * time. The pool of huge pages must hold the whole reservation, otherwise
+ * regular pages are used.
+ */
+#define ARENA_HUGETLB (1U << 1)
+
+/**
+ * @brief Commit memory in steps of ARENA_HUGE_PAGE_SIZE instead of a page.
+ */
+#define ARENA_COMMIT_HUGE (1U << 2)
+
+/**
+ * @brief Huge page size assumed by the ARENA_ flags.
+ */
+#define ARENA_HUGE_PAGE_SIZE MB(2)
+
+/**
+ * @brief Memory committed past what an allocation needs, so that the commit
+ * syscall runs once per this many bytes. See 'arena_set_commit_ahead'.
+ */
+#define ARENA_COMMIT_AHEAD_DEFAULT KB(64)
+
+/**
+ * @brief Size of the slice of each thread-local arena.
+ */
+#define ARENA_THREAD_LOCAL_SIZE GB(4)
+
+/**
+ * @brief Number of thread-local arenas that can be alive at once.
+ */
+#define ARENA_THREAD_LOCAL_MAX 64
+
 typedef struct arena arena;
 
+/**
+ * @brief The start of every arena, what the inline 'arena_alloc' reads.
+ */
+typedef struct arena_bump {
+  uint8_t *base_ptr;       // pointer to the start of the reserved size
+  uint64_t offset;         // bump pointer
+  uint64_t committed_size; // size of physical memory
+} arena_bump;
+
 /**
  * @brief Reserves the virtual Memory Area but doesn't commit any physical
  * memory yet.
@@ -50,17 +100,85 @@ typedef struct arena arena;
  */
 int arena_create(arena **arena, uint64_t reserve_size);
 
+/**
+ * @brief 'arena_create' with huge page options.
+ *
+ * Any of the flags aligns the reservation to ARENA_HUGE_PAGE_SIZE. When
+ * huge pages are not available the arena falls back to regular pages.
+ *
+ * @param arena memory block for de-allocate
+ * @param reserve_size size of the Virtual Memory Area.
+ * @param flags ARENA_HUGEPAGE, ARENA_HUGETLB and ARENA_COMMIT_HUGE or'ed.
+ * @return 0 on success, 1 otherwise
+ */
+int arena_create_ex(arena **arena, uint64_t reserve_size, unsigned int flags);
+
+/**
+ * @brief Slow path of 'arena_alloc', commits more memory when needed.
+ *
+ * @param arena the arena to modify
+ * @param size memory block size to commit.
+ * @param alignment the alignment boundary.
+ * @param zero_out indicates whether to initialize the memory block
+ * @return pointer to the start of the newly committed memory.
+ */
+void *arena_alloc_commit(arena *arena, const uint64_t size,
+                         const size_t alignment, unsigned int zero_out);
+
 /**
  * @brief Commit 'size' from the Virtual Memory Area.
  *
+ * Inlined, allocations that fit in the committed memory are a bump of the
+ * offset.
+ *
+ * @param arena the arena to modify
+ * @param size memory block size to commit.
+ * @param alignment the alignment boundary.
+ * @param zero_out indicates whether to initialize the memory block
+ * @return pointer to the start of the newly committed memory.
+ */
+static inline void *arena_alloc(arena *arena, const uint64_t size,
+                                const size_t alignment,
+                                unsigned int zero_out) {
+  arena_bump *bump = (arena_bump *)arena;
+
+  if (arena != NULL && size > 0 && alignment > 0 &&
+      (alignment & (alignment - 1)) == 0) {
+    const uint64_t aligned_offset =
+        (bump->offset + alignment - 1) & ~((uint64_t)alignment - 1);
+    const uint64_t new_offset = aligned_offset + size;
+
+    if (new_offset <= bump->committed_size && new_offset > aligned_offset) {
+      void *memory = bump->base_ptr + aligned_offset;
+      bump->offset = new_offset;
+
+      if (zero_out == 1) {
+        memset(memory, 0, size);
+      }
+
+      return memory;
+    }
+  }
+
+  return arena_alloc_commit(arena, size, alignment, zero_out);
+}
+
+/**
+ * @brief Commit 'size' from the Virtual Memory Area, from any thread.
+ *
+ * Space is claimed with a compare-and-swap on the bump pointer, retried
+ * when another thread claimed first. A request that does not fit claims
+ * nothing. Only the thread that extends the committed memory takes a lock.
+ * MUST NOT run at the same time as the other functions on 'arena'.
+ *
  * @param arena the arena to modify
  * @param size memory block size to commit.
  * @param alignment the alignment boundary.
  * @param zero_out indicates whether to initialize the memory block
  * @return pointer to the start of the newly committed memory.
  */
-void *arena_alloc(arena *arena, const uint64_t size, const size_t alignment,
-                  unsigned int zero_out);
+void *arena_alloc_concurrent(arena *arena, const uint64_t size,
+                             const size_t alignment, unsigned int zero_out);
 
 /**
  * @brief Commit 'size' from the Virtual Memory Area.
@@ -77,6 +195,31 @@ void *arena_realloc(arena *arena, void *old_ptr, const uint64_t old_size,
                     const uint64_t new_size, const uint64_t alignment,
                     unsigned int zero_out);
 
+/**
+ * @brief Set how much memory is committed ahead of the allocations.
+ *
+ * Larger steps make fewer commit syscalls, the memory is only backed by
+ * physical pages once written. 0 doubles the committed memory each time.
+ *
+ * @param arena the arena to modify
+ * @param commit_ahead bytes, rounded up to the commit granularity
+ * @return 0 on success, 1 otherwise
+ */
+int arena_set_commit_ahead(arena *arena, uint64_t commit_ahead);
+
+/**
+ * @brief Give back the most recent allocation.
+ *
+ * Nothing happens when 'ptr' is not the most recent allocation, or was made
+ * before the active scratch arena started.
+ *
+ * @param arena the arena to modify
+ * @param ptr start of the memory block returned by 'arena_alloc'
+ * @param size size of the memory block
+ * @return 0 when the memory was given back, 1 otherwise
+ */
+int arena_free_last(arena *arena, void *ptr, const uint64_t size);
+
 /**
  * @brief Indicate the next allocations are temporary
  *
@@ -106,9 +249,24 @@ int arena_reset(arena *arena);
 /**
  * @brief Deallocate memory used
  *
+ * Thread-local arenas are not destroyed, they go back to the pool when
+ * their thread exits.
+ *
  * @param arena memory block for de-allocate
  * @return 0 on success, 1 otherwise
  */
 int arena_destroy(arena **arena);
 
+/**
+ * @brief The calling thread's arena, created on first use.
+ *
+ * Every thread-local arena is a slice of ARENA_THREAD_LOCAL_SIZE of one
+ * shared reservation, and grows inside it without any lock. When the thread
+ * exits its pages are given back to the OS and the slice is reused by the
+ * next thread, so nothing allocated from it may outlive the thread.
+ *
+ * @return the arena, NULL when ARENA_THREAD_LOCAL_MAX threads hold one
+ */
+arena *arena_thread_local(void);
+
 #endif // ARENA_H
@@ -0,0 +1,95 @@
+/*
+ * @file concurrent_hash_table.h
+ *
+ * @brief Thread safe hash table with lock-free lookups.
+ *
+ * Lookups never take a lock. Writers serialize per key on one of a fixed set
+ * of striped locks, so writers of different keys rarely contend. Growing the
+ * table is cooperative: every writer migrates a chunk of slots to the new
+ * table while readers keep following the old one.
+ *
+ * The arena is only touched under an internal lock and memory of old tables
+ * is never reused, so it MUST outlive every thread using the table.
+ */
+
+#ifndef CONCURRENT_HASH_TABLE_H
+#define CONCURRENT_HASH_TABLE_H
+
+#include "arena.h"
+
+typedef struct concurrent_hash_table concurrent_hash_table;
+
+/**
+ * Allocate necessary resources and setup.
+ *
+ * @param ht concurrent_hash_table to create.
+ * @param initial_capacity number of buckets before resizing
+ * @param hashfn hashing function, if set to NULL FNV-1a  is used.
+ * @param arena memory block for all allocations
+ * @return 0 on success, 1 otherwise
+ */
+int concurrent_hash_table_create(concurrent_hash_table **ht,
+                                 unsigned int initial_capacity,
+                                 unsigned int (*hashfn)(const char *,
+                                                        unsigned int),
+                                 arena *arena);
+
+/**
+ * Retrive the number of entries in the hash table.
+ *
+ * The result is a snapshot, concurrent writers may change it right away.
+ *
+ * @param ht the hash table to access.
+ * @return number of entries otherwise, -1 otherwise
+ */
+int concurrent_hash_table_size(concurrent_hash_table *ht);
+
+/**
+ * Insert an entry into the hash table.
+ *
+ * This function DOES NOT change the value of an existing entry.
+ * To update the value use 'concurrent_hash_table_insert_or_update'.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @param value item to insert.
+ * @return 0 on success, 1 otherwise
+ */
+int concurrent_hash_table_insert(concurrent_hash_table *ht, const char *key,
+                                 const void *value);
+
+/**
+ * Insert/Update an entry into the hash table.
+ *
+ * This function DOES change the value of an existing entry.
+ * To prevent this use 'concurrent_hash_table_insert' instead.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @param value item to insert.
+ * @return 0 on success, 1 otherwise
+ */
+int concurrent_hash_table_insert_or_update(concurrent_hash_table *ht,
+                                           const char *key, void *value);
+
+/**
+ * Search for an entry in the hash table without taking any lock.
+ *
+ * @param ht hash table to search.
+ * @param key identifier used to access the hash table entry.
+ * @param value pointer used to get a reference to the entry's value.
+ * @return 0 on success, 1 otherwise
+ */
+int concurrent_hash_table_lookup(concurrent_hash_table *ht, const char *key,
+                                 void **value);
+
+/**
+ * Delete an entry from the hash table.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @return 0 on success, 1 otherwise
+ */
+int concurrent_hash_table_delete(concurrent_hash_table *ht, const char *key);
+
+#endif // CONCURRENT_HASH_TABLE_H
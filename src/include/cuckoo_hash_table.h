@@ -0,0 +1,97 @@
+/*
+ * @file cuckoo_hash_table.h
+ *
+ * @brief Hash table with a bounded number of probes per lookup.
+ *
+ * Every key can only live in one of two buckets of 4 slots, chosen by two
+ * hash functions, or in a small stash. A lookup reads at most the two
+ * buckets, one cache line each, and the stash when it is not empty.
+ * Insertion moves entries to their other bucket to make room, which is
+ * where the cost goes instead.
+ */
+
+#ifndef CUCKOO_HASH_TABLE_H
+#define CUCKOO_HASH_TABLE_H
+
+#include "arena.h"
+
+#include <stdint.h>
+
+typedef struct cuckoo_hash_table cuckoo_hash_table;
+
+/**
+ * Allocate necessary resources and setup.
+ *
+ * @param ht cuckoo_hash_table to create.
+ * @param initial_capacity number of slots before resizing
+ * @param arena memory block for all allocations
+ * @return 0 on success, 1 otherwise
+ */
+int cuckoo_hash_table_create(cuckoo_hash_table **ht,
+                             unsigned int initial_capacity, arena *arena);
+
+/**
+ * Retrive the number of entries in the hash table.
+ *
+ * @param ht the hash table to access.
+ * @return number of entries otherwise, -1 otherwise
+ */
+int cuckoo_hash_table_size(cuckoo_hash_table *ht);
+
+/**
+ * Insert an entry into the hash table.
+ *
+ * This function DOES NOT change the value of an existing entry.
+ * To update the value use 'cuckoo_hash_table_insert_or_update'.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @param value item to insert.
+ * @return 0 on success, 1 otherwise
+ */
+int cuckoo_hash_table_insert(cuckoo_hash_table *ht, const char *key,
+                             const void *value);
+
+/**
+ * Insert or update an entry.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @param value item to insert.
+ * @return 0 on success, 1 otherwise
+ */
+int cuckoo_hash_table_insert_or_update(cuckoo_hash_table *ht, const char *key,
+                                       const void *value);
+
+/**
+ * Lookup an entry in the hash table.
+ *
+ * @param ht hash table to search.
+ * @param key identifier used to search for.
+ * @param value where to store the value with 'key'.
+ * @return 0 on success, 1 otherwise
+ */
+int cuckoo_hash_table_lookup(cuckoo_hash_table *ht, const char *key,
+                             void **value);
+
+/**
+ * Delete an entry.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to search for.
+ * @return 0 on success, 1 otherwise
+ */
+int cuckoo_hash_table_delete(cuckoo_hash_table *ht, const char *key);
+
+/**
+ * Retrieve the memory used by the buckets.
+ *
+ * Keys are copied into separate arena blocks and are not counted.
+ *
+ * @param ht the hash table to access.
+ * @param bytes where to store the number of bytes.
+ * @return 0 on success, 1 otherwise
+ */
+int cuckoo_hash_table_memory(cuckoo_hash_table *ht, uint64_t *bytes);
+
+#endif // CUCKOO_HASH_TABLE_H
@@ -0,0 +1,144 @@
+#ifndef FLAT_HASH_TABLE_H
+#define FLAT_HASH_TABLE_H
+
+#include "arena.h"
+
+#include <stdint.h>
+
+typedef struct flat_hash_table_entry flat_hash_table_entry;
+typedef struct flat_hash_table flat_hash_table;
+typedef struct flat_hash_table_iterator flat_hash_table_iterator;
+
+/**
+ * Allocate necessary resources and setup.
+ *
+ * Values are copied into the slots instead of being stored as pointers, so
+ * small values need no allocation of their own and no pointer to follow.
+ * Keys shorter than 16 bytes are stored in the slots too.
+ *
+ * @param ht flat_hash_table to create.
+ * @param initial_capacity number of buckets before resizing
+ * @param data_size Size in bytes of each value stored, can be 0.
+ * @param arena memory block for all allocations
+ * @return 0 on success, 1 otherwise
+ */
+int flat_hash_table_create(flat_hash_table **ht, unsigned int initial_capacity,
+                           unsigned int data_size, arena *arena);
+
+/**
+ * Retrive the number of entries in the hash table.
+ *
+ * @param ht the hash table to access.
+ * @return number of entries otherwise, -1 otherwise
+ */
+int flat_hash_table_size(flat_hash_table *ht);
+
+/**
+ * Insert an entry into the hash table.
+ *
+ * This function DOES NOT change the value of an existing entry.
+ * To update the value use 'flat_hash_table_insert_or_update'.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @param value 'data_size' bytes to copy, can be NULL when 'data_size' is 0.
+ * @return 0 on success, 1 otherwise
+ */
+int flat_hash_table_insert(flat_hash_table *ht, const char *key,
+                           const void *value);
+
+/**
+ * Insert or update an entry.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @param value 'data_size' bytes to copy, can be NULL when 'data_size' is 0.
+ * @return 0 on success, 1 otherwise
+ */
+int flat_hash_table_insert_or_update(flat_hash_table *ht, const char *key,
+                                     const void *value);
+
+/**
+ * Lookup an entry in the hash table.
+ *
+ * @param ht hash table to search.
+ * @param key identifier used to search for.
+ * @param value where to copy the 'data_size' bytes of the value, can be NULL.
+ * @return 0 on success, 1 otherwise
+ */
+int flat_hash_table_lookup(flat_hash_table *ht, const char *key, void *value);
+
+/**
+ * Delete an entry.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to search for.
+ * @return 0 on success, 1 otherwise
+ */
+int flat_hash_table_delete(flat_hash_table *ht, const char *key);
+
+/**
+ * Retrieve the memory used by the slots.
+ *
+ * Keys of 16 bytes or more live in separate arena blocks and are not
+ * counted.
+ *
+ * @param ht the hash table to access.
+ * @param bytes where to store the number of bytes.
+ * @return 0 on success, 1 otherwise
+ */
+int flat_hash_table_memory(flat_hash_table *ht, uint64_t *bytes);
+
+/**
+ * Retreive the key from the given hash table entry.
+ *
+ * Short keys live inside the entry, the pointer is only valid until the
+ * hash table is modified.
+ *
+ * @param entry the hash table entry to access.
+ * @param key where to store the key.
+ * @return 0 on success, 1 otherwise
+ */
+int flat_hash_table_entry_key(flat_hash_table_entry *entry, char **key);
+
+/**
+ * Retreive a pointer to the value inside the given hash table entry.
+ *
+ * @param entry the hash table entry to access.
+ * @param value where to store the pointer, valid until the hash table is
+ *        modified.
+ * @return 0 on success, 1 otherwise
+ */
+int flat_hash_table_entry_value(flat_hash_table_entry *entry, void **value);
+
+/**
+ * Allocate necessary resources and setup.
+ *
+ * @param it hash table iterator to create.
+ * @param ht hash table to iterate through.
+ * @return 0 on success, 1 otherwise
+ */
+int flat_hash_table_iterator_create(flat_hash_table_iterator **it,
+                                    flat_hash_table *ht);
+
+/**
+ * Get the next entry in the hash table.
+ *
+ * @param it hash table iterator
+ * @param entry value used to hold the next entry in the hash table.
+ * @return 0 on success, 1 otherwise
+ */
+int flat_hash_table_iterator_next(flat_hash_table_iterator *it,
+                                  flat_hash_table_entry **entry);
+
+/**
+ * Reset the hash table iterator.
+ *
+ * Use before iterating hash_table for a second time.
+ *
+ * @param it hash table iterator
+ * @return 0 on success, 1 otherwise
+ */
+int flat_hash_table_iterator_reset(flat_hash_table_iterator *it);
+
+#endif // FLAT_HASH_TABLE_H
@@ -0,0 +1,79 @@
+#ifndef FROZEN_HASH_TABLE_H
+#define FROZEN_HASH_TABLE_H
+
+#include "arena.h"
+#include "hash_table.h"
+#include "string_view.h"
+
+#include <stdint.h>
+
+typedef struct frozen_hash_table frozen_hash_table;
+
+/**
+ * Build a read-only index of every entry in 'ht'.
+ *
+ * The index is a minimal perfect hash: one slot per entry and a small
+ * displacement per bucket of keys(PTHash/CHD). Every lookup reads one
+ * displacement, then exactly one slot and compares one key. The keys are
+ * copied, so 'ht' can be modified or dropped afterwards, the values are not.
+ *
+ * @param ht hash table to index.
+ * @param frozen frozen_hash_table to create.
+ * @param arena memory block for all allocations, can be the arena of 'ht'.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_freeze(hash_table *ht, frozen_hash_table **frozen,
+                      arena *arena);
+
+/**
+ * Retrive the number of entries in the frozen hash table.
+ *
+ * @param ft the frozen hash table to access.
+ * @return number of entries otherwise, -1 otherwise
+ */
+int frozen_hash_table_size(frozen_hash_table *ft);
+
+/**
+ * Lookup an entry in the frozen hash table.
+ *
+ * @param ft frozen hash table to search.
+ * @param key identifier used to search for.
+ * @param value where to store the value with 'key'.
+ * @return 0 on success, 1 otherwise
+ */
+int frozen_hash_table_lookup(frozen_hash_table *ft, const char *key,
+                             void **value);
+
+/**
+ * Lookup an entry in the frozen hash table, using a key of known length.
+ *
+ * @param ft frozen hash table to search.
+ * @param key identifier used to search for, does not need a '\0'.
+ * @param key_length length of 'key'.
+ * @param value where to store the value with 'key'.
+ * @return 0 on success, 1 otherwise
+ */
+int frozen_hash_table_lookup_n(frozen_hash_table *ft, const char *key,
+                               unsigned int key_length, void **value);
+
+/**
+ * Lookup an entry in the frozen hash table, using a string_view as the key.
+ *
+ * @param ft frozen hash table to search.
+ * @param key identifier used to search for.
+ * @param value where to store the value with 'key'.
+ * @return 0 on success, 1 otherwise
+ */
+int frozen_hash_table_lookup_view(frozen_hash_table *ft,
+                                  const string_view *key, void **value);
+
+/**
+ * Retrieve the memory used by the index, the copied keys are not counted.
+ *
+ * @param ft the frozen hash table to access.
+ * @param bytes where to store the number of bytes.
+ * @return 0 on success, 1 otherwise
+ */
+int frozen_hash_table_memory(frozen_hash_table *ft, uint64_t *bytes);
+
+#endif // FROZEN_HASH_TABLE_H
@@ -0,0 +1,160 @@
+/*
+ * @file hash_group.h
+ *
+ * @brief Control tag groups shared by the open addressing hash tables.
+ *
+ * Every slot has a 1 byte control tag. A full slot stores the low 7 bits of
+ * its hash, the others are empty or deleted. Tags are scanned GROUP_WIDTH at
+ * a time, so a probe only compares keys whose tag matches.
+ */
+
+#ifndef HASH_GROUP_H
+#define HASH_GROUP_H
+
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Number of control tags scanned at once, one SSE2 register worth.
+ */
+#define GROUP_WIDTH 16
+
+/**
+ * Control tag values.
+ *
+ * A full slot stores the low 7 bits of its hash(0..127), so the high bit
+ * alone tells whether the slot is free.
+ */
+#define CTRL_EMPTY ((int8_t)-128) // 0b10000000
+#define CTRL_DELETED ((int8_t)-2) // 0b11111110, tombstone
+
+/**
+ * Split a hash code into the probe start(H1) and the control tag(H2).
+ */
+#define H1(hash_code) ((hash_code) >> 7)
+#define H2(hash_code) ((int8_t)((hash_code) & 0x7F))
+
+/**
+ * Bitmask of the slots in the group whose tag equals 'tag'.
+ *
+ * Bit i is set when ctrl[i] == tag.
+ */
+static inline uint32_t group_match(const int8_t *ctrl, int8_t tag) {
+#ifdef __SSE2__
+  const __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+  return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(tag), group));
+#else
+  uint32_t mask = 0;
+
+  for (unsigned int i = 0; i < GROUP_WIDTH; i++) {
+    mask |= (uint32_t)(ctrl[i] == tag) << i;
+  }
+
+  return mask;
+#endif
+}
+
+/**
+ * Bitmask of the slots in the group that are empty or deleted.
+ */
+static inline uint32_t group_match_free(const int8_t *ctrl) {
+#ifdef __SSE2__
+  // Only free tags have the high bit set.
+  return (uint32_t)_mm_movemask_epi8(
+      _mm_loadu_si128((const __m128i *)ctrl));
+#else
+  uint32_t mask = 0;
+
+  for (unsigned int i = 0; i < GROUP_WIDTH; i++) {
+    mask |= (uint32_t)(ctrl[i] < 0) << i;
+  }
+
+  return mask;
+#endif
+}
+
+/**
+ * Bitmask of the slots in the group that hold an entry.
+ */
+static inline uint32_t group_match_full(const int8_t *ctrl) {
+  return ~group_match_free(ctrl) & ((1U << GROUP_WIDTH) - 1);
+}
+
+/**
+ * Set the tag of slot 'index'.
+ *
+ * The first GROUP_WIDTH tags are mirrored past the end of the array so a
+ * group starting near the end can be loaded without wrapping around.
+ */
+static inline void set_ctrl(int8_t *ctrl, unsigned int capacity,
+                            unsigned int index, int8_t tag) {
+  ctrl[index] = tag;
+
+  if (index < GROUP_WIDTH) {
+    ctrl[capacity + index] = tag;
+  }
+}
+
+/**
+ * Check whether a probe could ever have passed over slot 'index'.
+ *
+ * Probes stop at the first group holding an empty slot. When every window of
+ * GROUP_WIDTH slots around 'index' holds one, no probe went past 'index' and
+ * a deleted entry can become empty instead of a tombstone.
+ *
+ * @param ctrl control tags to check
+ * @param capacity number of slots 'ctrl' describes
+ * @param index slot being deleted
+ * @return 1 when 'index' can be marked empty, 0 otherwise
+ */
+static inline int was_never_full(const int8_t *ctrl, unsigned int capacity,
+                                 unsigned int index) {
+  const unsigned int before_index = (index - GROUP_WIDTH) & (capacity - 1);
+  const uint32_t empty_before = group_match(ctrl + before_index, CTRL_EMPTY);
+  const uint32_t empty_after = group_match(ctrl + index, CTRL_EMPTY);
+
+  if (empty_before == 0 || empty_after == 0) {
+    return 0;
+  }
+
+  // leading zeros of the 16 bit mask: full slots right before 'index'
+  const unsigned int full_before = __builtin_clz(empty_before) - 16;
+  const unsigned int full_after = __builtin_ctz(empty_after);
+
+  return full_before + full_after < GROUP_WIDTH;
+}
+
+/**
+ * Find the first empty/deleted slot on the probe sequence of 'hash_code'.
+ *
+ * Groups are visited triangularly, which covers every group when capacity is
+ * a power of 2.
+ *
+ * @param ctrl control tags to search
+ * @param capacity number of slots 'ctrl' describes
+ * @param hash_code hash code of the key to insert
+ * @return index of a free slot
+ */
+static inline unsigned int find_free_slot(const int8_t *ctrl,
+                                          unsigned int capacity,
+                                          uint64_t hash_code) {
+  const unsigned int mask = capacity - 1;
+  unsigned int position = H1(hash_code) & mask;
+  unsigned int stride = 0;
+
+  while (1) {
+    uint32_t free = group_match_free(ctrl + position);
+
+    if (free != 0) {
+      return (position + __builtin_ctz(free)) & mask;
+    }
+
+    stride += GROUP_WIDTH;
+    position = (position + stride) & mask;
+  }
+}
+
+#endif // HASH_GROUP_H
@@ -0,0 +1,74 @@
+/*
+ * @file hash_set.h
+ *
+ * @brief Set of strings, a flat_hash_table without values.
+ *
+ * Slots hold only the key header, 24 bytes against 40 for hash_table, which
+ * keeps more of them in cache for membership tests.
+ */
+
+#ifndef HASH_SET_H
+#define HASH_SET_H
+
+#include "arena.h"
+
+#include <stdint.h>
+
+typedef struct hash_set hash_set;
+
+/**
+ * Allocate necessary resources and setup.
+ *
+ * @param set hash_set to create.
+ * @param initial_capacity number of buckets before resizing
+ * @param arena memory block for all allocations
+ * @return 0 on success, 1 otherwise
+ */
+int hash_set_create(hash_set **set, unsigned int initial_capacity,
+                    arena *arena);
+
+/**
+ * Retrive the number of keys in the set.
+ *
+ * @param set the set to access.
+ * @return number of keys otherwise, -1 otherwise
+ */
+int hash_set_size(hash_set *set);
+
+/**
+ * Add a key to the set.
+ *
+ * @param set set to be modified.
+ * @param key key to add.
+ * @return 0 on success, 1 otherwise or when 'key' is already present
+ */
+int hash_set_add(hash_set *set, const char *key);
+
+/**
+ * Check whether the set holds a key.
+ *
+ * @param set set to search.
+ * @param key key to search for.
+ * @return 0 when 'key' is present, 1 otherwise
+ */
+int hash_set_contains(hash_set *set, const char *key);
+
+/**
+ * Remove a key from the set.
+ *
+ * @param set set to be modified.
+ * @param key key to remove.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_set_remove(hash_set *set, const char *key);
+
+/**
+ * Retrieve the memory used by the slots.
+ *
+ * @param set the set to access.
+ * @param bytes where to store the number of bytes.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_set_memory(hash_set *set, uint64_t *bytes);
+
+#endif // HASH_SET_H
@@ -2,6 +2,29 @@
 #define HASH_TABLE_H
 
 #include "arena.h"
+#include "string_view.h"
+
+#include <stdint.h>
+
+/**
+ * Store the caller's key pointer instead of copying the key into the arena.
+ *
+ * Applies to keys of 24 bytes or more, shorter keys are always copied
+ * inside the entry. The key memory MUST outlive the hash table and MUST NOT
+ * change. Keys inserted through the '_n' and '_view' variants are then not
+ * '\0' terminated, use 'hash_table_entry_key_length' when iterating.
+ */
+#define HASH_TABLE_BORROWED_KEYS (1U << 0)
+
+/**
+ * Spread resizing over later operations instead of moving every entry at once.
+ *
+ * While a resize is running both entry arrays stay allocated, every insert,
+ * lookup and delete migrates a bounded number of buckets and searches both
+ * arrays until the migration finishes. Bounds the latency of the operation
+ * that crosses the load factor.
+ */
+#define HASH_TABLE_INCREMENTAL_RESIZE (1U << 1)
 
 typedef struct hash_table_entry hash_table_entry;
 typedef struct hash_table hash_table;
@@ -12,7 +35,8 @@ typedef struct hash_table_iterator hash_table_iterator;
  *
  * @param ht hash_table to create.
  * @param initial_capacity number of buckets before resizing
- * @param hashfn hashing function, if set to NULL FNV-1a  is used.
+ * @param hashfn hashing function, if set to NULL 'hash_table_hash64' is used
+ *        with a seed picked for this table.
  * @param arena memory block for all allocations
  * @return 0 on success, 1 otherwise
  */
@@ -20,6 +44,74 @@ int hash_table_create(hash_table **ht, unsigned int initial_capacity,
                       unsigned int (*hashfn)(const char *, unsigned int),
                       arena *arena);
 
+/**
+ * Allocate necessary resources and setup, with creation flags.
+ *
+ * @param ht hash_table to create.
+ * @param initial_capacity number of buckets before resizing
+ * @param hashfn hashing function, if set to NULL 'hash_table_hash64' is used
+ *        with a seed picked for this table.
+ * @param flags bitwise OR of HASH_TABLE_* flags, 0 for the defaults.
+ * @param arena memory block for all allocations
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_create_ex(hash_table **ht, unsigned int initial_capacity,
+                         unsigned int (*hashfn)(const char *, unsigned int),
+                         unsigned int flags, arena *arena);
+
+/**
+ * Allocate necessary resources and setup, with a 64 bit seeded hash.
+ *
+ * The full 64 bit hash is stored in each entry, the table only uses as many
+ * bits as its capacity needs. With 'hash_table_hash64', prefer a seed that
+ * is not known to clients, so they cannot pick keys that collide. The seed
+ * gives no such protection with 'hash_table_hash_crc32c'.
+ *
+ * @param ht hash_table to create.
+ * @param initial_capacity number of buckets before resizing
+ * @param hashfn hashing function, if set to NULL 'hash_table_hash64' is used.
+ * @param seed passed as the last argument of every 'hashfn' call.
+ * @param flags bitwise OR of HASH_TABLE_* flags, 0 for the defaults.
+ * @param arena memory block for all allocations
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_create_seeded(hash_table **ht, unsigned int initial_capacity,
+                             uint64_t (*hashfn)(const char *, unsigned int,
+                                                uint64_t),
+                             uint64_t seed, unsigned int flags, arena *arena);
+
+/**
+ * Seeded 64 bit hash, consumes 16 bytes per step(wyhash).
+ *
+ * source: https://github.com/wangyi-fudan/wyhash
+ *
+ * @param key bytes to hash.
+ * @param length length of 'key'.
+ * @param seed changes every hash value.
+ * @return hash of 'key'
+ */
+uint64_t hash_table_hash64(const char *key, unsigned int length,
+                           uint64_t seed);
+
+/**
+ * Seeded 64 bit hash built on the SSE4.2 CRC32C instruction.
+ *
+ * Checks the CPU at runtime and falls back to 'hash_table_hash64' when the
+ * instruction is missing, so values differ between machines.
+ *
+ * NOT resistant to hash flooding. CRC is linear, whether two keys of the
+ * same length collide does not depend on the seed, and clients choosing
+ * keys can find collisions offline. Use 'hash_table_hash64' for untrusted
+ * keys.
+ *
+ * @param key bytes to hash.
+ * @param length length of 'key'.
+ * @param seed changes every hash value, but not which keys collide.
+ * @return hash of 'key'
+ */
+uint64_t hash_table_hash_crc32c(const char *key, unsigned int length,
+                                uint64_t seed);
+
 /**
  * Retrive the number of entries in the hash table.
  *
@@ -41,6 +133,71 @@ int hash_table_size(hash_table *ht);
  */
 int hash_table_insert(hash_table *ht, const char *key, const void *value);
 
+/**
+ * Insert an entry into the hash table, using a key of known length.
+ *
+ * 'key' does not need to be '\0' terminated.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @param key_length number of bytes in 'key'.
+ * @param value item to insert.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_insert_n(hash_table *ht, const char *key,
+                        unsigned int key_length, const void *value);
+
+/**
+ * Insert an entry into the hash table, using a string_view as the key.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @param value item to insert.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_insert_view(hash_table *ht, const string_view *key,
+                           const void *value);
+
+/**
+ * Insert a batch of entries into the hash table.
+ *
+ * Hashes the keys and prefetches their buckets ahead of inserting them, so
+ * the cache misses of a batch overlap. The capacity grows once for the
+ * whole batch. Like 'hash_table_insert', existing entries are not changed.
+ *
+ * @param ht hash table to be modified.
+ * @param keys 'n' '\0' terminated keys.
+ * @param values 'n' items, values[i] is stored under keys[i].
+ * @param n number of entries to insert.
+ * @return 0 when every key was inserted, 1 otherwise
+ */
+int hash_table_insert_batch(hash_table *ht, const char *const *keys,
+                            void *const *values, unsigned int n);
+
+/**
+ * Insert a large array of entries using several threads.
+ *
+ * The keys are hashed in parallel and partitioned by the high bits of their
+ * home slot, then each thread fills its own regions of slots without any
+ * locking. The few keys whose probe crosses into another region are
+ * inserted by the calling thread at the end. Below 65536 keys, or with a
+ * single thread, this is 'hash_table_insert_batch'.
+ *
+ * Like 'hash_table_insert', existing entries are not changed, and the first
+ * of repeated keys wins. The hash function has to be safe to call from
+ * several threads.
+ *
+ * @param ht hash table to be modified.
+ * @param keys 'n' '\0' terminated keys.
+ * @param values 'n' items, values[i] is stored under keys[i].
+ * @param n number of entries to insert.
+ * @param nthreads number of threads to use, at most 64.
+ * @return 0 when every key was inserted, 1 otherwise
+ */
+int hash_table_bulk_load(hash_table *ht, const char *const *keys,
+                         void *const *values, unsigned int n,
+                         unsigned int nthreads);
+
 /**
  * Insert/Update an entry into the hash table.
  *
@@ -54,6 +211,80 @@ int hash_table_insert(hash_table *ht, const char *key, const void *value);
  */
 int hash_table_insert_or_update(hash_table *ht, const char *key, void *value);
 
+/**
+ * Insert/Update an entry into the hash table, using a key of known length.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @param key_length number of bytes in 'key'.
+ * @param value item to insert.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_insert_or_update_n(hash_table *ht, const char *key,
+                                  unsigned int key_length, void *value);
+
+/**
+ * Insert/Update an entry into the hash table, using a string_view as the key.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @param value item to insert.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_insert_or_update_view(hash_table *ht, const string_view *key,
+                                     void *value);
+
+/**
+ * Find the value of 'key', inserting an entry with a NULL value if absent.
+ *
+ * Takes a single probe, the value can then be read and written in place:
+ *
+ *   void **slot;
+ *   int was_inserted;
+ *   hash_table_get_or_insert_slot(ht, word, &slot, &was_inserted);
+ *   *slot = (void *)((uintptr_t)*slot + 1);
+ *
+ * The slot is only valid until the hash table is modified.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @param value_slot where to store a pointer to the value of 'key'.
+ * @param was_inserted where to store whether 'key' was absent.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_get_or_insert_slot(hash_table *ht, const char *key,
+                                  void ***value_slot, int *was_inserted);
+
+/**
+ * Find the value of 'key', inserting an entry with a NULL value if absent,
+ * using a key of known length.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored, does not need a
+ *        '\0'.
+ * @param key_length length of 'key'.
+ * @param value_slot where to store a pointer to the value of 'key'.
+ * @param was_inserted where to store whether 'key' was absent.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_get_or_insert_slot_n(hash_table *ht, const char *key,
+                                    unsigned int key_length,
+                                    void ***value_slot, int *was_inserted);
+
+/**
+ * Insert an entry, or combine its value with the existing one.
+ *
+ * Takes a single probe.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @param value item to insert, or to pass to 'merge'.
+ * @param merge returns the new value from the existing one and 'value'.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_upsert(hash_table *ht, const char *key, void *value,
+                      void *(*merge)(void *existing, void *value));
+
 /**
  * Search for an entry in the hash table.
  *
@@ -64,6 +295,45 @@ int hash_table_insert_or_update(hash_table *ht, const char *key, void *value);
  */
 int hash_table_lookup(hash_table *ht, const char *key, void **value);
 
+/**
+ * Search for an entry in the hash table, using a key of known length.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the hash table entry.
+ * @param key_length number of bytes in 'key'.
+ * @param value pointer used to get a reference to the entry's value.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_lookup_n(hash_table *ht, const char *key,
+                        unsigned int key_length, void **value);
+
+/**
+ * Search for an entry in the hash table, using a string_view as the key.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the hash table entry.
+ * @param value pointer used to get a reference to the entry's value.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_lookup_view(hash_table *ht, const string_view *key,
+                           void **value);
+
+/**
+ * Lookup a batch of keys in the hash table.
+ *
+ * Hashes the keys and prefetches their buckets ahead of probing, so the
+ * cache misses of a batch overlap. Faster than calling 'hash_table_lookup'
+ * for each key when the table does not fit in cache.
+ *
+ * @param ht hash table to search.
+ * @param keys 'n' '\0' terminated keys.
+ * @param n number of keys to look up.
+ * @param values_out where to store 'n' items, NULL for keys not found.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_lookup_batch(hash_table *ht, const char *const *keys,
+                            unsigned int n, void **values_out);
+
 /**
  * Delete an entry from the hash table.
  *
@@ -73,10 +343,114 @@ int hash_table_lookup(hash_table *ht, const char *key, void **value);
  */
 int hash_table_delete(hash_table *ht, const char *key);
 
+/**
+ * Delete an entry from the hash table, using a key of known length.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @param key_length number of bytes in 'key'.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_delete_n(hash_table *ht, const char *key,
+                        unsigned int key_length);
+
+/**
+ * Delete an entry from the hash table, using a string_view as the key.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_delete_view(hash_table *ht, const string_view *key);
+
+/**
+ * Retrive the number of slots in the hash table.
+ *
+ * Slot indexes passed to 'hash_table_iterator_create_range' go up to this.
+ *
+ * @param ht the hash table to access.
+ * @return number of slots otherwise, -1 otherwise
+ */
+int hash_table_capacity(hash_table *ht);
+
+/**
+ * Remove every entry, keeping the capacity for the next ones.
+ *
+ * Takes constant time whatever the capacity, slots are reset lazily as they
+ * are reused. Arena copies of long keys are not given back.
+ *
+ * @param ht hash table to be modified.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_clear(hash_table *ht);
+
+/**
+ * Presize the hash table for 'n' entries.
+ *
+ * Inserting up to 'n' entries in total then never resizes. Never shrinks the
+ * hash table, use 'hash_table_shrink_to_fit' for that.
+ *
+ * @param ht hash table to modify.
+ * @param n number of entries to make room for.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_reserve(hash_table *ht, unsigned int n);
+
+/**
+ * Resize the hash table to the smallest capacity that holds its entries.
+ *
+ * Also drops every tombstone. Useful after mass deletions.
+ *
+ * @param ht hash table to modify.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_shrink_to_fit(hash_table *ht);
+
+/**
+ * Retrieve the memory used by the entry arrays.
+ *
+ * Keys of 24 bytes or more live in separate arena blocks and are not
+ * counted.
+ *
+ * @param ht the hash table to access.
+ * @param bytes where to store the number of bytes.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_memory(hash_table *ht, uint64_t *bytes);
+
+/**
+ * Retrieve the arena memory held by dropped entry arrays.
+ *
+ * Resizing gives the old entry array back to the arena when it is the most
+ * recent allocation. Otherwise it stays in the arena until the arena is
+ * reset, and is counted here.
+ *
+ * @param ht the hash table to access.
+ * @param bytes where to store the number of bytes.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_reclaimable(hash_table *ht, uint64_t *bytes);
+
+/**
+ * Measure how far entries sit from their home group.
+ *
+ * A probe length of 1 means the entry is found in the first group of
+ * GROUP_WIDTH slots searched. Finishes any incremental resize first.
+ *
+ * @param ht hash table to inspect.
+ * @param mean_probe_length where to store the mean probe length.
+ * @param max_probe_length where to store the longest probe length.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_probe_stats(hash_table *ht, double *mean_probe_length,
+                           unsigned int *max_probe_length);
+
 /**
  * Retreive the key from the given hash table entry.
  *
- * Usedful when iterating throught the hash table.
+ * Usedful when iterating throught the hash table. Keys shorter than 24
+ * bytes live inside the entry, the pointer is only valid until the hash
+ * table is modified.
  *
  * @param entry hash table entry.
  * @param key where to store the key of entry.
@@ -84,6 +458,18 @@ int hash_table_delete(hash_table *ht, const char *key);
  */
 int hash_table_entry_key(hash_table_entry *entry, char **key);
 
+/**
+ * Retreive the key length from the given hash table entry.
+ *
+ * Borrowed keys are not always '\0' terminated, use this length instead.
+ *
+ * @param entry hash table entry.
+ * @param key_length where to store the length of the key.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_entry_key_length(hash_table_entry *entry,
+                                unsigned int *key_length);
+
 /**
  * Retreive the value from the given hash table entry.
  *
@@ -106,6 +492,37 @@ int hash_table_entry_value(hash_table_entry *entry, void **value);
  */
 int hash_table_iterator_create(hash_table_iterator **it, hash_table *table);
 
+/**
+ * Allocate necessary resources and setup, for the slots in [begin, end).
+ *
+ * Iterators over disjoint ranges can run on different threads, as long as
+ * nothing modifies the hash table meanwhile. Create them all before handing
+ * them out, creating one can modify the hash table.
+ *
+ * @param it hash table iterator to create.
+ * @param ht hash table to iterate through.
+ * @param begin_slot first slot to visit.
+ * @param end_slot one past the last slot to visit, clamped to the capacity.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_iterator_create_range(hash_table_iterator **it, hash_table *ht,
+                                     unsigned int begin_slot,
+                                     unsigned int end_slot);
+
+/**
+ * Split the slots of the hash table between 'k' iterators.
+ *
+ * The ranges are disjoint, together they cover every slot. See
+ * 'hash_table_iterator_create_range'.
+ *
+ * @param ht hash table to iterate through.
+ * @param k number of iterators to create.
+ * @param its where to store 'k' hash table iterators.
+ * @return 0 on success, 1 otherwise
+ */
+int hash_table_split_iterators(hash_table *ht, unsigned int k,
+                               hash_table_iterator **its);
+
 /**
  * Get the next entry in the hash table.
  *
@@ -0,0 +1,134 @@
+#ifndef INT_HASH_TABLE_H
+#define INT_HASH_TABLE_H
+
+#include "arena.h"
+
+#include <stdint.h>
+
+typedef struct int_hash_table_entry int_hash_table_entry;
+typedef struct int_hash_table int_hash_table;
+typedef struct int_hash_table_iterator int_hash_table_iterator;
+
+/**
+ * Allocate necessary resources and setup.
+ *
+ * Keys are stored inline in the slots, 32 bit keys are widened to 64 bits.
+ *
+ * @param ht int_hash_table to create.
+ * @param initial_capacity number of buckets before resizing
+ * @param hashfn hashing function, if set to NULL a 64 bit mixer is used.
+ * @param arena memory block for all allocations
+ * @return 0 on success, 1 otherwise
+ */
+int int_hash_table_create(int_hash_table **ht, unsigned int initial_capacity,
+                          uint64_t (*hashfn)(uint64_t), arena *arena);
+
+/**
+ * Retrive the number of entries in the hash table.
+ *
+ * @param ht the hash table to access.
+ * @return number of entries otherwise, -1 otherwise
+ */
+int int_hash_table_size(int_hash_table *ht);
+
+/**
+ * Insert an entry into the hash table.
+ *
+ * This function DOES NOT change the value of an existing entry.
+ * To update the value use 'int_hash_table_insert_or_update'.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @param value item to insert.
+ * @return 0 on success, 1 otherwise
+ */
+int int_hash_table_insert(int_hash_table *ht, uint64_t key, const void *value);
+
+/**
+ * Insert/Update an entry into the hash table.
+ *
+ * This function DOES change the value of an existing entry.
+ * To prevent this use 'int_hash_table_insert' instead.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @param value item to insert.
+ * @return 0 on success, 1 otherwise
+ */
+int int_hash_table_insert_or_update(int_hash_table *ht, uint64_t key,
+                                    void *value);
+
+/**
+ * Search for an entry in the hash table.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the hash table entry.
+ * @param value pointer used to get a reference to the entry's value.
+ * @return 0 on success, 1 otherwise
+ */
+int int_hash_table_lookup(int_hash_table *ht, uint64_t key, void **value);
+
+/**
+ * Delete an entry from the hash table.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @return 0 on success, 1 otherwise
+ */
+int int_hash_table_delete(int_hash_table *ht, uint64_t key);
+
+/**
+ * Retreive the key from the given hash table entry.
+ *
+ * Useful when iterating throught the hash table.
+ *
+ * @param entry hash table entry.
+ * @param key where to store the key of entry.
+ * @return 0 on success, 1 otherwise
+ */
+int int_hash_table_entry_key(int_hash_table_entry *entry, uint64_t *key);
+
+/**
+ * Retreive the value from the given hash table entry.
+ *
+ * Useful when iterating throught the hash table.
+ *
+ * @param entry hash table entry.
+ * @param value where to store the value of entry.
+ * @return 0 on success, 1 otherwise
+ */
+int int_hash_table_entry_value(int_hash_table_entry *entry, void **value);
+
+/**
+ * Allocate necessary resources and setup.
+ *
+ * Use to iterate through a hash table.
+ *
+ * @param it hash table iterator to create.
+ * @param ht hash table to iterate through.
+ * @return 0 on success, 1 otherwise
+ */
+int int_hash_table_iterator_create(int_hash_table_iterator **it,
+                                   int_hash_table *ht);
+
+/**
+ * Get the next entry in the hash table.
+ *
+ * @param it hash table iterator
+ * @param entry value used to hold the next entry in the hash table.
+ * @return 0 on success, 1 otherwise
+ */
+int int_hash_table_iterator_next(int_hash_table_iterator *it,
+                                 int_hash_table_entry **entry);
+
+/**
+ * Reset the hash table iterator.
+ *
+ * Use before iterating hash_table for a second time.
+ *
+ * @param it hash table iterator
+ * @return 0 on success, 1 otherwise
+ */
+int int_hash_table_iterator_reset(int_hash_table_iterator *it);
+
+#endif // INT_HASH_TABLE_H
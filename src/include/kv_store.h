@@ -0,0 +1,146 @@
+/*
+ * @file kv_store.h
+ *
+ * @brief Persistent key-value store on an append-only log, Bitcask style.
+ *
+ * Every put and delete appends a CRC-checked record to the active segment
+ * file of a directory, and an in-memory flat_hash_table maps each key to the
+ * segment and offset of its latest record. A get is one index lookup and one
+ * read. Full segments are immutable, compaction copies their live records
+ * into a new segment in the background and removes them. Each segment has a
+ * hint file listing its keys and offsets, opening a store rebuilds the index
+ * from the hints and only scans the logs that lack one.
+ */
+
+#ifndef KV_STORE_H
+#define KV_STORE_H
+
+#include "arena.h"
+
+#include <stdint.h>
+
+/**
+ * Writes reach the page cache only, a crash of the machine may lose the
+ * most recent ones. A crash of the process does not.
+ */
+#define KV_STORE_SYNC_NONE 0
+
+/**
+ * Every put and delete returns after its record is on disk.
+ */
+#define KV_STORE_SYNC_ALWAYS 1
+
+/**
+ * Records are flushed to disk every KV_STORE_GROUP_WRITES writes or after
+ * KV_STORE_GROUP_INTERVAL_MS, whichever comes first, and on 'kv_store_sync'.
+ * A background thread enforces the interval when no write follows.
+ */
+#define KV_STORE_SYNC_GROUP 2
+
+#define KV_STORE_GROUP_WRITES 1024
+#define KV_STORE_GROUP_INTERVAL_MS 10
+
+/**
+ * Longest key accepted, '\0' excluded.
+ */
+#define KV_STORE_MAX_KEY_SIZE 1024
+
+typedef struct kv_store kv_store;
+
+/**
+ * Open the store in 'directory', creating it when missing.
+ *
+ * The index is rebuilt from the segments already there. A record cut short
+ * by a crash at the end of a segment is discarded.
+ *
+ * @param store kv_store to open.
+ * @param directory where the segment files live.
+ * @param sync_mode one of the KV_STORE_SYNC_ modes.
+ * @param arena memory block for all allocations
+ * @return 0 on success, 1 otherwise
+ */
+int kv_store_open(kv_store **store, const char *directory,
+                  unsigned int sync_mode, arena *arena);
+
+/**
+ * Wait for compaction, flush the active segment and close every file.
+ *
+ * @param store the store to close.
+ * @return 0 on success, 1 otherwise
+ */
+int kv_store_close(kv_store *store);
+
+/**
+ * Retrive the number of keys in the store.
+ *
+ * @param store the store to access.
+ * @return number of keys, -1 otherwise
+ */
+int kv_store_size(kv_store *store);
+
+/**
+ * Insert or update a key.
+ *
+ * @param store the store to modify.
+ * @param key identifier used to access the data stored.
+ * @param value bytes to store.
+ * @param value_size number of bytes in 'value'.
+ * @return 0 on success, 1 otherwise
+ */
+int kv_store_put(kv_store *store, const char *key, const void *value,
+                 uint32_t value_size);
+
+/**
+ * Read the value of a key.
+ *
+ * At most 'capacity' bytes are copied, 'value_size' always receives the
+ * full size so a second call can use a larger buffer. The record checksum
+ * is verified when the whole value is read.
+ *
+ * @param store the store to search.
+ * @param key identifier used to search for.
+ * @param value where to copy the value.
+ * @param capacity number of bytes available in 'value'.
+ * @param value_size where to store the size of the value, can be NULL.
+ * @return 0 on success, 1 otherwise
+ */
+int kv_store_get(kv_store *store, const char *key, void *value,
+                 uint32_t capacity, uint32_t *value_size);
+
+/**
+ * Delete a key.
+ *
+ * @param store the store to modify.
+ * @param key identifier used to search for.
+ * @return 0 on success, 1 otherwise
+ */
+int kv_store_delete(kv_store *store, const char *key);
+
+/**
+ * Flush the records written so far to disk.
+ *
+ * @param store the store to flush.
+ * @return 0 on success, 1 otherwise
+ */
+int kv_store_sync(kv_store *store);
+
+/**
+ * Start compacting the immutable segments on a background thread.
+ *
+ * The active segment is closed first so that everything written before the
+ * call is compacted. Reads and writes continue meanwhile.
+ *
+ * @param store the store to compact.
+ * @return 0 on success, 1 otherwise
+ */
+int kv_store_compact(kv_store *store);
+
+/**
+ * Wait for the compaction started by 'kv_store_compact'.
+ *
+ * @param store the store being compacted.
+ * @return 0 on success, 1 otherwise
+ */
+int kv_store_compact_wait(kv_store *store);
+
+#endif // KV_STORE_H
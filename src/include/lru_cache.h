@@ -0,0 +1,109 @@
+/*
+ * @file lru_cache.h
+ *
+ * @brief Thread safe, fixed capacity cache with least recently used eviction.
+ *
+ * Keys are split between independent shards, each behind its own lock, so
+ * threads working on different keys rarely contend. Every shard preallocates
+ * its entries and indexes them with open addressing, and keeps them on an
+ * intrusive recency list. Inserting into a full shard evicts its least
+ * recently used entry in O(1), no memory is allocated after creation.
+ *
+ * Eviction is per shard, the cache as a whole is approximately LRU.
+ */
+
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+#include "arena.h"
+
+#include <stdint.h>
+
+typedef struct lru_cache lru_cache;
+
+/**
+ * Allocate necessary resources and setup.
+ *
+ * @param cache lru_cache to create.
+ * @param capacity max number of entries, split evenly between the shards.
+ * @param max_bytes max total size of the entries, 0 for no limit. The size
+ *        of an entry is its key length plus the size given to
+ *        'lru_cache_put'.
+ * @param max_key_length longest key the cache accepts.
+ * @param shards number of shards, rounded up to a power of 2.
+ * @param arena memory block for all allocations
+ * @return 0 on success, 1 otherwise
+ */
+int lru_cache_create(lru_cache **cache, unsigned int capacity,
+                     uint64_t max_bytes, unsigned int max_key_length,
+                     unsigned int shards, arena *arena);
+
+/**
+ * Retrive the number of entries in the cache.
+ *
+ * The result is a snapshot, other threads may change it right away.
+ *
+ * @param cache the cache to access.
+ * @return number of entries otherwise, -1 otherwise
+ */
+int lru_cache_size(lru_cache *cache);
+
+/**
+ * Lookup an entry and mark it as the most recently used.
+ *
+ * @param cache cache to search.
+ * @param key identifier used to search for.
+ * @param value where to store the value with 'key'.
+ * @return 0 on success, 1 otherwise
+ */
+int lru_cache_get(lru_cache *cache, const char *key, void **value);
+
+/**
+ * Lookup an entry without changing when it will be evicted.
+ *
+ * Not counted in the hit rate.
+ *
+ * @param cache cache to search.
+ * @param key identifier used to search for.
+ * @param value where to store the value with 'key'.
+ * @return 0 on success, 1 otherwise
+ */
+int lru_cache_peek(lru_cache *cache, const char *key, void **value);
+
+/**
+ * Insert or update an entry and mark it as the most recently used.
+ *
+ * Evicts least recently used entries of the same shard until the new one
+ * fits.
+ *
+ * @param cache cache to be modified.
+ * @param key identifier used to access the data stored.
+ * @param value item to insert.
+ * @param size bytes charged for 'value', ignored without 'max_bytes'.
+ * @return 0 on success, 1 when the key or the entry is too large
+ */
+int lru_cache_put(lru_cache *cache, const char *key, void *value,
+                  uint64_t size);
+
+/**
+ * Delete an entry.
+ *
+ * @param cache cache to be modified.
+ * @param key identifier used to search for.
+ * @return 0 on success, 1 otherwise
+ */
+int lru_cache_remove(lru_cache *cache, const char *key);
+
+/**
+ * Retrieve the counters of every shard added up.
+ *
+ * @param cache the cache to access.
+ * @param hits where to store the number of 'lru_cache_get' that found a key.
+ * @param misses where to store the number of 'lru_cache_get' that did not.
+ * @param evictions where to store the number of entries evicted.
+ * @return 0 on success, 1 otherwise
+ */
+int lru_cache_stats(lru_cache *cache, uint64_t *hits, uint64_t *misses,
+                    uint64_t *evictions);
+
+#endif // LRU_CACHE_H
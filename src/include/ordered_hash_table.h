@@ -0,0 +1,150 @@
+/*
+ * @file ordered_hash_table.h
+ *
+ * @brief Hash table that iterates in insertion order.
+ *
+ * Entries are appended to a dense array, and a sparse index of 1, 2 or 4
+ * byte positions into it is probed on lookup, the same layout as CPython's
+ * dict. Iterating only reads the entries, never the empty slots, and the
+ * order is deterministic. Updating a key keeps its position, deleting and
+ * inserting it again moves it to the end.
+ */
+
+#ifndef ORDERED_HASH_TABLE_H
+#define ORDERED_HASH_TABLE_H
+
+#include "arena.h"
+
+#include <stdint.h>
+
+typedef struct ordered_hash_table_entry ordered_hash_table_entry;
+typedef struct ordered_hash_table ordered_hash_table;
+typedef struct ordered_hash_table_iterator ordered_hash_table_iterator;
+
+/**
+ * Allocate necessary resources and setup.
+ *
+ * @param ht ordered_hash_table to create.
+ * @param initial_capacity number of entries before resizing
+ * @param arena memory block for all allocations
+ * @return 0 on success, 1 otherwise
+ */
+int ordered_hash_table_create(ordered_hash_table **ht,
+                              unsigned int initial_capacity, arena *arena);
+
+/**
+ * Retrive the number of entries in the hash table.
+ *
+ * @param ht the hash table to access.
+ * @return number of entries otherwise, -1 otherwise
+ */
+int ordered_hash_table_size(ordered_hash_table *ht);
+
+/**
+ * Insert an entry at the end of the hash table.
+ *
+ * This function DOES NOT change the value of an existing entry.
+ * To update the value use 'ordered_hash_table_insert_or_update'.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @param value item to insert.
+ * @return 0 on success, 1 otherwise
+ */
+int ordered_hash_table_insert(ordered_hash_table *ht, const char *key,
+                              const void *value);
+
+/**
+ * Insert an entry at the end, or update it where it is.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to access the data stored.
+ * @param value item to insert.
+ * @return 0 on success, 1 otherwise
+ */
+int ordered_hash_table_insert_or_update(ordered_hash_table *ht,
+                                        const char *key, const void *value);
+
+/**
+ * Lookup an entry in the hash table.
+ *
+ * @param ht hash table to search.
+ * @param key identifier used to search for.
+ * @param value where to store the value with 'key'.
+ * @return 0 on success, 1 otherwise
+ */
+int ordered_hash_table_lookup(ordered_hash_table *ht, const char *key,
+                              void **value);
+
+/**
+ * Delete an entry.
+ *
+ * @param ht hash table to be modified.
+ * @param key identifier used to search for.
+ * @return 0 on success, 1 otherwise
+ */
+int ordered_hash_table_delete(ordered_hash_table *ht, const char *key);
+
+/**
+ * Retrieve the memory used by the entries and the index.
+ *
+ * Keys are copied into separate arena blocks and are not counted.
+ *
+ * @param ht the hash table to access.
+ * @param bytes where to store the number of bytes.
+ * @return 0 on success, 1 otherwise
+ */
+int ordered_hash_table_memory(ordered_hash_table *ht, uint64_t *bytes);
+
+/**
+ * Retreive the key from the given hash table entry.
+ *
+ * @param entry the hash table entry to access.
+ * @param key where to store the key.
+ * @return 0 on success, 1 otherwise
+ */
+int ordered_hash_table_entry_key(ordered_hash_table_entry *entry, char **key);
+
+/**
+ * Retreive the value from the given hash table entry.
+ *
+ * @param entry the hash table entry to access.
+ * @param value where to store the value.
+ * @return 0 on success, 1 otherwise
+ */
+int ordered_hash_table_entry_value(ordered_hash_table_entry *entry,
+                                   void **value);
+
+/**
+ * Allocate necessary resources and setup.
+ *
+ * The iterator visits the entries in insertion order.
+ *
+ * @param it hash table iterator to create.
+ * @param ht hash table to iterate through.
+ * @return 0 on success, 1 otherwise
+ */
+int ordered_hash_table_iterator_create(ordered_hash_table_iterator **it,
+                                       ordered_hash_table *ht);
+
+/**
+ * Get the next entry in the hash table.
+ *
+ * @param it hash table iterator
+ * @param entry value used to hold the next entry in the hash table.
+ * @return 0 on success, 1 otherwise
+ */
+int ordered_hash_table_iterator_next(ordered_hash_table_iterator *it,
+                                     ordered_hash_table_entry **entry);
+
+/**
+ * Reset the hash table iterator.
+ *
+ * Use before iterating hash_table for a second time.
+ *
+ * @param it hash table iterator
+ * @return 0 on success, 1 otherwise
+ */
+int ordered_hash_table_iterator_reset(ordered_hash_table_iterator *it);
+
+#endif // ORDERED_HASH_TABLE_H
@@ -0,0 +1,440 @@
+#include "int_hash_table.h"
+#include "hash_group.h"
+#include "utils.h"
+
+#include <stdalign.h>
+#include <stdio.h>
+#include <string.h>
+
+#define INT_HASH_TABLE_LOAD_FACTOR 0.875
+
+/**
+ * Below this load, reaching INT_HASH_TABLE_LOAD_FACTOR is mostly tombstones
+ * and rehashing at the same capacity frees enough room(25/32).
+ */
+#define INT_HASH_TABLE_PURGE_LOAD_FACTOR 0.78125
+#define FALSE 0
+
+struct int_hash_table_entry {
+  uint64_t key;
+  void *value;
+};
+
+struct int_hash_table {
+  int_hash_table_entry *entries; // array of entries
+  int8_t *ctrl;                  // one tag per entry
+  uint64_t (*hashfn)(uint64_t);  // used for hash code
+  arena *arena;                  // memory block for allocations
+  unsigned int size;             // number of entries
+  unsigned int tombstones;       // number of deleted entries
+  unsigned int capacity;         // number of buckets
+};
+
+struct int_hash_table_iterator {
+  int_hash_table_entry *entries;
+  int8_t *ctrl;
+  unsigned int size;
+  unsigned int capacity;
+  unsigned int index; // current index
+};
+
+/**
+ * 64 bit finalizer from MurmurHash3.
+ *
+ * Every input bit affects every output bit, so sequential ids spread across
+ * both the probe start and the control tag.
+ *
+ * source:
+ * https://github.com/aappleby/smhasher/blob/master/src/MurmurHash3.cpp
+ */
+static uint64_t hash(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xFF51AFD7ED558CCDULL;
+  key ^= key >> 33;
+  key *= 0xC4CEB9FE1A85EC53ULL;
+  key ^= key >> 33;
+
+  return key;
+}
+
+/**
+ * Retreive the index of a hash table entry.
+ *
+ * @param ht hash table to search.
+ * @param key identifier used to search for.
+ * @param hash_code hash code of 'key'.
+ * @param free_index where to store the first empty/deleted index on the probe
+ *        sequence, can be NULL.
+ * @return index of the entry with 'key', -1 otherwise
+ */
+static long find_entry(const int_hash_table *ht, uint64_t key,
+                       uint64_t hash_code, long *free_index) {
+  const unsigned int mask = ht->capacity - 1;
+  const int8_t tag = H2(hash_code);
+  unsigned int position = H1(hash_code) & mask;
+  unsigned int stride = 0;
+
+  if (free_index != NULL) {
+    *free_index = -1;
+  }
+
+  while (1) {
+    const int8_t *group = ht->ctrl + position;
+
+    for (uint32_t match = group_match(group, tag); match != 0;
+         match &= match - 1) {
+      const unsigned int index = (position + __builtin_ctz(match)) & mask;
+
+      if (ht->entries[index].key == key) {
+        return index;
+      }
+    }
+
+    if (free_index != NULL && *free_index == -1) {
+      uint32_t free = group_match_free(group);
+
+      if (free != 0) {
+        *free_index = (position + __builtin_ctz(free)) & mask;
+      }
+    }
+
+    if (group_match(group, CTRL_EMPTY) != 0) {
+      return -1;
+    }
+
+    stride += GROUP_WIDTH;
+    position = (position + stride) & mask;
+  }
+}
+
+/**
+ * Bytes of an entry array of 'capacity' slots, its tags included.
+ */
+static inline uint64_t slots_size(unsigned int capacity) {
+  return (uint64_t)capacity * (sizeof(int_hash_table_entry) + 1) + GROUP_WIDTH;
+}
+
+/**
+ * Allocate entries and control tags, with every slot marked empty.
+ *
+ * @param ht hash table to modify.
+ * @param capacity number of slots to allocate.
+ * @return 0 on success, 1 otherwise
+ */
+static int allocate_slots(int_hash_table *ht, unsigned int capacity) {
+  const uint64_t entries_size =
+      (uint64_t)capacity * sizeof(int_hash_table_entry);
+  uint8_t *block = arena_alloc(ht->arena, slots_size(capacity),
+                               alignof(int_hash_table_entry), FALSE);
+
+  if (block == NULL) {
+    return 1;
+  }
+
+  ht->entries = (int_hash_table_entry *)block;
+  ht->ctrl = (int8_t *)(block + entries_size);
+  ht->capacity = capacity;
+  ht->tombstones = 0;
+
+  memset(ht->ctrl, (uint8_t)CTRL_EMPTY, capacity + GROUP_WIDTH);
+
+  return 0;
+}
+
+/**
+ * Give back the dropped slots when they are the last arena allocation.
+ *
+ * When the current slots directly follow them, both are given back and the
+ * current ones slide down to the start of the dropped ones.
+ *
+ * @param ht hash table to modifiy.
+ * @param entries the dropped entries, followed by their tags.
+ * @param capacity number of buckets in 'entries'.
+ */
+static void release_slots(int_hash_table *ht, int_hash_table_entry *entries,
+                          unsigned int capacity) {
+  uint8_t *block = (uint8_t *)entries;
+  const uint64_t size = slots_size(capacity);
+  const uint64_t current_size = slots_size(ht->capacity);
+
+  if (block + size == (uint8_t *)ht->entries &&
+      arena_free_last(ht->arena, ht->entries, current_size) == 0) {
+    arena_free_last(ht->arena, block, size);
+    block = arena_alloc(ht->arena, current_size,
+                        alignof(int_hash_table_entry), FALSE);
+    memmove(block, ht->entries, current_size);
+
+    ht->entries = (int_hash_table_entry *)block;
+    ht->ctrl = (int8_t *)(block + (uint64_t)ht->capacity *
+                                      sizeof(int_hash_table_entry));
+    return;
+  }
+
+  arena_free_last(ht->arena, block, size);
+}
+
+/**
+ * Rehash every entry into a new array, dropping the tombstones.
+ *
+ * @param ht hash table to modifiy.
+ * @param capacity the new number of buckets.
+ * @return 0 on success, 1 otherwise
+ */
+static int int_hash_table_resize(int_hash_table *ht, unsigned int capacity) {
+  int_hash_table_entry *old_entries = ht->entries;
+  int8_t *old_ctrl = ht->ctrl;
+  const unsigned int old_capacity = ht->capacity;
+
+  if (allocate_slots(ht, capacity) == 1) {
+    return 1;
+  }
+
+  for (unsigned int i = 0; i < old_capacity; i++) {
+    if (old_ctrl[i] < 0) {
+      continue;
+    }
+
+    const uint64_t hash_code = ht->hashfn(old_entries[i].key);
+    const unsigned int index =
+        find_free_slot(ht->ctrl, ht->capacity, hash_code);
+
+    set_ctrl(ht->ctrl, ht->capacity, index, H2(hash_code));
+    ht->entries[index] = old_entries[i];
+  }
+
+  release_slots(ht, old_entries, old_capacity);
+
+  return 0;
+}
+
+/**
+ *  Find the entry for 'key', claiming a free slot when it is absent.
+ *
+ *  @param ht hash_table to modify
+ *  @param key the hash table entry key to search
+ *  @param is_new_key where to store whether 'key' was absent.
+ *  @return hash table entry with 'key', NULL otherwise
+ */
+static int_hash_table_entry *handle_pre_insertion(int_hash_table *ht,
+                                                  uint64_t key,
+                                                  int *is_new_key) {
+  if (ht == NULL) {
+    return NULL;
+  }
+
+  if (ht->entries == NULL && allocate_slots(ht, ht->capacity) == 1) {
+    return NULL;
+  }
+
+  const uint64_t hash_code = ht->hashfn(key);
+  long free_index;
+  long index = find_entry(ht, key, hash_code, &free_index);
+
+  if (index != -1) {
+    *is_new_key = 0;
+    return &ht->entries[index];
+  }
+
+  // Rehash at the same capacity when it is mostly tombstones.
+  if (ht->size + ht->tombstones + 1 >
+      ht->capacity * INT_HASH_TABLE_LOAD_FACTOR) {
+    const unsigned int capacity =
+        ht->size + 1 > ht->capacity * INT_HASH_TABLE_PURGE_LOAD_FACTOR
+            ? ht->capacity << 1
+            : ht->capacity;
+
+    if (int_hash_table_resize(ht, capacity) == 1) {
+      return NULL;
+    }
+
+    free_index = find_free_slot(ht->ctrl, ht->capacity, hash_code);
+  }
+
+  if (ht->ctrl[free_index] == CTRL_DELETED) {
+    ht->tombstones--;
+  }
+
+  set_ctrl(ht->ctrl, ht->capacity, free_index, H2(hash_code));
+  ht->entries[free_index].key = key;
+  ht->size++;
+  *is_new_key = 1;
+
+  return &ht->entries[free_index];
+}
+
+int int_hash_table_create(int_hash_table **ht, unsigned int initial_capacity,
+                          uint64_t (*hashfn)(uint64_t), arena *arena) {
+  ASSERT(arena != NULL, "arena MUST be provided");
+
+  if ((*ht = arena_alloc(arena, sizeof(int_hash_table),
+                         alignof(int_hash_table), FALSE)) == NULL) {
+    return 1;
+  }
+
+  (*ht)->capacity = initial_capacity < GROUP_WIDTH
+                        ? GROUP_WIDTH
+                        : (unsigned int)ROUND_POW2(initial_capacity);
+  (*ht)->arena = arena;
+  (*ht)->size = 0;
+  (*ht)->tombstones = 0;
+  (*ht)->hashfn = hashfn == NULL ? hash : hashfn;
+  (*ht)->entries = NULL;
+  (*ht)->ctrl = NULL;
+
+  return 0;
+}
+
+int int_hash_table_insert(int_hash_table *ht, uint64_t key, const void *value) {
+  int is_new_key;
+  int_hash_table_entry *entry = handle_pre_insertion(ht, key, &is_new_key);
+
+  if (entry == NULL || !is_new_key) {
+    return 1;
+  }
+
+  entry->value = (void *)value;
+
+  return 0;
+}
+
+int int_hash_table_insert_or_update(int_hash_table *ht, uint64_t key,
+                                    void *value) {
+  int is_new_key;
+  int_hash_table_entry *entry = handle_pre_insertion(ht, key, &is_new_key);
+
+  if (entry == NULL) {
+    return 1;
+  }
+
+  entry->value = value;
+
+  return 0;
+}
+
+int int_hash_table_lookup(int_hash_table *ht, uint64_t key, void **value) {
+  if (ht == NULL || ht->size == 0) {
+    return 1;
+  }
+
+  long index = find_entry(ht, key, ht->hashfn(key), NULL);
+
+  if (index == -1) {
+    *value = NULL;
+    return 1;
+  }
+
+  *value = ht->entries[index].value;
+
+  return 0;
+}
+
+int int_hash_table_delete(int_hash_table *ht, uint64_t key) {
+  if (ht == NULL || ht->size == 0) {
+    return 1;
+  }
+
+  long index = find_entry(ht, key, ht->hashfn(key), NULL);
+
+  if (index == -1) {
+    return 1;
+  }
+
+  // Only leave a tombstone when a probe could have passed this slot.
+  if (was_never_full(ht->ctrl, ht->capacity, index)) {
+    set_ctrl(ht->ctrl, ht->capacity, index, CTRL_EMPTY);
+  } else {
+    set_ctrl(ht->ctrl, ht->capacity, index, CTRL_DELETED);
+    ht->tombstones++;
+  }
+
+  ht->size--;
+  ht->entries[index].value = NULL;
+
+  return 0;
+}
+
+int int_hash_table_size(int_hash_table *ht) {
+  if (ht == NULL) {
+    return -1;
+  }
+
+  return ht->size;
+}
+
+int int_hash_table_entry_key(int_hash_table_entry *entry, uint64_t *key) {
+  if (entry == NULL) {
+    *key = 0;
+    return 1;
+  }
+  *key = entry->key;
+  return 0;
+}
+
+int int_hash_table_entry_value(int_hash_table_entry *entry, void **value) {
+  if (entry == NULL) {
+    *value = NULL;
+    return 1;
+  }
+  *value = entry->value;
+  return 0;
+}
+
+int int_hash_table_iterator_create(int_hash_table_iterator **it,
+                                   int_hash_table *ht) {
+  if (ht == NULL || ht->size == 0) {
+    return 1;
+  }
+
+  ASSERT(ht->arena != NULL, "arena MUST be provided");
+
+  if (((*it) = arena_alloc(ht->arena, sizeof(int_hash_table_iterator),
+                           alignof(int_hash_table_iterator), FALSE)) == NULL) {
+    return 1;
+  }
+
+  (*it)->entries = ht->entries;
+  (*it)->ctrl = ht->ctrl;
+  (*it)->size = ht->size;
+  (*it)->capacity = ht->capacity;
+  (*it)->index = 0;
+
+  return 0;
+}
+
+int int_hash_table_iterator_next(int_hash_table_iterator *it,
+                                 int_hash_table_entry **entry) {
+  if (it == NULL || it->size == 0) {
+    return 1;
+  }
+
+  // Skip empty entries and tombstones a group of tags at a time.
+  while (it->index < it->capacity) {
+    const unsigned int remaining = it->capacity - it->index;
+    uint32_t full = group_match_full(it->ctrl + it->index);
+
+    // The tags past the end mirror the first group.
+    if (remaining < GROUP_WIDTH) {
+      full &= (1U << remaining) - 1;
+    }
+
+    if (full != 0) {
+      it->index += __builtin_ctz(full);
+      *entry = &it->entries[it->index++];
+      return 0;
+    }
+
+    it->index += GROUP_WIDTH;
+  }
+
+  return 1;
+}
+
+int int_hash_table_iterator_reset(int_hash_table_iterator *it) {
+  if (it == NULL) {
+    return 1;
+  }
+
+  it->index = 0;
+
+  return 0;
+}
@@ -0,0 +1,1115 @@
+#include "kv_store.h"
+#include "flat_hash_table.h"
+#include "utils.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+/**
+ * The active segment is closed once it grows past this size.
+ */
+#define KV_STORE_SEGMENT_SIZE (64ULL << 20)
+
+/**
+ * Compaction and recovery stream records through a buffer of this size.
+ */
+#define COPY_BUFFER_SIZE (64 * 1024)
+
+#define INITIAL_SEGMENTS 8
+#define INITIAL_INDEX_CAPACITY 1024
+#define TOMBSTONE UINT32_MAX
+#define FALSE 0
+
+/**
+ * Record header in a segment, the key and the value follow it. 'crc' covers
+ * 'key_size', 'value_size', the key and the value. A delete appends a record
+ * with 'value_size' set to TOMBSTONE and no value.
+ */
+typedef struct record_header {
+  uint32_t crc;
+  uint32_t key_size;
+  uint32_t value_size;
+} record_header;
+
+/**
+ * Hint entry, the key follows it. 'crc' covers the rest of the entry and the
+ * key.
+ */
+typedef struct hint_header {
+  uint32_t crc;
+  uint32_t key_size;
+  uint32_t value_size;
+  uint32_t reserved;
+  uint64_t offset; // of the record in the segment
+} hint_header;
+
+/**
+ * Value of a key in the index.
+ */
+typedef struct location {
+  uint64_t offset;
+  uint32_t segment;
+  uint32_t value_size;
+} location;
+
+typedef struct segment {
+  uint64_t size;
+  uint32_t id;
+  int fd;
+} segment;
+
+struct kv_store {
+  pthread_mutex_t lock;        // everything below and the arena
+  flat_hash_table *index;      // key -> location of its latest record
+  segment *segments;           // sorted by id, the active one is last
+  unsigned int segment_count;
+  unsigned int segment_capacity;
+  unsigned int next_id;        // of the next segment to create
+  FILE *hint;                  // hint of the active segment
+  unsigned int sync_mode;
+  unsigned int unsynced;       // writes since the last fsync
+  uint64_t last_sync;          // in milliseconds
+  pthread_t flusher;           // KV_STORE_SYNC_GROUP only
+  pthread_cond_t flusher_wake; // signalled on close
+  int closing;                 // the flusher has to exit
+  pthread_t compaction;
+  int compacting;              // a compaction was started
+  int compaction_joinable;     // it runs on 'compaction'
+  int compaction_result;
+  uint32_t compaction_id;      // of the segment compaction writes
+  FILE *compaction_hint;
+  char *copy_buffer;           // COPY_BUFFER_SIZE, owned by compaction
+  char *directory;
+  arena *arena;
+};
+
+static uint32_t crc_table[256];
+static int crc_hardware;
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void) {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = crc & 1 ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+    }
+    crc_table[i] = crc;
+  }
+
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  crc_hardware = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_hardware(uint32_t crc, const unsigned char *bytes, uint64_t size) {
+  uint64_t wide = crc;
+
+  for (; size >= 8; bytes += 8, size -= 8) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    wide = _mm_crc32_u64(wide, word);
+  }
+
+  crc = (uint32_t)wide;
+  for (; size > 0; bytes++, size--) {
+    crc = _mm_crc32_u8(crc, *bytes);
+  }
+
+  return crc;
+}
+#endif
+
+/**
+ * CRC-32C of 'data', continuing from 'crc', 0 to start.
+ */
+static uint32_t crc32c(uint32_t crc, const void *data, uint64_t size) {
+  const unsigned char *bytes = data;
+  crc = ~crc;
+
+#if defined(__x86_64__)
+  if (crc_hardware) {
+    return ~crc32c_hardware(crc, bytes, size);
+  }
+#endif
+
+  for (; size > 0; bytes++, size--) {
+    crc = crc_table[(crc ^ *bytes) & 0xFF] ^ (crc >> 8);
+  }
+
+  return ~crc;
+}
+
+static uint32_t record_crc(const record_header *header, const char *key,
+                           const void *value) {
+  uint32_t crc = crc32c(0, &header->key_size, 2 * sizeof(uint32_t));
+  crc = crc32c(crc, key, header->key_size);
+
+  if (header->value_size != TOMBSTONE) {
+    crc = crc32c(crc, value, header->value_size);
+  }
+
+  return crc;
+}
+
+static uint64_t record_size(uint32_t key_size, uint32_t value_size) {
+  return sizeof(record_header) + key_size +
+         (value_size == TOMBSTONE ? 0 : (uint64_t)value_size);
+}
+
+static uint64_t now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void segment_path(kv_store *store, uint32_t id, const char *suffix,
+                         char *path) {
+  snprintf(path, PATH_MAX, "%s/%010u%s", store->directory, id, suffix);
+}
+
+static int sync_directory(kv_store *store) {
+  int fd = open(store->directory, O_RDONLY | O_DIRECTORY);
+  if (fd == -1) {
+    return 1;
+  }
+
+  int result = fsync(fd) == 0 ? 0 : 1;
+  close(fd);
+  return result;
+}
+
+static segment *find_segment(kv_store *store, uint32_t id) {
+  unsigned int low = 0;
+  unsigned int high = store->segment_count;
+
+  while (low < high) {
+    unsigned int middle = low + (high - low) / 2;
+
+    if (store->segments[middle].id < id) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  return low < store->segment_count && store->segments[low].id == id
+             ? &store->segments[low]
+             : NULL;
+}
+
+static int add_segment(kv_store *store, uint32_t id, int fd, uint64_t size) {
+  if (store->segment_count == store->segment_capacity) {
+    segment *segments = arena_realloc(
+        store->arena, store->segments,
+        store->segment_capacity * sizeof(segment),
+        store->segment_capacity * 2 * sizeof(segment), alignof(segment), FALSE);
+
+    if (segments == NULL) {
+      return 1;
+    }
+
+    store->segments = segments;
+    store->segment_capacity *= 2;
+  }
+
+  unsigned int index = store->segment_count;
+  while (index > 0 && store->segments[index - 1].id > id) {
+    store->segments[index] = store->segments[index - 1];
+    index--;
+  }
+
+  store->segments[index] = (segment){.size = size, .id = id, .fd = fd};
+  store->segment_count++;
+  return 0;
+}
+
+/**
+ * Close and delete the files of a segment, and forget it.
+ */
+static void remove_segment(kv_store *store, segment *s) {
+  char path[PATH_MAX];
+
+  close(s->fd);
+  segment_path(store, s->id, ".log", path);
+  unlink(path);
+  segment_path(store, s->id, ".hint", path);
+  unlink(path);
+
+  const unsigned int index = s - store->segments;
+  memmove(s, s + 1, (store->segment_count - index - 1) * sizeof(segment));
+  store->segment_count--;
+}
+
+static int write_hint(FILE *hint, const char *key, uint32_t key_size,
+                      uint32_t value_size, uint64_t offset) {
+  hint_header header = {.key_size = key_size,
+                        .value_size = value_size,
+                        .reserved = 0,
+                        .offset = offset};
+  header.crc = crc32c(0, &header.key_size,
+                      sizeof(header) - offsetof(hint_header, key_size));
+  header.crc = crc32c(header.crc, key, key_size);
+
+  return fwrite(&header, sizeof(header), 1, hint) == 1 &&
+                 fwrite(key, 1, key_size, hint) == key_size
+             ? 0
+             : 1;
+}
+
+/**
+ * Flush a hint to disk and give it its final name.
+ */
+static int publish_hint(kv_store *store, uint32_t id, FILE *hint) {
+  char path[PATH_MAX];
+  char final_path[PATH_MAX];
+  int result = fflush(hint) == 0 && fsync(fileno(hint)) == 0 ? 0 : 1;
+
+  fclose(hint);
+  segment_path(store, id, ".hint.tmp", path);
+
+  if (result == 1) {
+    unlink(path);
+    return 1;
+  }
+
+  segment_path(store, id, ".hint", final_path);
+  return rename(path, final_path) == 0 ? 0 : 1;
+}
+
+/**
+ * Create a new active segment and its hint.
+ */
+static int open_active(kv_store *store) {
+  char path[PATH_MAX];
+  const uint32_t id = store->next_id;
+
+  segment_path(store, id, ".log", path);
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    return 1;
+  }
+
+  // Synced records are lost with the segment if its entry is not on disk.
+  segment_path(store, id, ".hint.tmp", path);
+  FILE *hint = sync_directory(store) == 0 ? fopen(path, "wb") : NULL;
+
+  if (hint == NULL || add_segment(store, id, fd, 0) == 1) {
+    if (hint != NULL) {
+      fclose(hint);
+    }
+    unlink(path);
+    segment_path(store, id, ".log", path);
+    unlink(path);
+    close(fd);
+    return 1;
+  }
+
+  store->next_id++;
+  store->hint = hint;
+  return 0;
+}
+
+/**
+ * Make a former active segment immutable, or drop it when it is empty.
+ */
+static int finish_segment(kv_store *store, uint32_t id, FILE *hint) {
+  segment *s = find_segment(store, id);
+
+  if (s->size == 0) {
+    char path[PATH_MAX];
+    fclose(hint);
+    segment_path(store, id, ".hint.tmp", path);
+    unlink(path);
+    remove_segment(store, s);
+    return 0;
+  }
+
+  if (fdatasync(s->fd) != 0) {
+    fclose(hint);
+    return 1;
+  }
+
+  return publish_hint(store, id, hint);
+}
+
+/**
+ * Switch writes to a new segment.
+ */
+static int rotate(kv_store *store) {
+  const uint32_t id = store->segments[store->segment_count - 1].id;
+  FILE *hint = store->hint;
+
+  if (open_active(store) == 1) {
+    return 1;
+  }
+
+  return finish_segment(store, id, hint);
+}
+
+static int flush_writes(kv_store *store) {
+  store->unsynced = 0;
+  store->last_sync = now_ms();
+  return fdatasync(store->segments[store->segment_count - 1].fd) == 0 ? 0 : 1;
+}
+
+/**
+ * Flush the writes of KV_STORE_SYNC_GROUP left unsynced for
+ * KV_STORE_GROUP_INTERVAL_MS when no later write does it.
+ */
+static void *flush_periodically(void *arg) {
+  kv_store *store = arg;
+  pthread_mutex_lock(&store->lock);
+
+  while (!store->closing) {
+    const uint64_t now = now_ms();
+    uint64_t wait = KV_STORE_GROUP_INTERVAL_MS;
+
+    if (store->unsynced > 0) {
+      if (now - store->last_sync >= KV_STORE_GROUP_INTERVAL_MS) {
+        // A failure shows up again on the next write or sync.
+        flush_writes(store);
+      } else {
+        wait = store->last_sync + KV_STORE_GROUP_INTERVAL_MS - now;
+      }
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += (long)wait * 1000000;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000;
+    deadline.tv_nsec %= 1000000000;
+    pthread_cond_timedwait(&store->flusher_wake, &store->lock, &deadline);
+  }
+
+  pthread_mutex_unlock(&store->lock);
+  return NULL;
+}
+
+/**
+ * Point the index at the record in 'at', or drop the key for a tombstone.
+ */
+static int apply(kv_store *store, const char *key, const location *at) {
+  if (at->value_size == TOMBSTONE) {
+    return flat_hash_table_delete(store->index, key);
+  }
+
+  return flat_hash_table_insert_or_update(store->index, key, at);
+}
+
+/**
+ * Append a record to the active segment and its hint, and apply it to the
+ * index.
+ *
+ * Once the record is in the segment a reopen would see it, so the index is
+ * updated even when writing the hint or syncing fails afterwards. A hint
+ * left damaged fails its checksum on open, and the log is scanned instead.
+ */
+static int append_record(kv_store *store, const char *key, uint32_t key_size,
+                         const void *value, uint32_t value_size,
+                         location *at) {
+  segment *active = &store->segments[store->segment_count - 1];
+  record_header header = {.key_size = key_size, .value_size = value_size};
+  header.crc = record_crc(&header, key, value);
+
+  struct iovec parts[3] = {
+      {.iov_base = &header, .iov_len = sizeof(header)},
+      {.iov_base = (void *)key, .iov_len = key_size},
+      {.iov_base = (void *)value,
+       .iov_len = value_size == TOMBSTONE ? 0 : value_size},
+  };
+
+  // A failed write leaves 'size' alone, the next record overwrites it.
+  const uint64_t size = record_size(key_size, value_size);
+  if (pwritev(active->fd, parts, 3, active->size) != (ssize_t)size) {
+    return 1;
+  }
+
+  *at = (location){
+      .offset = active->size, .segment = active->id, .value_size = value_size};
+  active->size += size;
+
+  int result = apply(store, key, at);
+  result |= write_hint(store->hint, key, key_size, value_size, at->offset);
+
+  if (store->sync_mode == KV_STORE_SYNC_ALWAYS ||
+      (store->sync_mode == KV_STORE_SYNC_GROUP &&
+       (++store->unsynced >= KV_STORE_GROUP_WRITES ||
+        now_ms() - store->last_sync >= KV_STORE_GROUP_INTERVAL_MS))) {
+    result |= flush_writes(store);
+  }
+
+  // Failing to rotate keeps writing to the current segment.
+  if (active->size >= KV_STORE_SEGMENT_SIZE) {
+    rotate(store);
+  }
+
+  return result;
+}
+
+/**
+ * Rebuild the index of a segment from its hint.
+ *
+ * Valid only if the entries cover the whole segment, a partly applied hint
+ * is harmless since the log is then replayed in the same order.
+ */
+static int load_hint(kv_store *store, segment *s) {
+  char path[PATH_MAX];
+  char key[KV_STORE_MAX_KEY_SIZE + 1];
+  hint_header header;
+  uint64_t end = 0;
+
+  segment_path(store, s->id, ".hint", path);
+  FILE *hint = fopen(path, "rb");
+  if (hint == NULL) {
+    return 1;
+  }
+
+  while (fread(&header, sizeof(header), 1, hint) == 1) {
+    if (header.key_size > KV_STORE_MAX_KEY_SIZE || header.offset != end ||
+        fread(key, 1, header.key_size, hint) != header.key_size) {
+      break;
+    }
+
+    uint32_t crc = crc32c(0, &header.key_size,
+                          sizeof(header) - offsetof(hint_header, key_size));
+    if (crc32c(crc, key, header.key_size) != header.crc) {
+      break;
+    }
+
+    end += record_size(header.key_size, header.value_size);
+    if (end > s->size) {
+      break;
+    }
+
+    key[header.key_size] = '\0';
+    apply(store, key,
+          &(location){.offset = header.offset,
+                      .segment = s->id,
+                      .value_size = header.value_size});
+  }
+
+  const int complete = feof(hint) && end == s->size;
+  fclose(hint);
+  return complete ? 0 : 1;
+}
+
+/**
+ * Rebuild the index of a segment from its records and write its hint.
+ *
+ * The segment is truncated at the first record that is incomplete or fails
+ * its checksum, what a crash in the middle of a write leaves behind.
+ */
+static int scan_log(kv_store *store, segment *s) {
+  char path[PATH_MAX];
+  char key[KV_STORE_MAX_KEY_SIZE + 1];
+  record_header header;
+  uint64_t offset = 0;
+
+  segment_path(store, s->id, ".log", path);
+  FILE *log = fopen(path, "rb");
+  if (log == NULL) {
+    return 1;
+  }
+
+  segment_path(store, s->id, ".hint.tmp", path);
+  FILE *hint = fopen(path, "wb");
+  if (hint == NULL) {
+    fclose(log);
+    return 1;
+  }
+
+  while (fread(&header, sizeof(header), 1, log) == 1) {
+    if (header.key_size > KV_STORE_MAX_KEY_SIZE ||
+        fread(key, 1, header.key_size, log) != header.key_size) {
+      break;
+    }
+
+    uint32_t crc = crc32c(0, &header.key_size, 2 * sizeof(uint32_t));
+    crc = crc32c(crc, key, header.key_size);
+
+    uint64_t remaining = header.value_size == TOMBSTONE ? 0 : header.value_size;
+    while (remaining > 0) {
+      const size_t chunk =
+          remaining < COPY_BUFFER_SIZE ? remaining : COPY_BUFFER_SIZE;
+
+      if (fread(store->copy_buffer, 1, chunk, log) != chunk) {
+        break;
+      }
+
+      crc = crc32c(crc, store->copy_buffer, chunk);
+      remaining -= chunk;
+    }
+
+    if (remaining > 0 || crc != header.crc) {
+      break;
+    }
+
+    key[header.key_size] = '\0';
+    apply(store, key,
+          &(location){.offset = offset,
+                      .segment = s->id,
+                      .value_size = header.value_size});
+    write_hint(hint, key, header.key_size, header.value_size, offset);
+    offset += record_size(header.key_size, header.value_size);
+  }
+
+  fclose(log);
+
+  if (offset < s->size) {
+    if (ftruncate(s->fd, offset) != 0) {
+      fclose(hint);
+      unlink(path);
+      return 1;
+    }
+    s->size = offset;
+  }
+
+  return publish_hint(store, s->id, hint);
+}
+
+/**
+ * Register every segment in the directory, drop unfinished hints.
+ */
+static int list_segments(kv_store *store) {
+  char path[PATH_MAX];
+  DIR *directory = opendir(store->directory);
+
+  if (directory == NULL) {
+    return 1;
+  }
+
+  int result = 0;
+  struct dirent *file;
+
+  while (result == 0 && (file = readdir(directory)) != NULL) {
+    unsigned int id;
+    char suffix[16];
+
+    if (strlen(file->d_name) < 14 ||
+        sscanf(file->d_name, "%10u%15s", &id, suffix) != 2) {
+      continue;
+    }
+
+    if (strcmp(suffix, ".hint.tmp") == 0) {
+      segment_path(store, id, ".hint.tmp", path);
+      unlink(path);
+      continue;
+    }
+
+    if (strcmp(suffix, ".log") != 0) {
+      continue;
+    }
+
+    struct stat info;
+    segment_path(store, id, ".log", path);
+    int fd = open(path, O_RDWR);
+
+    if (fd == -1 || fstat(fd, &info) != 0 ||
+        add_segment(store, id, fd, info.st_size) == 1) {
+      if (fd != -1) {
+        close(fd);
+      }
+      result = 1;
+    } else if (id >= store->next_id) {
+      store->next_id = id + 1;
+    }
+  }
+
+  closedir(directory);
+  return result;
+}
+
+int kv_store_open(kv_store **store, const char *directory,
+                  unsigned int sync_mode, arena *arena) {
+  ASSERT(arena != NULL, "arena MUST be provided");
+
+  if (store == NULL || directory == NULL || sync_mode > KV_STORE_SYNC_GROUP ||
+      strlen(directory) + 32 > PATH_MAX) {
+    return 1;
+  }
+
+  pthread_once(&crc_once, crc_init);
+
+  if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+    return 1;
+  }
+
+  kv_store *s = arena_alloc(arena, sizeof(kv_store), alignof(kv_store), 1);
+  if (s == NULL) {
+    return 1;
+  }
+
+  const size_t directory_size = strlen(directory) + 1;
+  s->arena = arena;
+  s->sync_mode = sync_mode;
+  s->segment_capacity = INITIAL_SEGMENTS;
+  s->directory = arena_alloc(arena, directory_size, alignof(char), FALSE);
+  s->copy_buffer = arena_alloc(arena, COPY_BUFFER_SIZE, 64, FALSE);
+  s->segments = arena_alloc(arena, INITIAL_SEGMENTS * sizeof(segment),
+                            alignof(segment), FALSE);
+
+  if (s->directory == NULL || s->copy_buffer == NULL || s->segments == NULL ||
+      flat_hash_table_create(&s->index, INITIAL_INDEX_CAPACITY,
+                             sizeof(location), arena) == 1) {
+    return 1;
+  }
+
+  memcpy(s->directory, directory, directory_size);
+
+  if (list_segments(s) == 1) {
+    goto fail;
+  }
+
+  for (unsigned int i = 0; i < s->segment_count; i++) {
+    if (load_hint(s, &s->segments[i]) == 1 &&
+        scan_log(s, &s->segments[i]) == 1) {
+      goto fail;
+    }
+  }
+
+  if (open_active(s) == 1) {
+    goto fail;
+  }
+
+  s->last_sync = now_ms();
+  pthread_mutex_init(&s->lock, NULL);
+
+  if (sync_mode == KV_STORE_SYNC_GROUP) {
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&s->flusher_wake, &attributes);
+    pthread_condattr_destroy(&attributes);
+
+    if (pthread_create(&s->flusher, NULL, flush_periodically, s) != 0) {
+      pthread_cond_destroy(&s->flusher_wake);
+      pthread_mutex_destroy(&s->lock);
+      // Nothing was written, this closes the hint and deletes the segment.
+      finish_segment(s, s->segments[s->segment_count - 1].id, s->hint);
+      goto fail;
+    }
+  }
+
+  *store = s;
+  return 0;
+
+fail:
+  for (unsigned int i = 0; i < s->segment_count; i++) {
+    close(s->segments[i].fd);
+  }
+  return 1;
+}
+
+int kv_store_close(kv_store *store) {
+  if (store == NULL) {
+    return 1;
+  }
+
+  int result = 0;
+  if (store->compacting) {
+    result = kv_store_compact_wait(store);
+  }
+
+  if (store->sync_mode == KV_STORE_SYNC_GROUP) {
+    pthread_mutex_lock(&store->lock);
+    store->closing = 1;
+    pthread_cond_signal(&store->flusher_wake);
+    pthread_mutex_unlock(&store->lock);
+
+    pthread_join(store->flusher, NULL);
+    pthread_cond_destroy(&store->flusher_wake);
+  }
+
+  pthread_mutex_lock(&store->lock);
+
+  const uint32_t id = store->segments[store->segment_count - 1].id;
+  result |= finish_segment(store, id, store->hint);
+  store->hint = NULL;
+
+  for (unsigned int i = 0; i < store->segment_count; i++) {
+    close(store->segments[i].fd);
+  }
+  store->segment_count = 0;
+
+  pthread_mutex_unlock(&store->lock);
+  pthread_mutex_destroy(&store->lock);
+  return result | sync_directory(store);
+}
+
+int kv_store_size(kv_store *store) {
+  if (store == NULL) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&store->lock);
+  int size = flat_hash_table_size(store->index);
+  pthread_mutex_unlock(&store->lock);
+  return size;
+}
+
+int kv_store_put(kv_store *store, const char *key, const void *value,
+                 uint32_t value_size) {
+  if (store == NULL || key == NULL || (value == NULL && value_size > 0) ||
+      value_size == TOMBSTONE) {
+    return 1;
+  }
+
+  const size_t key_size = strlen(key);
+  if (key_size > KV_STORE_MAX_KEY_SIZE) {
+    return 1;
+  }
+
+  location at;
+  pthread_mutex_lock(&store->lock);
+
+  int result = append_record(store, key, key_size, value, value_size, &at);
+
+  pthread_mutex_unlock(&store->lock);
+  return result;
+}
+
+int kv_store_get(kv_store *store, const char *key, void *value,
+                 uint32_t capacity, uint32_t *value_size) {
+  if (store == NULL || key == NULL || (value == NULL && capacity > 0)) {
+    return 1;
+  }
+
+  location at;
+  int result = 1;
+  pthread_mutex_lock(&store->lock);
+
+  if (flat_hash_table_lookup(store->index, key, &at) == 1) {
+    goto exit;
+  }
+
+  const segment *s = find_segment(store, at.segment);
+  const uint32_t key_size = strlen(key);
+  const uint32_t size = capacity < at.value_size ? capacity : at.value_size;
+
+  if (pread(s->fd, value, size, at.offset + sizeof(record_header) + key_size) !=
+      (ssize_t)size) {
+    goto exit;
+  }
+
+  // Only a complete value can be checked.
+  if (size == at.value_size) {
+    record_header header;
+
+    if (pread(s->fd, &header, sizeof(header), at.offset) !=
+            (ssize_t)sizeof(header) ||
+        header.key_size != key_size || header.value_size != at.value_size ||
+        record_crc(&header, key, value) != header.crc) {
+      goto exit;
+    }
+  }
+
+  if (value_size != NULL) {
+    *value_size = at.value_size;
+  }
+  result = 0;
+
+exit:
+  pthread_mutex_unlock(&store->lock);
+  return result;
+}
+
+int kv_store_delete(kv_store *store, const char *key) {
+  if (store == NULL || key == NULL) {
+    return 1;
+  }
+
+  location at;
+  int result = 1;
+  pthread_mutex_lock(&store->lock);
+
+  if (flat_hash_table_lookup(store->index, key, &at) == 0) {
+    result = append_record(store, key, strlen(key), NULL, TOMBSTONE, &at);
+  }
+
+  pthread_mutex_unlock(&store->lock);
+  return result;
+}
+
+int kv_store_sync(kv_store *store) {
+  if (store == NULL) {
+    return 1;
+  }
+
+  pthread_mutex_lock(&store->lock);
+  int result = flush_writes(store);
+  pthread_mutex_unlock(&store->lock);
+  return result;
+}
+
+/**
+ * Copy the live records of segment 'id' to the end of the compaction
+ * segment, and point the index at the copies.
+ *
+ * Liveness is checked under the lock before copying and again before
+ * switching the index, a key written in between keeps its newer record.
+ */
+static int compact_segment(kv_store *store, uint32_t id, uint64_t size,
+                           int out_fd, uint64_t *out_offset) {
+  char path[PATH_MAX];
+  char key[KV_STORE_MAX_KEY_SIZE + 1];
+  char *buffer = store->copy_buffer;
+  record_header header;
+  location at;
+  uint64_t offset = 0;
+  int result = 1;
+
+  segment_path(store, id, ".log", path);
+  FILE *log = fopen(path, "rb");
+  if (log == NULL) {
+    return 1;
+  }
+
+  for (; offset < size; offset += record_size(header.key_size,
+                                              header.value_size)) {
+    if (fread(&header, sizeof(header), 1, log) != 1 ||
+        header.key_size > KV_STORE_MAX_KEY_SIZE ||
+        fread(key, 1, header.key_size, log) != header.key_size) {
+      goto exit;
+    }
+
+    key[header.key_size] = '\0';
+
+    // Deletes are dropped, every older record of the key is compacted too.
+    if (header.value_size == TOMBSTONE) {
+      continue;
+    }
+
+    pthread_mutex_lock(&store->lock);
+    int live = flat_hash_table_lookup(store->index, key, &at) == 0 &&
+               at.segment == id && at.offset == offset;
+    pthread_mutex_unlock(&store->lock);
+
+    if (!live) {
+      if (fseek(log, header.value_size, SEEK_CUR) != 0) {
+        goto exit;
+      }
+      continue;
+    }
+
+    uint32_t crc = crc32c(0, &header.key_size, 2 * sizeof(uint32_t));
+    crc = crc32c(crc, key, header.key_size);
+
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), key, header.key_size);
+
+    uint64_t used = sizeof(header) + header.key_size;
+    uint64_t position = *out_offset;
+    uint64_t remaining = header.value_size;
+
+    do {
+      const uint64_t room = COPY_BUFFER_SIZE - used;
+      const size_t chunk = remaining < room ? remaining : room;
+
+      if (fread(buffer + used, 1, chunk, log) != chunk) {
+        goto exit;
+      }
+
+      crc = crc32c(crc, buffer + used, chunk);
+      used += chunk;
+      remaining -= chunk;
+
+      if (used == COPY_BUFFER_SIZE || remaining == 0) {
+        if (pwrite(out_fd, buffer, used, position) != (ssize_t)used) {
+          goto exit;
+        }
+        position += used;
+        used = 0;
+      }
+    } while (remaining > 0);
+
+    if (crc != header.crc ||
+        write_hint(store->compaction_hint, key, header.key_size,
+                   header.value_size, *out_offset) == 1) {
+      goto exit;
+    }
+
+    pthread_mutex_lock(&store->lock);
+    if (flat_hash_table_lookup(store->index, key, &at) == 0 &&
+        at.segment == id && at.offset == offset) {
+      at.segment = store->compaction_id;
+      at.offset = *out_offset;
+      // The key exists, updating it does not allocate.
+      flat_hash_table_insert_or_update(store->index, key, &at);
+    }
+    pthread_mutex_unlock(&store->lock);
+
+    *out_offset = position;
+  }
+
+  result = 0;
+
+exit:
+  fclose(log);
+  return result;
+}
+
+/**
+ * Compact every segment older than the compaction segment, then delete
+ * them. Runs without allocating, the arena is not thread safe.
+ */
+static void *compact(void *arg) {
+  kv_store *store = arg;
+  const uint32_t out_id = store->compaction_id;
+  uint64_t out_offset = 0;
+  uint32_t next = 0;
+  int result = 0;
+
+  pthread_mutex_lock(&store->lock);
+  const int out_fd = find_segment(store, out_id)->fd;
+  pthread_mutex_unlock(&store->lock);
+
+  while (result == 0) {
+    uint32_t id = UINT32_MAX;
+    uint64_t size = 0;
+
+    pthread_mutex_lock(&store->lock);
+    for (unsigned int i = 0; i < store->segment_count; i++) {
+      if (store->segments[i].id >= next) {
+        id = store->segments[i].id;
+        size = store->segments[i].size;
+        break;
+      }
+    }
+    pthread_mutex_unlock(&store->lock);
+
+    if (id >= out_id) {
+      break;
+    }
+
+    result = compact_segment(store, id, size, out_fd, &out_offset);
+    next = id + 1;
+  }
+
+  // On failure the old segments stay, and recovery scans the partial copy.
+  if (result == 0) {
+    result = fdatasync(out_fd) == 0 ? 0 : 1;
+  }
+
+  if (result == 0) {
+    result = publish_hint(store, out_id, store->compaction_hint);
+  } else {
+    char path[PATH_MAX];
+    fclose(store->compaction_hint);
+    segment_path(store, out_id, ".hint.tmp", path);
+    unlink(path);
+  }
+  store->compaction_hint = NULL;
+
+  // The compacted segment and its hint must be on disk before the old ones go.
+  if (result == 0) {
+    result = sync_directory(store);
+  }
+
+  pthread_mutex_lock(&store->lock);
+  find_segment(store, out_id)->size = out_offset;
+
+  if (result == 0) {
+    while (store->segments[0].id < out_id) {
+      remove_segment(store, &store->segments[0]);
+    }
+  }
+  pthread_mutex_unlock(&store->lock);
+
+  store->compaction_result = result | sync_directory(store);
+  return NULL;
+}
+
+int kv_store_compact(kv_store *store) {
+  if (store == NULL) {
+    return 1;
+  }
+
+  char path[PATH_MAX];
+  int result = 1;
+  pthread_mutex_lock(&store->lock);
+
+  if (store->compacting) {
+    goto exit;
+  }
+
+  // The compaction segment sits between the old segments and the new active.
+  const uint32_t id = store->next_id++;
+  if (rotate(store) == 1) {
+    goto exit;
+  }
+
+  if (store->segments[0].id > id) {
+    goto exit; // nothing written before
+  }
+
+  segment_path(store, id, ".log", path);
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    goto exit;
+  }
+
+  segment_path(store, id, ".hint.tmp", path);
+  if ((store->compaction_hint = fopen(path, "wb")) == NULL ||
+      add_segment(store, id, fd, 0) == 1) {
+    if (store->compaction_hint != NULL) {
+      fclose(store->compaction_hint);
+      store->compaction_hint = NULL;
+    }
+    unlink(path);
+    segment_path(store, id, ".log", path);
+    unlink(path);
+    close(fd);
+    goto exit;
+  }
+
+  store->compaction_id = id;
+  store->compacting = 1;
+  result = 0;
+
+exit:
+  pthread_mutex_unlock(&store->lock);
+
+  if (result == 0) {
+    store->compaction_joinable =
+        pthread_create(&store->compaction, NULL, compact, store) == 0;
+
+    if (!store->compaction_joinable) {
+      compact(store);
+    }
+  }
+
+  return result;
+}
+
+int kv_store_compact_wait(kv_store *store) {
+  if (store == NULL || !store->compacting) {
+    return 1;
+  }
+
+  if (store->compaction_joinable) {
+    pthread_join(store->compaction, NULL);
+    store->compaction_joinable = 0;
+  }
+
+  store->compacting = 0;
+  return store->compaction_result;
+}
@@ -0,0 +1,483 @@
+#include "lru_cache.h"
+#include "hash_group.h"
+#include "hash_table.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FALSE 0
+
+/**
+ * Marks the end of the recency and free lists.
+ */
+#define NIL UINT32_MAX
+
+/**
+ * Number of index slots per entry, keeps probes short even with tombstones.
+ */
+#define INDEX_SLOTS_PER_ENTRY 2
+
+/**
+ * Entry header, the key follows it in the same record.
+ */
+typedef struct node {
+  uint32_t prev;       // more recently used, NIL for the head
+  uint32_t next;       // less recently used or next free, NIL for the tail
+  uint32_t hash_code;  // 32 bits of the key hash, shard bits excluded
+  uint32_t key_length; // length of the key excluding '\0'
+  void *value;
+  uint64_t size; // bytes charged for the entry
+} node;
+
+/**
+ * Own cache line, so shards locked by different threads do not share one.
+ */
+typedef struct shard {
+  alignas(64) pthread_mutex_t lock;
+  uint8_t *records;        // 'capacity' nodes, each followed by its key
+  uint32_t *slots;         // node of every index slot
+  int8_t *ctrl;            // tag of every index slot
+  unsigned int mask;       // index slots - 1
+  unsigned int size;       // number of entries
+  unsigned int tombstones; // deleted index slots
+  uint32_t head;           // most recently used
+  uint32_t tail;           // least recently used, evicted first
+  uint32_t free;           // first unused node
+  uint64_t bytes;          // size of every entry added up
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+} shard;
+
+struct lru_cache {
+  shard *shards;
+  unsigned int shard_bits;     // log2 of the number of shards
+  unsigned int capacity;       // entries per shard
+  uint64_t max_bytes;          // bytes per shard, 0 for no limit
+  unsigned int max_key_length; // longest accepted key
+  uint64_t record_size;        // node plus key, rounded to the node alignment
+  uint64_t seed;               // passed to 'hash_table_hash64'
+};
+
+static inline node *node_at(const lru_cache *cache, const shard *s,
+                            uint32_t index) {
+  return (node *)(s->records + index * cache->record_size);
+}
+
+static inline char *node_key(node *n) { return (char *)(n + 1); }
+
+/**
+ * Index slot of the node with 'key'.
+ *
+ * @return index slot, -1 otherwise
+ */
+static long find_slot(const lru_cache *cache, const shard *s, const char *key,
+                      unsigned int key_length, uint32_t hash_code) {
+  const int8_t tag = H2(hash_code);
+  unsigned int position = H1(hash_code) & s->mask;
+  unsigned int stride = 0;
+
+  while (1) {
+    const int8_t *group = s->ctrl + position;
+
+    for (uint32_t match = group_match(group, tag); match != 0;
+         match &= match - 1) {
+      const unsigned int slot = (position + __builtin_ctz(match)) & s->mask;
+      node *n = node_at(cache, s, s->slots[slot]);
+
+      if (n->hash_code == hash_code && n->key_length == key_length &&
+          memcmp(node_key(n), key, key_length) == 0) {
+        return slot;
+      }
+    }
+
+    if (group_match(group, CTRL_EMPTY) != 0) {
+      return -1;
+    }
+
+    stride += GROUP_WIDTH;
+    position = (position + stride) & s->mask;
+  }
+}
+
+/**
+ * Index slot pointing at node 'index', which MUST be indexed.
+ */
+static unsigned int find_node_slot(const lru_cache *cache, const shard *s,
+                                   uint32_t index) {
+  const uint32_t hash_code = node_at(cache, s, index)->hash_code;
+  const int8_t tag = H2(hash_code);
+  unsigned int position = H1(hash_code) & s->mask;
+  unsigned int stride = 0;
+
+  while (1) {
+    for (uint32_t match = group_match(s->ctrl + position, tag); match != 0;
+         match &= match - 1) {
+      const unsigned int slot = (position + __builtin_ctz(match)) & s->mask;
+
+      if (s->slots[slot] == index) {
+        return slot;
+      }
+    }
+
+    stride += GROUP_WIDTH;
+    position = (position + stride) & s->mask;
+  }
+}
+
+/**
+ * Index every entry again, turning every tombstone back into empty.
+ */
+static void rebuild_index(lru_cache *cache, shard *s) {
+  memset(s->ctrl, CTRL_EMPTY, s->mask + 1 + GROUP_WIDTH);
+  s->tombstones = 0;
+
+  for (uint32_t i = s->head; i != NIL; i = node_at(cache, s, i)->next) {
+    const uint32_t hash_code = node_at(cache, s, i)->hash_code;
+    const unsigned int slot = find_free_slot(s->ctrl, s->mask + 1, hash_code);
+
+    set_ctrl(s->ctrl, s->mask + 1, slot, H2(hash_code));
+    s->slots[slot] = i;
+  }
+}
+
+static void unlink_node(lru_cache *cache, shard *s, uint32_t index) {
+  node *n = node_at(cache, s, index);
+
+  if (n->prev != NIL) {
+    node_at(cache, s, n->prev)->next = n->next;
+  } else {
+    s->head = n->next;
+  }
+
+  if (n->next != NIL) {
+    node_at(cache, s, n->next)->prev = n->prev;
+  } else {
+    s->tail = n->prev;
+  }
+}
+
+static void push_front(lru_cache *cache, shard *s, uint32_t index) {
+  node *n = node_at(cache, s, index);
+
+  n->prev = NIL;
+  n->next = s->head;
+
+  if (s->head != NIL) {
+    node_at(cache, s, s->head)->prev = index;
+  } else {
+    s->tail = index;
+  }
+
+  s->head = index;
+}
+
+/**
+ * Drop the entry of node 'index' indexed at 'slot', its node becomes free.
+ */
+static void remove_node(lru_cache *cache, shard *s, unsigned int slot,
+                        uint32_t index) {
+  node *n = node_at(cache, s, index);
+
+  if (was_never_full(s->ctrl, s->mask + 1, slot)) {
+    set_ctrl(s->ctrl, s->mask + 1, slot, CTRL_EMPTY);
+  } else {
+    set_ctrl(s->ctrl, s->mask + 1, slot, CTRL_DELETED);
+    s->tombstones++;
+  }
+
+  unlink_node(cache, s, index);
+  s->bytes -= n->size;
+  s->size--;
+
+  n->next = s->free;
+  s->free = index;
+}
+
+/**
+ * Shard of 'key', and the hash code used inside it.
+ */
+static shard *shard_of(const lru_cache *cache, const char *key,
+                       unsigned int key_length, uint32_t *hash_code) {
+  const uint64_t hash = hash_table_hash64(key, key_length, cache->seed);
+
+  *hash_code = (uint32_t)hash;
+
+  // The top bits pick the shard, the bottom ones the index slot.
+  return &cache->shards[cache->shard_bits == 0
+                            ? 0
+                            : hash >> (64 - cache->shard_bits)];
+}
+
+int lru_cache_create(lru_cache **cache, unsigned int capacity,
+                     uint64_t max_bytes, unsigned int max_key_length,
+                     unsigned int shards, arena *arena) {
+  ASSERT(arena != NULL, "arena MUST be provided");
+
+  if (capacity == 0 || shards == 0) {
+    return 1;
+  }
+
+  if ((*cache = arena_alloc(arena, sizeof(lru_cache), alignof(lru_cache),
+                            FALSE)) == NULL) {
+    return 1;
+  }
+
+  lru_cache *c = *cache;
+  const unsigned int count = ROUND_POW2(shards);
+
+  c->shard_bits = __builtin_ctz(count);
+  c->capacity = (capacity + count - 1) / count;
+  c->max_bytes = max_bytes == 0 ? 0 : (max_bytes + count - 1) / count;
+  c->max_key_length = max_key_length;
+  c->record_size = (sizeof(node) + max_key_length + 1 + alignof(node) - 1) &
+                   ~(uint64_t)(alignof(node) - 1);
+  c->seed = (uint64_t)(uintptr_t)c * 0x9E3779B97F4A7C15ULL;
+
+  const unsigned int index_slots =
+      ROUND_POW2(c->capacity * INDEX_SLOTS_PER_ENTRY) < GROUP_WIDTH
+          ? GROUP_WIDTH
+          : ROUND_POW2(c->capacity * INDEX_SLOTS_PER_ENTRY);
+
+  if ((c->shards = arena_alloc(arena, sizeof(shard) * count, alignof(shard),
+                               FALSE)) == NULL) {
+    return 1;
+  }
+
+  for (unsigned int i = 0; i < count; i++) {
+    shard *s = &c->shards[i];
+
+    if ((s->records = arena_alloc(arena, c->record_size * c->capacity,
+                                  alignof(node), FALSE)) == NULL ||
+        (s->slots = arena_alloc(arena, sizeof(uint32_t) * index_slots,
+                                alignof(uint32_t), FALSE)) == NULL ||
+        (s->ctrl = arena_alloc(arena, index_slots + GROUP_WIDTH,
+                               alignof(int8_t), FALSE)) == NULL) {
+      return 1;
+    }
+
+    pthread_mutex_init(&s->lock, NULL);
+    memset(s->ctrl, CTRL_EMPTY, index_slots + GROUP_WIDTH);
+    s->mask = index_slots - 1;
+    s->size = 0;
+    s->tombstones = 0;
+    s->head = NIL;
+    s->tail = NIL;
+    s->bytes = 0;
+    s->hits = 0;
+    s->misses = 0;
+    s->evictions = 0;
+
+    // Every node starts on the free list.
+    for (uint32_t n = 0; n < c->capacity; n++) {
+      node_at(c, s, n)->next = n + 1 < c->capacity ? n + 1 : NIL;
+    }
+    s->free = 0;
+  }
+
+  return 0;
+}
+
+int lru_cache_size(lru_cache *cache) {
+  if (cache == NULL) {
+    return -1;
+  }
+
+  unsigned int size = 0;
+
+  for (unsigned int i = 0; i < 1U << cache->shard_bits; i++) {
+    pthread_mutex_lock(&cache->shards[i].lock);
+    size += cache->shards[i].size;
+    pthread_mutex_unlock(&cache->shards[i].lock);
+  }
+
+  return size;
+}
+
+/**
+ * Shared by get and peek, 'touch' marks the entry as the most recently used.
+ */
+static int lookup(lru_cache *cache, const char *key, void **value, int touch) {
+  if (cache == NULL) {
+    return 1;
+  }
+
+  const unsigned int key_length = strlen(key);
+  uint32_t hash_code;
+  shard *s = shard_of(cache, key, key_length, &hash_code);
+  int result = 1;
+
+  pthread_mutex_lock(&s->lock);
+
+  const long slot = find_slot(cache, s, key, key_length, hash_code);
+
+  if (slot != -1) {
+    const uint32_t index = s->slots[slot];
+
+    *value = node_at(cache, s, index)->value;
+    result = 0;
+
+    if (touch && index != s->head) {
+      unlink_node(cache, s, index);
+      push_front(cache, s, index);
+    }
+  } else {
+    *value = NULL;
+  }
+
+  if (touch) {
+    if (result == 0) {
+      s->hits++;
+    } else {
+      s->misses++;
+    }
+  }
+
+  pthread_mutex_unlock(&s->lock);
+
+  return result;
+}
+
+int lru_cache_get(lru_cache *cache, const char *key, void **value) {
+  return lookup(cache, key, value, 1);
+}
+
+int lru_cache_peek(lru_cache *cache, const char *key, void **value) {
+  return lookup(cache, key, value, 0);
+}
+
+int lru_cache_put(lru_cache *cache, const char *key, void *value,
+                  uint64_t size) {
+  if (cache == NULL) {
+    return 1;
+  }
+
+  const unsigned int key_length = strlen(key);
+  const uint64_t entry_size = cache->max_bytes == 0 ? 0 : key_length + size;
+
+  if (key_length > cache->max_key_length ||
+      (cache->max_bytes != 0 && entry_size > cache->max_bytes)) {
+    return 1;
+  }
+
+  uint32_t hash_code;
+  shard *s = shard_of(cache, key, key_length, &hash_code);
+
+  pthread_mutex_lock(&s->lock);
+
+  long slot = find_slot(cache, s, key, key_length, hash_code);
+
+  if (slot != -1) { // update in place
+    const uint32_t index = s->slots[slot];
+    node *n = node_at(cache, s, index);
+
+    s->bytes += entry_size - n->size;
+    n->value = value;
+    n->size = entry_size;
+
+    if (index != s->head) {
+      unlink_node(cache, s, index);
+      push_front(cache, s, index);
+    }
+  }
+
+  // Evict from the tail until the entry fits, never the entry just updated.
+  const int is_new_key = slot == -1;
+
+  while (s->tail != NIL &&
+         ((is_new_key && s->free == NIL) ||
+          (cache->max_bytes != 0 &&
+           s->bytes + (is_new_key ? entry_size : 0) > cache->max_bytes))) {
+    const uint32_t victim = s->tail;
+
+    if (!is_new_key && victim == s->head) {
+      break;
+    }
+
+    remove_node(cache, s, find_node_slot(cache, s, victim), victim);
+    s->evictions++;
+  }
+
+  if (!is_new_key) {
+    pthread_mutex_unlock(&s->lock);
+    return 0;
+  }
+
+  // Tombstones count towards the load, drop them before probes get long.
+  if ((s->size + s->tombstones + 1) * 8 > (s->mask + 1) * 7) {
+    rebuild_index(cache, s);
+  }
+
+  const uint32_t index = s->free;
+  node *n = node_at(cache, s, index);
+
+  s->free = n->next;
+  n->hash_code = hash_code;
+  n->key_length = key_length;
+  n->value = value;
+  n->size = entry_size;
+  memcpy(node_key(n), key, key_length);
+  node_key(n)[key_length] = '\0';
+  push_front(cache, s, index);
+
+  slot = find_free_slot(s->ctrl, s->mask + 1, hash_code);
+  if (s->ctrl[slot] == CTRL_DELETED) {
+    s->tombstones--;
+  }
+  set_ctrl(s->ctrl, s->mask + 1, slot, H2(hash_code));
+  s->slots[slot] = index;
+  s->bytes += entry_size;
+  s->size++;
+
+  pthread_mutex_unlock(&s->lock);
+
+  return 0;
+}
+
+int lru_cache_remove(lru_cache *cache, const char *key) {
+  if (cache == NULL) {
+    return 1;
+  }
+
+  const unsigned int key_length = strlen(key);
+  uint32_t hash_code;
+  shard *s = shard_of(cache, key, key_length, &hash_code);
+
+  pthread_mutex_lock(&s->lock);
+
+  const long slot = find_slot(cache, s, key, key_length, hash_code);
+
+  if (slot != -1) {
+    remove_node(cache, s, slot, s->slots[slot]);
+  }
+
+  pthread_mutex_unlock(&s->lock);
+
+  return slot == -1;
+}
+
+int lru_cache_stats(lru_cache *cache, uint64_t *hits, uint64_t *misses,
+                    uint64_t *evictions) {
+  if (cache == NULL) {
+    return 1;
+  }
+
+  *hits = 0;
+  *misses = 0;
+  *evictions = 0;
+
+  for (unsigned int i = 0; i < 1U << cache->shard_bits; i++) {
+    shard *s = &cache->shards[i];
+
+    pthread_mutex_lock(&s->lock);
+    *hits += s->hits;
+    *misses += s->misses;
+    *evictions += s->evictions;
+    pthread_mutex_unlock(&s->lock);
+  }
+
+  return 0;
+}
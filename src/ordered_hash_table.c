@@ -0,0 +1,505 @@
+#include "ordered_hash_table.h"
+#include "hash_table.h"
+#include "utils.h"
+
+#include <stdalign.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FALSE 0
+
+/**
+ * Smallest index, 'usable' is 5 entries.
+ */
+#define MIN_CAPACITY 8
+
+/**
+ * Index values that are not positions in the entries.
+ */
+#define INDEX_EMPTY -1
+#define INDEX_DELETED -2
+
+/**
+ * Bits of the hash mixed into each probe step.
+ */
+#define PERTURB_SHIFT 5
+
+struct ordered_hash_table_entry {
+  char *key; // NULL once deleted
+  void *value;
+  unsigned int hash_code;  // hash of 'key', reused on resize
+  unsigned int key_length; // length of 'key' excluding '\0'
+};
+
+struct ordered_hash_table {
+  ordered_hash_table_entry *entries; // dense, in insertion order
+  void *index;                       // 'capacity' positions in 'entries'
+  arena *arena;                      // memory block for allocations
+  uint64_t seed;                     // passed to 'hash_table_hash64'
+  unsigned int size;                 // number of entries
+  unsigned int used;                 // entries written, deleted included
+  unsigned int usable;               // length of 'entries', 2/3 of capacity
+  unsigned int capacity;             // number of index slots
+  unsigned int index_width;          // 1, 2 or 4 bytes per index slot
+};
+
+struct ordered_hash_table_iterator {
+  ordered_hash_table_entry *entries;
+  unsigned int used;
+  unsigned int index; // current index
+};
+
+static inline unsigned int hash(const ordered_hash_table *ht, const char *key,
+                                unsigned int key_length) {
+  const uint64_t hash_code = hash_table_hash64(key, key_length, ht->seed);
+
+  return (unsigned int)(hash_code ^ (hash_code >> 32));
+}
+
+/**
+ * Narrowest signed integer holding every position of 'capacity' slots.
+ */
+static inline unsigned int index_width(unsigned int capacity) {
+  return capacity <= 128 ? 1 : capacity <= 32768 ? 2 : 4;
+}
+
+static inline long index_get(const ordered_hash_table *ht, unsigned int slot) {
+  switch (ht->index_width) {
+  case 1:
+    return ((const int8_t *)ht->index)[slot];
+  case 2:
+    return ((const int16_t *)ht->index)[slot];
+  default:
+    return ((const int32_t *)ht->index)[slot];
+  }
+}
+
+static inline void index_set(ordered_hash_table *ht, unsigned int slot,
+                             long position) {
+  switch (ht->index_width) {
+  case 1:
+    ((int8_t *)ht->index)[slot] = (int8_t)position;
+    break;
+  case 2:
+    ((int16_t *)ht->index)[slot] = (int16_t)position;
+    break;
+  default:
+    ((int32_t *)ht->index)[slot] = (int32_t)position;
+    break;
+  }
+}
+
+/**
+ * Size of the arena block holding the entries and the index.
+ */
+static inline uint64_t slots_size(unsigned int capacity) {
+  return (uint64_t)(capacity * 2 / 3) * sizeof(ordered_hash_table_entry) +
+         (uint64_t)capacity * index_width(capacity);
+}
+
+/**
+ * Retreive the index slot of a hash table entry.
+ *
+ * Probes like CPython, the higher bits of the hash are shifted in at every
+ * step until the sequence becomes 'slot * 5 + 1', which visits every slot.
+ *
+ * @param ht hash table to search.
+ * @param key identifier used to search for.
+ * @param key_length length of 'key'.
+ * @param hash_code hash code of 'key'.
+ * @param free_slot where to store the first empty/deleted slot on the probe
+ *        sequence, can be NULL.
+ * @return index slot of the entry with 'key', -1 otherwise
+ */
+static long find_slot(const ordered_hash_table *ht, const char *key,
+                      unsigned int key_length, unsigned int hash_code,
+                      long *free_slot) {
+  const unsigned int mask = ht->capacity - 1;
+  unsigned int perturb = hash_code;
+  unsigned int slot = hash_code & mask;
+
+  if (free_slot != NULL) {
+    *free_slot = -1;
+  }
+
+  while (1) {
+    const long position = index_get(ht, slot);
+
+    if (position == INDEX_EMPTY) {
+      if (free_slot != NULL && *free_slot == -1) {
+        *free_slot = slot;
+      }
+      return -1;
+    }
+
+    if (position == INDEX_DELETED) {
+      if (free_slot != NULL && *free_slot == -1) {
+        *free_slot = slot;
+      }
+    } else {
+      const ordered_hash_table_entry *entry = &ht->entries[position];
+
+      if (entry->hash_code == hash_code && entry->key_length == key_length &&
+          memcmp(entry->key, key, key_length) == 0) {
+        return slot;
+      }
+    }
+
+    perturb >>= PERTURB_SHIFT;
+    slot = (slot * 5 + perturb + 1) & mask;
+  }
+}
+
+/**
+ * Allocate the entries and an index with every slot empty.
+ *
+ * @param ht hash table to modify.
+ * @param capacity number of index slots to allocate.
+ * @return 0 on success, 1 otherwise
+ */
+static int allocate_slots(ordered_hash_table *ht, unsigned int capacity) {
+  const unsigned int usable = capacity * 2 / 3;
+  uint8_t *block = arena_alloc(ht->arena, slots_size(capacity),
+                               alignof(ordered_hash_table_entry), FALSE);
+
+  if (block == NULL) {
+    return 1;
+  }
+
+  ht->entries = (ordered_hash_table_entry *)block;
+  ht->index = block + (uint64_t)usable * sizeof(ordered_hash_table_entry);
+  ht->capacity = capacity;
+  ht->usable = usable;
+  ht->index_width = index_width(capacity);
+  ht->used = 0;
+
+  // every byte 0xFF reads as INDEX_EMPTY whatever the width
+  memset(ht->index, 0xFF, (uint64_t)capacity * ht->index_width);
+
+  return 0;
+}
+
+/**
+ * Give the dropped entries and index back to the arena.
+ *
+ * When the current ones directly follow them, both are given back and the
+ * current ones slide down to the start of the dropped ones.
+ *
+ * @param ht hash table to modifiy.
+ * @param entries the dropped entries, followed by their index.
+ * @param capacity number of index slots after 'entries'.
+ */
+static void release_slots(ordered_hash_table *ht,
+                          ordered_hash_table_entry *entries,
+                          unsigned int capacity) {
+  uint8_t *block = (uint8_t *)entries;
+  uint8_t *current = (uint8_t *)ht->entries;
+  const uint64_t size = slots_size(capacity);
+  const uint64_t current_size = slots_size(ht->capacity);
+
+  if (block + size == current &&
+      arena_free_last(ht->arena, current, current_size) == 0) {
+    arena_free_last(ht->arena, block, size);
+    block = arena_alloc(ht->arena, current_size,
+                        alignof(ordered_hash_table_entry), FALSE);
+    memmove(block, current, current_size);
+
+    ht->entries = (ordered_hash_table_entry *)block;
+    ht->index =
+        block + (uint64_t)ht->usable * sizeof(ordered_hash_table_entry);
+    return;
+  }
+
+  arena_free_last(ht->arena, block, size);
+}
+
+/**
+ * Move the live entries into new arrays, keeping their order and closing
+ * the holes left by deletions.
+ *
+ * @param ht hash table to modifiy.
+ * @param capacity the new number of index slots.
+ * @return 0 on success, 1 otherwise
+ */
+static int ordered_hash_table_resize(ordered_hash_table *ht,
+                                     unsigned int capacity) {
+  ordered_hash_table_entry *old_entries = ht->entries;
+  const unsigned int old_used = ht->used;
+  const unsigned int old_capacity = ht->capacity;
+
+  if (allocate_slots(ht, capacity) == 1) {
+    return 1;
+  }
+
+  const unsigned int mask = capacity - 1;
+
+  for (unsigned int i = 0; i < old_used; i++) {
+    if (old_entries[i].key == NULL) {
+      continue;
+    }
+
+    // No key can be there already, only look for an empty slot.
+    unsigned int perturb = old_entries[i].hash_code;
+    unsigned int slot = perturb & mask;
+
+    while (index_get(ht, slot) != INDEX_EMPTY) {
+      perturb >>= PERTURB_SHIFT;
+      slot = (slot * 5 + perturb + 1) & mask;
+    }
+
+    index_set(ht, slot, ht->used);
+    ht->entries[ht->used++] = old_entries[i];
+  }
+
+  release_slots(ht, old_entries, old_capacity);
+
+  return 0;
+}
+
+/**
+ *  Find the entry for 'key', appending a new one when it is absent.
+ *
+ *  A new entry has its key stored, the caller stores the value.
+ *
+ *  @param ht hash_table to modify
+ *  @param key the hash table entry key to search
+ *  @param is_new_key where to store whether 'key' was absent.
+ *  @return hash table entry with 'key', NULL otherwise
+ */
+static ordered_hash_table_entry *
+handle_pre_insertion(ordered_hash_table *ht, const char *key,
+                     int *is_new_key) {
+  if (ht == NULL) {
+    return NULL;
+  }
+
+  if (ht->entries == NULL && allocate_slots(ht, ht->capacity) == 1) {
+    return NULL;
+  }
+
+  const unsigned int key_length = strlen(key);
+  const unsigned int hash_code = hash(ht, key, key_length);
+  long free_slot;
+  long slot = find_slot(ht, key, key_length, hash_code, &free_slot);
+
+  if (slot != -1) {
+    *is_new_key = 0;
+    return &ht->entries[index_get(ht, slot)];
+  }
+
+  // Out of entries, deleted ones included. Sized on the live entries, so
+  // after many deletions this shrinks the table.
+  if (ht->used == ht->usable) {
+    const unsigned int capacity = ROUND_POW2((ht->size + 1) * 3);
+
+    if (ordered_hash_table_resize(
+            ht, capacity < MIN_CAPACITY ? MIN_CAPACITY : capacity) == 1) {
+      return NULL;
+    }
+
+    find_slot(ht, key, key_length, hash_code, &free_slot);
+  }
+
+  char *copy = arena_alloc(ht->arena, key_length + 1, alignof(char), FALSE);
+
+  if (copy == NULL) {
+    return NULL;
+  }
+
+  memcpy(copy, key, key_length + 1);
+
+  ordered_hash_table_entry *entry = &ht->entries[ht->used];
+  entry->key = copy;
+  entry->hash_code = hash_code;
+  entry->key_length = key_length;
+
+  index_set(ht, free_slot, ht->used++);
+  ht->size++;
+  *is_new_key = 1;
+
+  return entry;
+}
+
+int ordered_hash_table_create(ordered_hash_table **ht,
+                              unsigned int initial_capacity, arena *arena) {
+  ASSERT(arena != NULL, "arena MUST be provided");
+
+  if ((*ht = arena_alloc(arena, sizeof(ordered_hash_table),
+                         alignof(ordered_hash_table), FALSE)) == NULL) {
+    return 1;
+  }
+
+  // Only 2/3 of the index slots get an entry.
+  const unsigned int capacity = ROUND_POW2((initial_capacity * 3 + 1) / 2);
+
+  (*ht)->capacity = capacity < MIN_CAPACITY ? MIN_CAPACITY : capacity;
+  (*ht)->arena = arena;
+  (*ht)->seed = (uint64_t)(uintptr_t)*ht * 0x9E3779B97F4A7C15ULL;
+  (*ht)->entries = NULL;
+  (*ht)->index = NULL;
+  (*ht)->size = 0;
+  (*ht)->used = 0;
+  (*ht)->usable = 0;
+  (*ht)->index_width = 0;
+
+  return 0;
+}
+
+int ordered_hash_table_size(ordered_hash_table *ht) {
+  if (ht == NULL) {
+    return -1;
+  }
+
+  return ht->size;
+}
+
+int ordered_hash_table_insert(ordered_hash_table *ht, const char *key,
+                              const void *value) {
+  int is_new_key;
+  ordered_hash_table_entry *entry = handle_pre_insertion(ht, key, &is_new_key);
+
+  if (entry == NULL || !is_new_key) {
+    return 1;
+  }
+
+  entry->value = (void *)value;
+
+  return 0;
+}
+
+int ordered_hash_table_insert_or_update(ordered_hash_table *ht,
+                                        const char *key, const void *value) {
+  int is_new_key;
+  ordered_hash_table_entry *entry = handle_pre_insertion(ht, key, &is_new_key);
+
+  if (entry == NULL) {
+    return 1;
+  }
+
+  entry->value = (void *)value;
+
+  return 0;
+}
+
+int ordered_hash_table_lookup(ordered_hash_table *ht, const char *key,
+                              void **value) {
+  if (ht == NULL || ht->size == 0) {
+    return 1;
+  }
+
+  const unsigned int key_length = strlen(key);
+  long slot = find_slot(ht, key, key_length, hash(ht, key, key_length), NULL);
+
+  if (slot == -1) {
+    return 1;
+  }
+
+  *value = ht->entries[index_get(ht, slot)].value;
+
+  return 0;
+}
+
+int ordered_hash_table_delete(ordered_hash_table *ht, const char *key) {
+  if (ht == NULL || ht->size == 0) {
+    return 1;
+  }
+
+  const unsigned int key_length = strlen(key);
+  long slot = find_slot(ht, key, key_length, hash(ht, key, key_length), NULL);
+
+  if (slot == -1) {
+    return 1;
+  }
+
+  // The entry stays as a hole until the next resize compacts the entries.
+  ordered_hash_table_entry *entry = &ht->entries[index_get(ht, slot)];
+  entry->key = NULL;
+  entry->value = NULL;
+
+  index_set(ht, slot, INDEX_DELETED);
+  ht->size--;
+
+  return 0;
+}
+
+int ordered_hash_table_memory(ordered_hash_table *ht, uint64_t *bytes) {
+  if (ht == NULL) {
+    *bytes = 0;
+    return 1;
+  }
+
+  *bytes = sizeof(ordered_hash_table);
+
+  if (ht->entries != NULL) {
+    *bytes += slots_size(ht->capacity);
+  }
+
+  return 0;
+}
+
+int ordered_hash_table_entry_key(ordered_hash_table_entry *entry, char **key) {
+  if (entry == NULL) {
+    *key = NULL;
+    return 1;
+  }
+  *key = entry->key;
+  return 0;
+}
+
+int ordered_hash_table_entry_value(ordered_hash_table_entry *entry,
+                                   void **value) {
+  if (entry == NULL) {
+    *value = NULL;
+    return 1;
+  }
+  *value = entry->value;
+  return 0;
+}
+
+int ordered_hash_table_iterator_create(ordered_hash_table_iterator **it,
+                                       ordered_hash_table *ht) {
+  if (ht == NULL || ht->size == 0) {
+    return 1;
+  }
+
+  if (((*it) = arena_alloc(ht->arena, sizeof(ordered_hash_table_iterator),
+                           alignof(ordered_hash_table_iterator), FALSE)) ==
+      NULL) {
+    return 1;
+  }
+
+  (*it)->entries = ht->entries;
+  (*it)->used = ht->used;
+  (*it)->index = 0;
+
+  return 0;
+}
+
+int ordered_hash_table_iterator_next(ordered_hash_table_iterator *it,
+                                     ordered_hash_table_entry **entry) {
+  if (it == NULL) {
+    return 1;
+  }
+
+  // Only the holes left by deletions are skipped.
+  while (it->index < it->used) {
+    ordered_hash_table_entry *current = &it->entries[it->index++];
+
+    if (current->key != NULL) {
+      *entry = current;
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+int ordered_hash_table_iterator_reset(ordered_hash_table_iterator *it) {
+  if (it == NULL) {
+    return 1;
+  }
+
+  it->index = 0;
+
+  return 0;
+}